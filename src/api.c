@@ -18,7 +18,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <float.h> /* for DBL_MAX */
 
 #include <libavcodec/avcodec.h>
@@ -35,8 +38,11 @@
 
 #include "sxplayer.h"
 #include "async.h"
+#include "framepool.h"
 #include "log.h"
+#include "membudget.h"
 #include "internal.h"
+#include "workpool.h"
 
 struct sxplayer_ctx {
     const AVClass *class;                   // necessary for the AVOption mechanism
@@ -51,6 +57,13 @@ struct sxplayer_ctx {
 
     AVFrame *cached_frame;
 
+    struct framepool *framepool;
+    struct framepool_cache framepool_cache;
+
+    sxplayer_frame_callback_type frame_cb;  // push mode callback, NULL for the pull mode
+    void *frame_cb_arg;
+    struct framepool_cache push_cache;      // wrappers of the pushed frames, used from the filtering module
+
     AVRational st_timebase;                 // stream timebase
 
     /* All the following ts are expressed in st_timebase unit */
@@ -59,10 +72,31 @@ struct sxplayer_ctx {
     int64_t first_ts;
     int64_t last_ts;
 
+    int64_t seek_inflight_ts;               // media time of the latest seek not yet honored by the pipeline (AV_TIME_BASE unit)
+    int64_t landing_vt;                     // media time served with the frame a seek landed on (AV_TIME_BASE unit)
+
+    /* Reverse playback window: the decoded frames preceding rev_end, sorted
+     * by ascending ts (st_timebase unit) */
+    AVFrame **rev_frames;
+    int nb_rev_frames;
+    int rev_capacity;
+    int64_t rev_end;                        // exclusive upper bound of the window, AV_NOPTS_VALUE for the end of the media
+    int64_t rev_prefetch_end;               // upper bound of the window being prefetched by the pipeline
+    int rev_active;                         // the pipeline was moved by the reverse playback
+
+    int frame_from_cache;                   // the latest pushed frame was obtained from the frame cache
+
+    int64_t configure_time;                 // time of the context configuration (av_gettime_relative() reference)
+    atomic_llong time_to_first_frame;       // time between the configuration and the first frame returned, 0 until then
+
     int64_t entering_time;
     const char *cur_func_name;
 };
 
+struct sxplayer_pool {
+    struct workpool *workpool;
+};
+
 #define OFFSET(x) offsetof(struct sxplayer_ctx, opts.x)
 static const AVOption sxplayer_options[] = {
     { "avselect",               NULL, OFFSET(avselect),               AV_OPT_TYPE_INT,       {.i64=SXPLAYER_SELECT_VIDEO}, 0, NB_SXPLAYER_MEDIA_SELECTION-1 },
@@ -79,6 +113,7 @@ static const AVOption sxplayer_options[] = {
     { "autorotate",             NULL, OFFSET(autorotate),             AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
     { "auto_hwaccel",           NULL, OFFSET(auto_hwaccel),           AV_OPT_TYPE_INT,       {.i64=1},       0, 1 },
     { "export_mvs",             NULL, OFFSET(export_mvs),             AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "export_mvs_grid",        NULL, OFFSET(export_mvs_grid),        AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
     { "pkt_skip_mod",           NULL, OFFSET(pkt_skip_mod),           AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
     { "thread_stack_size",      NULL, OFFSET(thread_stack_size),      AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
     { "opaque",                 NULL, OFFSET(opaque),                 AV_OPT_TYPE_BINARY,    {.str=NULL},    0, UINT64_MAX },
@@ -87,6 +122,28 @@ static const AVOption sxplayer_options[] = {
     { "vt_pix_fmt",             NULL, OFFSET(vt_pix_fmt),             AV_OPT_TYPE_STRING,    {.str="bgra"},  0, 0 },
     { "stream_idx",             NULL, OFFSET(stream_idx),             AV_OPT_TYPE_INT,       {.i64=-1},     -1, INT_MAX },
     { "use_pkt_duration",       NULL, OFFSET(use_pkt_duration),       AV_OPT_TYPE_INT,       {.i64=1},       0, 1 },
+    { "reverse",                NULL, OFFSET(reverse),                AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "max_nb_reverse_frames",  NULL, OFFSET(max_nb_reverse_frames),  AV_OPT_TYPE_INT,       {.i64=32},      1, 1000 },
+    { "frame_cache_size",       NULL, OFFSET(frame_cache_size),       AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "index_scan",             NULL, OFFSET(index_scan),             AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "index_cache_dir",        NULL, OFFSET(index_cache_dir),        AV_OPT_TYPE_STRING,    {.str=NULL},    0, 0 },
+    { "keyframes_only",         NULL, OFFSET(keyframes_only),         AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "pool",                   NULL, OFFSET(pool),                   AV_OPT_TYPE_BINARY,    {.str=NULL},    0, UINT64_MAX },
+    { "probesize",              NULL, OFFSET(probesize),              AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "analyzeduration",        NULL, OFFSET(analyzeduration),        AV_OPT_TYPE_DOUBLE,    {.dbl=0},       0, DBL_MAX },
+    { "fast_open",              NULL, OFFSET(fast_open),              AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "probe_cache",            NULL, OFFSET(probe_cache),            AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "playback_rate",          NULL, OFFSET(playback_rate),          AV_OPT_TYPE_DOUBLE,    {.dbl=1},       0, DBL_MAX },
+    { "display_rate",           NULL, OFFSET(display_rate),           AV_OPT_TYPE_DOUBLE,    {.dbl=0},       0, DBL_MAX },
+    { "seek_mode",              NULL, OFFSET(seek_mode),              AV_OPT_TYPE_INT,       {.i64=SXPLAYER_SEEK_PRECISE}, 0, NB_SXPLAYER_SEEK_MODES-1 },
+    { "adaptive_prefetch",      NULL, OFFSET(adaptive_prefetch),      AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "prefetch_duration",      NULL, OFFSET(prefetch_duration),      AV_OPT_TYPE_DOUBLE,    {.dbl=0},       0, DBL_MAX },
+    { "max_nb_prefetch",        NULL, OFFSET(max_nb_prefetch),        AV_OPT_TYPE_INT,       {.i64=16},      1, 100 },
+    { "max_packets_bytes",      NULL, OFFSET(max_packets_bytes),      AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "max_frames_bytes",       NULL, OFFSET(max_frames_bytes),       AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "max_sink_bytes",         NULL, OFFSET(max_sink_bytes),         AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "budget_policy",          NULL, OFFSET(budget_policy),          AV_OPT_TYPE_INT,       {.i64=SXPLAYER_BUDGET_BLOCK}, 0, NB_SXPLAYER_BUDGET_POLICIES-1 },
+    { "pipeline_layout",        NULL, OFFSET(pipeline_layout),        AV_OPT_TYPE_INT,       {.i64=SXPLAYER_PIPELINE_SPLIT}, 0, NB_SXPLAYER_PIPELINE_LAYOUTS-1 },
     { NULL }
 };
 
@@ -157,6 +214,11 @@ static void free_context(struct sxplayer_ctx *s)
         return;
     av_freep(&s->filename);
     av_freep(&s->logname);
+    if (s->framepool) {
+        sxpi_framepool_flush_cache(s->framepool, &s->framepool_cache);
+        sxpi_framepool_flush_cache(s->framepool, &s->push_cache);
+    }
+    sxpi_framepool_unref(&s->framepool);
     sxpi_log_free(&s->log_ctx);
     av_opt_free(s);
     av_freep(&s);
@@ -167,13 +229,49 @@ static void free_temp_context_data(struct sxplayer_ctx *s)
 {
     TRACE(s, "free temporary context data");
 
-    av_frame_free(&s->cached_frame);
+    sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
+
+    for (int i = 0; i < s->nb_rev_frames; i++)
+        sxpi_framepool_release_frame(s->framepool, &s->rev_frames[i]);
+    av_freep(&s->rev_frames);
+    s->nb_rev_frames = 0;
+    s->rev_capacity = 0;
+    s->rev_end = AV_NOPTS_VALUE;
+    s->rev_prefetch_end = AV_NOPTS_VALUE;
+    s->rev_active = 0;
 
     sxpi_async_free(&s->actx);
 
     s->context_configured = 0;
 }
 
+struct sxplayer_pool *sxplayer_pool_create(int nb_threads)
+{
+    struct sxplayer_pool *pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->workpool = sxpi_workpool_create(nb_threads);
+    if (!pool->workpool) {
+        av_freep(&pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void sxplayer_pool_free(struct sxplayer_pool **poolp)
+{
+    struct sxplayer_pool *pool = *poolp;
+    if (!pool)
+        return;
+    sxpi_workpool_unref(&pool->workpool);
+    av_freep(poolp);
+}
+
+void sxplayer_set_memory_budget(int64_t max_bytes)
+{
+    sxpi_membudget_set_global_limit(FFMAX(max_bytes, 0));
+}
+
 void sxplayer_set_log_callback(struct sxplayer_ctx *s, void *arg,
                                sxplayer_log_callback_type callback)
 {
@@ -201,7 +299,8 @@ struct sxplayer_ctx *sxplayer_create(const char *filename)
 
     s->filename = av_strdup(filename);
     s->logname  = av_asprintf("sxplayer:%s", av_basename(filename));
-    if (!s->filename || !s->logname)
+    s->framepool = sxpi_framepool_alloc();
+    if (!s->filename || !s->logname || !s->framepool)
         goto fail;
 
     s->class = &sxplayer_class;
@@ -233,6 +332,10 @@ struct sxplayer_ctx *sxplayer_create(const char *filename)
     s->first_ts             = AV_NOPTS_VALUE;
     s->last_frame_poped_ts  = AV_NOPTS_VALUE;
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->seek_inflight_ts     = AV_NOPTS_VALUE;
+    s->landing_vt           = AV_NOPTS_VALUE;
+    s->rev_end              = AV_NOPTS_VALUE;
+    s->rev_prefetch_end     = AV_NOPTS_VALUE;
 
     av_assert0(!s->context_configured);
     return s;
@@ -265,6 +368,8 @@ static int64_t get_media_time(const struct sxplayer_opts *o, int64_t t)
     return o->end_time64 == AV_NOPTS_VALUE ? mt : FFMIN(mt, o->end_time64);
 }
 
+static int push_frame(void *arg, AVFrame *frame);
+
 static int set_context_fields(struct sxplayer_ctx *s)
 {
     struct sxplayer_opts *o = &s->opts;
@@ -278,6 +383,9 @@ static int set_context_fields(struct sxplayer_ctx *s)
         }
     }
 
+    if (o->export_mvs_grid)
+        o->export_mvs = 1;
+
     if (o->auto_hwaccel && (o->filters || o->autorotate || o->export_mvs)) {
         LOG(s, WARNING, "Filters ('%s'), autorotate (%d), or export_mvs (%d) settings "
             "are set but hwaccel is enabled, disabling auto_hwaccel so these "
@@ -301,6 +409,8 @@ static int set_context_fields(struct sxplayer_ctx *s)
         o->start_time = o->skip;
     }
 
+    atomic_store_explicit(&o->cur_playback_rate, o->playback_rate, memory_order_relaxed);
+
     o->start_time64 = TIME2INT64(o->start_time);
     o->dist_time_seek_trigger64 = TIME2INT64(o->dist_time_seek_trigger);
     o->end_time64 = o->end_time < 0 ? AV_NOPTS_VALUE : TIME2INT64(o->end_time);
@@ -327,12 +437,19 @@ static int set_context_fields(struct sxplayer_ctx *s)
           PTS2TIMESTR(o->end_time64),
           PTS2TIMESTR(o->dist_time_seek_trigger64));
 
+    s->configure_time = av_gettime_relative();
+
     av_assert0(!s->actx);
     s->actx = sxpi_async_alloc_context();
     if (!s->actx)
         return AVERROR(ENOMEM);
 
-    int ret = sxpi_async_init(s->actx, s->log_ctx, s->filename, &s->opts);
+    if (s->frame_cb)
+        sxpi_async_set_frame_cb(s->actx, push_frame, s);
+
+    const struct sxplayer_pool *pool = o->pool ? *(struct sxplayer_pool **)o->pool : NULL;
+    int ret = sxpi_async_init(s->actx, s->log_ctx, s->filename, &s->opts, s->framepool,
+                              pool ? pool->workpool : NULL);
     if (ret < 0)
         return ret;
 
@@ -362,6 +479,16 @@ static int configure_context(struct sxplayer_ctx *s)
     return 0;
 }
 
+/* The frames can not be requested when they are pushed to the frame callback */
+static int configure_pull_context(struct sxplayer_ctx *s)
+{
+    if (s->frame_cb) {
+        LOG(s, ERROR, "Frames are delivered to the frame callback, they can not be requested");
+        return AVERROR(EINVAL);
+    }
+    return configure_context(s);
+}
+
 static const int col_spc_map[] = {
     [AVCOL_SPC_RGB]                = SXPLAYER_COL_SPC_RGB,
     [AVCOL_SPC_BT709]              = SXPLAYER_COL_SPC_BT709,
@@ -484,55 +611,57 @@ static int get_sxplayer_col_trc(int avcol_trc)
 #define MAX_ASYNC_OP_TIME (10/1000.)
 #define MAX_SYNC_OP_TIME  (1/60.)
 
-/* Return the frame only if different from previous one. We do not make a
- * simple pointer check because of the frame reference counting (and thus
- * pointer reuse, depending on many parameters)  */
-static struct sxplayer_frame *ret_frame(struct sxplayer_ctx *s, AVFrame *frame)
+/* Return the motion vectors grid attached by the filtering module, or NULL if
+ * the buffer is not large enough to hold the planes its header describes */
+static const struct sxpi_mvs_grid *get_mvs_grid(const AVBufferRef *buf)
 {
-    struct sxplayer_frame *ret = NULL;
-    const struct sxplayer_opts *o = &s->opts;
-
-    if (!frame) {
-        LOG(s, DEBUG, "no frame to return");
-        goto end;
-    }
+    if (!buf || buf->size < sizeof(struct sxpi_mvs_grid))
+        return NULL;
+    const struct sxpi_mvs_grid *grid = (const struct sxpi_mvs_grid *)buf->data;
+    if (grid->width <= 0 || grid->height <= 0 || grid->dx_offset < 0 || grid->dy_offset < 0)
+        return NULL;
+    const int64_t plane_size = (int64_t)grid->width * grid->height * sizeof(int16_t);
+    if (grid->dx_offset + plane_size > buf->size || grid->dy_offset + plane_size > buf->size)
+        return NULL;
+    return grid;
+}
 
+/* Wrap an AVFrame into a user frame; the ownership of the AVFrame is
+ * transferred to the returned frame */
+static struct sxplayer_frame *wrap_frame(struct sxplayer_ctx *s, struct framepool_cache *cache, AVFrame *frame)
+{
+    const struct sxplayer_opts *o = &s->opts;
     const int64_t frame_ts = frame->pts;
 
-    TRACE(s, "last_pushed_frame_ts:%s (%"PRId64") frame_ts:%s (%"PRId64")",
-          av_ts2timestr(s->last_pushed_frame_ts, &s->st_timebase),
-          s->last_pushed_frame_ts,
-          av_ts2timestr(frame_ts, &s->st_timebase),
-          frame_ts);
-
-    /* if same frame as previously, do not raise it again */
-    if (s->last_pushed_frame_ts == frame_ts) {
-        LOG(s, DEBUG, "same frame as previously, return NULL");
-        av_frame_free(&frame);
-        goto end;
-    }
-
-    ret = av_mallocz(sizeof(*ret));
+    struct sxplayer_frame *ret = sxpi_framepool_get_wrapper(s->framepool, cache);
     if (!ret) {
-        av_frame_free(&frame);
-        goto end;
+        sxpi_framepool_release_frame(s->framepool, &frame);
+        return NULL;
     }
 
-    s->last_pushed_frame_ts = frame_ts;
+    if (!atomic_load_explicit(&s->time_to_first_frame, memory_order_relaxed)) {
+        const int64_t time_to_first_frame = av_gettime_relative() - s->configure_time;
+        atomic_store_explicit(&s->time_to_first_frame, time_to_first_frame, memory_order_relaxed);
+        LOG(s, INFO, "first frame returned after %s", PTS2TIMESTR(time_to_first_frame));
+    }
 
+    /* The side data and the grid buffer are kept alive by the frame */
     AVFrameSideData *sd = av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
     if (sd) {
-        ret->mvs = av_memdup(sd->data, sd->size);
-        if (!ret->mvs) {
-            LOG(s, ERROR, "Unable to memdup motion vectors side data");
-            av_frame_free(&frame);
-            av_freep(&ret);
-            goto end;
-        }
+        ret->mvs = sd->data;
         ret->nb_mvs = sd->size / sizeof(AVMotionVector);
         TRACE(s, "export %d motion vectors", ret->nb_mvs);
     }
 
+    const struct sxpi_mvs_grid *grid = o->export_mvs_grid ? get_mvs_grid(frame->opaque_ref) : NULL;
+    if (grid) {
+        uint8_t *grid_data = frame->opaque_ref->data;
+        ret->mvs_dx = (int16_t *)(grid_data + grid->dx_offset);
+        ret->mvs_dy = (int16_t *)(grid_data + grid->dy_offset);
+        ret->mvs_grid_w = grid->width;
+        ret->mvs_grid_h = grid->height;
+    }
+
     ret->internal = frame;
     ret->data = frame->data[0];
     ret->linesize = frame->linesize[0];
@@ -570,6 +699,40 @@ static struct sxplayer_frame *ret_frame(struct sxplayer_ctx *s, AVFrame *frame)
             frame->nb_samples, av_ts2timestr(frame_ts, &s->st_timebase));
     }
 
+    return ret;
+}
+
+/* Return the frame only if different from previous one. We do not make a
+ * simple pointer check because of the frame reference counting (and thus
+ * pointer reuse, depending on many parameters)  */
+static struct sxplayer_frame *ret_frame(struct sxplayer_ctx *s, AVFrame *frame)
+{
+    struct sxplayer_frame *ret = NULL;
+
+    if (!frame) {
+        LOG(s, DEBUG, "no frame to return");
+        goto end;
+    }
+
+    const int64_t frame_ts = frame->pts;
+
+    TRACE(s, "last_pushed_frame_ts:%s (%"PRId64") frame_ts:%s (%"PRId64")",
+          av_ts2timestr(s->last_pushed_frame_ts, &s->st_timebase),
+          s->last_pushed_frame_ts,
+          av_ts2timestr(frame_ts, &s->st_timebase),
+          frame_ts);
+
+    /* if same frame as previously, do not raise it again */
+    if (s->last_pushed_frame_ts == frame_ts) {
+        LOG(s, DEBUG, "same frame as previously, return NULL");
+        sxpi_framepool_release_frame(s->framepool, &frame);
+        goto end;
+    }
+
+    ret = wrap_frame(s, &s->framepool_cache, frame);
+    if (ret)
+        s->last_pushed_frame_ts = frame_ts;
+
 end:
     END_FUNC(MAX_SYNC_OP_TIME);
     return ret;
@@ -577,21 +740,101 @@ end:
 
 void sxplayer_release_frame(struct sxplayer_frame *frame)
 {
-    if (frame) {
-        AVFrame *avframe = frame->internal;
-        av_frame_free(&avframe);
-        av_freep(&frame->mvs);
-        av_free(frame);
+    if (frame)
+        sxpi_framepool_release_wrapper(frame);
+}
+
+/* Called from the filtering module in push mode, so only the fields it owns
+ * in this mode (st_timebase and push_cache) are accessed */
+static int push_frame(void *arg, AVFrame *frame)
+{
+    struct sxplayer_ctx *s = arg;
+
+    if (!frame) {
+        LOG(s, DEBUG, "end of stream reached, notify the frame callback");
+        s->frame_cb(s->frame_cb_arg, NULL);
+        return 0;
+    }
+
+    if (!s->st_timebase.den)
+        s->st_timebase = sxpi_async_get_timebase(s->actx);
+
+    struct sxplayer_frame *out = wrap_frame(s, &s->push_cache, frame);
+    if (!out)
+        return AVERROR(ENOMEM);
+
+    const int ret = s->frame_cb(s->frame_cb_arg, out);
+    if (ret) {
+        /* The frame was not accepted: give it back to the filtering module,
+         * which offers it again once resumed if the callback is busy */
+        out->internal = NULL;
+        sxplayer_release_frame(out);
+    }
+    return ret;
+}
+
+int sxplayer_set_frame_callback(struct sxplayer_ctx *s, sxplayer_frame_callback_type callback, void *arg)
+{
+    if (s->context_configured) {
+        LOG(s, ERROR, "Context is already configured, can not set the frame callback");
+        return AVERROR(EINVAL);
     }
+    s->frame_cb = callback;
+    s->frame_cb_arg = arg;
+    return 0;
+}
+
+void sxplayer_resume_frame_callback(struct sxplayer_ctx *s)
+{
+    if (s->frame_cb && s->actx)
+        sxpi_async_resume_frame_cb(s->actx);
 }
 
 int sxplayer_set_drop_ref(struct sxplayer_ctx *s, int drop)
 {
-    return -1; // TODO
+    atomic_store_explicit(&s->opts.drop_ref, !!drop, memory_order_relaxed);
+    return 0;
 }
 
-static AVFrame *pop_frame(struct sxplayer_ctx *s)
+int sxplayer_set_playback_rate(struct sxplayer_ctx *s, double rate)
 {
+    if (!(rate >= 0. && rate <= DBL_MAX)) {
+        LOG(s, ERROR, "Invalid playback rate %g", rate);
+        return AVERROR(EINVAL);
+    }
+    /* The option is read when the context gets configured */
+    s->opts.playback_rate = rate;
+    atomic_store_explicit(&s->opts.cur_playback_rate, rate, memory_order_relaxed);
+    return 0;
+}
+
+static int fetch_timebase(struct sxplayer_ctx *s, int64_t deadline)
+{
+    if (s->st_timebase.den)
+        return 0;
+
+    struct sxplayer_info info;
+    int ret = sxpi_async_fetch_info(s->actx, &info, deadline);
+    if (ret < 0) {
+        TRACE(s, "unable to fetch info %s", av_err2str(ret));
+        return ret;
+    }
+    s->st_timebase = av_make_q(info.timebase[0], info.timebase[1]);
+    LOG(s, DEBUG, "store stream timebase %d/%d",
+        s->st_timebase.num, s->st_timebase.den);
+    av_assert0(s->st_timebase.den);
+    return 0;
+}
+
+/*
+ * Pop the next frame out of the pipeline. Return 0 on success,
+ * AVERROR(EAGAIN) if no frame could be obtained before the deadline, or
+ * another negative error code if no frame will ever be available (typically
+ * at the end of the stream).
+ */
+static int pop_frame(struct sxplayer_ctx *s, AVFrame **framep, int64_t deadline)
+{
+    int ret = 0;
     AVFrame *frame = NULL;
 
     if (s->cached_frame) {
@@ -601,23 +844,14 @@ static AVFrame *pop_frame(struct sxplayer_ctx *s)
     } else {
 
         /* Stream time base is required to interpret the frame PTS */
-        if (!s->st_timebase.den) {
-            struct sxplayer_info info;
-            int ret = sxpi_async_fetch_info(s->actx, &info);
-            if (ret < 0) {
-                TRACE(s, "unable to fetch info %s", av_err2str(ret));
-            } else {
-                s->st_timebase = av_make_q(info.timebase[0], info.timebase[1]);
-                LOG(s, DEBUG, "store stream timebase %d/%d",
-                    s->st_timebase.num, s->st_timebase.den);
-                av_assert0(s->st_timebase.den);
-            }
-        }
+        ret = fetch_timebase(s, deadline);
 
         if (s->st_timebase.den) {
-            int ret = sxpi_async_pop_frame(s->actx, &frame);
+            ret = sxpi_async_pop_frame(s->actx, &frame, deadline);
             if (ret < 0)
                 TRACE(s, "poped a message raising %s", av_err2str(ret));
+            else
+                s->seek_inflight_ts = AV_NOPTS_VALUE;
         }
     }
 
@@ -625,6 +859,8 @@ static AVFrame *pop_frame(struct sxplayer_ctx *s)
         const int64_t ts = frame->pts;
         TRACE(s, "poped frame with ts=%s (%"PRId64")", av_ts2timestr(ts, &s->st_timebase), ts);
         s->last_frame_poped_ts = ts;
+    } else if (ret == AVERROR(EAGAIN)) {
+        TRACE(s, "no frame available yet");
     } else {
         TRACE(s, "no frame available");
         /* We save the last timestamp in order to avoid restarting the decoding
@@ -634,10 +870,13 @@ static AVFrame *pop_frame(struct sxplayer_ctx *s)
             TRACE(s, "last timestamp is apparently %s", av_ts2timestr(s->last_ts, &s->st_timebase));
             s->last_ts = s->last_frame_poped_ts;
         }
+        if (ret >= 0)
+            ret = AVERROR_EOF;
     }
 
     TRACE(s, "pop frame %p", frame);
-    return frame;
+    *framep = frame;
+    return ret;
 }
 
 #define SYNTH_FRAME 0
@@ -660,19 +899,58 @@ static struct sxplayer_frame *ret_synth_frame(struct sxplayer_ctx *s, int64_t t6
 }
 #endif
 
-int sxplayer_seek(struct sxplayer_ctx *s, double reqt)
+static void release_reverse_window(struct sxplayer_ctx *s)
 {
-    START_FUNC_T("SEEK", reqt);
+    for (int i = 0; i < s->nb_rev_frames; i++)
+        sxpi_framepool_release_frame(s->framepool, &s->rev_frames[i]);
+    s->nb_rev_frames = 0;
+    s->rev_end = AV_NOPTS_VALUE;
+}
 
-    av_frame_free(&s->cached_frame);
+/* Leave the reverse playback: since the pipeline was moved backward, what was
+ * obtained from it so far can not be relied upon anymore */
+static void reverse_reset(struct sxplayer_ctx *s)
+{
+    if (!s->rev_active)
+        return;
+    TRACE(s, "leaving reverse playback");
+    release_reverse_window(s);
+    sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->rev_prefetch_end = AV_NOPTS_VALUE;
+    s->rev_active = 0;
+}
+
+static enum seek_mode get_seek_mode(const struct sxplayer_ctx *s)
+{
+    switch (s->opts.seek_mode) {
+    case SXPLAYER_SEEK_KEYFRAME:    return SEEK_MODE_KEYFRAME;
+    case SXPLAYER_SEEK_PROGRESSIVE: return SEEK_MODE_PROGRESSIVE;
+    default:                        return SEEK_MODE_PRECISE;
+    }
+}
+
+/* Seek to the media time vt and forget about the frames obtained so far */
+static int seek_media_time(struct sxplayer_ctx *s, int64_t vt)
+{
+    reverse_reset(s);
+    sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
+    s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->seek_inflight_ts = vt;
+    s->landing_vt = AV_NOPTS_VALUE;
+    return sxpi_async_seek(s->actx, vt, get_seek_mode(s));
+}
+
+int sxplayer_seek(struct sxplayer_ctx *s, double reqt)
+{
+    START_FUNC_T("SEEK", reqt);
 
     int ret = configure_context(s);
     if (ret < 0)
         return ret;
 
     const struct sxplayer_opts *o = &s->opts;
-    ret = sxpi_async_seek(s->actx, get_media_time(o, TIME2INT64(reqt)));
+    ret = seek_media_time(s, get_media_time(o, TIME2INT64(reqt)));
     END_FUNC(MAX_ASYNC_OP_TIME);
     return ret;
 }
@@ -681,8 +959,11 @@ int sxplayer_stop(struct sxplayer_ctx *s)
 {
     START_FUNC("STOP");
 
-    av_frame_free(&s->cached_frame);
+    reverse_reset(s);
+    sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->seek_inflight_ts = AV_NOPTS_VALUE;
+    s->landing_vt = AV_NOPTS_VALUE;
 
     int ret = configure_context(s);
     if (ret < 0)
@@ -715,62 +996,311 @@ static inline int64_t stream_time(const struct sxplayer_ctx *s, int64_t t)
     return av_rescale_q(t, AV_TIME_BASE_Q, s->st_timebase);
 }
 
-struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64)
+/*
+ * Seek to the keyframe preceding the stream time end (exclusive, or the end of
+ * the media if unset) and restart the pipeline, so that it starts decoding
+ * the frames until the queues are full. The keyframe is looked up in the
+ * packet index (which reverse playback always builds); if it can not tell,
+ * the seek aims right before end and relies on the demuxer to land on a
+ * keyframe.
+ */
+static int reverse_seek(struct sxplayer_ctx *s, int64_t end)
+{
+    int64_t seek_to;
+    const int64_t keyframe = sxpi_async_index_get_prev_keyframe(s->actx, end);
+
+    if (keyframe != AV_NOPTS_VALUE) {
+        /* Rounded up so the demuxer does not land on the keyframe before */
+        seek_to = av_rescale_q_rnd(keyframe, s->st_timebase, AV_TIME_BASE_Q, AV_ROUND_UP);
+    } else if (end == AV_NOPTS_VALUE) {
+        struct sxplayer_info info;
+        int ret = sxpi_async_fetch_info(s->actx, &info, AV_NOPTS_VALUE);
+        if (ret < 0)
+            return ret;
+        seek_to = s->opts.end_time64 != AV_NOPTS_VALUE ? s->opts.end_time64
+                                                       : TIME2INT64(info.duration);
+    } else {
+        /* The demuxer rounds the seek time to the closest stream timestamp,
+         * so we aim one tick before the end to make sure we land before */
+        seek_to = av_rescale_q_rnd(end - 1, s->st_timebase, AV_TIME_BASE_Q, AV_ROUND_DOWN) - 1;
+    }
+    seek_to = FFMAX(seek_to, 0);
+
+    TRACE(s, "reverse seek to %s (keyframe:%s)", PTS2TIMESTR(seek_to),
+          av_ts2timestr(keyframe, &s->st_timebase));
+    sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
+    s->rev_active = 1;
+    s->seek_inflight_ts = AV_NOPTS_VALUE;
+    int ret = sxpi_async_seek(s->actx, seek_to, SEEK_MODE_KEYFRAME);
+    if (ret < 0)
+        return ret;
+    return sxpi_async_start(s->actx);
+}
+
+/* Pop the first frame of the reverse window, or nothing if the pipeline is
+ * positioned after the stream time end (exclusive) */
+static int reverse_pop_first(struct sxplayer_ctx *s, int64_t end, AVFrame **framep)
+{
+    int ret = pop_frame(s, framep, AV_NOPTS_VALUE);
+    if (ret < 0 && ret != AVERROR_EOF)
+        return ret;
+    if (*framep && end != AV_NOPTS_VALUE && (*framep)->pts >= end) {
+        TRACE(s, "no frame before %s from the current position", av_ts2timestr(end, &s->st_timebase));
+        sxpi_framepool_release_frame(s->framepool, framep);
+    }
+    return 0;
+}
+
+/*
+ * Fill the reverse window with the frames preceding the stream time end
+ * (exclusive). Since the pipeline delivers the frames from the preceding
+ * keyframe, every GOP is decoded only once as long as it fits in the window.
+ * Once filled, the pipeline is immediately moved to the previous GOP, which
+ * saves the seek on the next fill and gets its first frames (up to the queues
+ * depth) decoded while the window is being consumed.
+ */
+static int reverse_fill(struct sxplayer_ctx *s, int64_t end)
+{
+    int ret;
+    AVFrame *frame = NULL;
+
+    TRACE(s, "fill reverse window up to %s", av_ts2timestr(end, &s->st_timebase));
+
+    if (!s->rev_frames) {
+        s->rev_frames = av_calloc(s->opts.max_nb_reverse_frames, sizeof(*s->rev_frames));
+        if (!s->rev_frames)
+            return AVERROR(ENOMEM);
+        s->rev_capacity = s->opts.max_nb_reverse_frames;
+    }
+
+    release_reverse_window(s);
+
+    /* The prefetched GOP does not cover end if the request jumped before it */
+    if (s->rev_prefetch_end != AV_NOPTS_VALUE) {
+        s->rev_prefetch_end = AV_NOPTS_VALUE;
+        ret = reverse_pop_first(s, end, &frame);
+        if (ret < 0)
+            return ret;
+    }
+    if (!frame) {
+        ret = reverse_seek(s, end);
+        if (ret < 0)
+            return ret;
+        ret = reverse_pop_first(s, end, &frame);
+        if (ret < 0)
+            return ret;
+    }
+    if (!frame)
+        return 0;
+
+    /* Hardware frames from MediaCodec can not be retained without stalling
+     * the decoder */
+    const int capacity = frame->format == AV_PIX_FMT_MEDIACODEC ? 1 : s->rev_capacity;
+
+    while (frame) {
+        if (end != AV_NOPTS_VALUE && frame->pts >= end) {
+            sxpi_framepool_release_frame(s->framepool, &frame);
+            break;
+        }
+        if (s->nb_rev_frames == capacity) {
+            sxpi_framepool_release_frame(s->framepool, &s->rev_frames[0]);
+            memmove(s->rev_frames, s->rev_frames + 1, (capacity - 1) * sizeof(*s->rev_frames));
+            s->nb_rev_frames--;
+        }
+        s->rev_frames[s->nb_rev_frames++] = frame;
+        ret = pop_frame(s, &frame, AV_NOPTS_VALUE);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            release_reverse_window(s);
+            return ret;
+        }
+    }
+
+    s->rev_end = end;
+    TRACE(s, "reverse window: %d frames in [%s;%s[", s->nb_rev_frames,
+          av_ts2timestr(s->rev_frames[0]->pts, &s->st_timebase),
+          av_ts2timestr(end, &s->st_timebase));
+
+    /* Prefetch the previous GOP (or the previous part of the current one if
+     * it did not fit in the window) */
+    const int64_t prefetch_end = s->rev_frames[0]->pts;
+    if (prefetch_end > stream_time(s, s->opts.start_time64)) {
+        ret = reverse_seek(s, prefetch_end);
+        if (ret < 0)
+            return ret;
+        s->rev_prefetch_end = prefetch_end;
+    }
+
+    return 0;
+}
+
+/* Get the latest frame with a timestamp lower or equal to ts (stream time
+ * base, or AV_NOPTS_VALUE for the last frame of the media) */
+static AVFrame *reverse_get_frame(struct sxplayer_ctx *s, int64_t ts)
+{
+    const int covered = s->nb_rev_frames && ts != AV_NOPTS_VALUE &&
+                        ts >= s->rev_frames[0]->pts &&
+                        (s->rev_end == AV_NOPTS_VALUE || ts < s->rev_end);
+    if (!covered) {
+        int ret = reverse_fill(s, ts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : ts + 1);
+        if (ret < 0) {
+            LOG(s, ERROR, "unable to fill reverse playback window: %s", av_err2str(ret));
+            return NULL;
+        }
+    }
+
+    int i = s->nb_rev_frames - 1;
+    while (i >= 0 && ts != AV_NOPTS_VALUE && s->rev_frames[i]->pts > ts)
+        i--;
+    if (i < 0) {
+        TRACE(s, "no frame found in the reverse window");
+        return NULL;
+    }
+
+    AVFrame *frame = sxpi_framepool_get_frame(s->framepool, &s->framepool_cache);
+    if (!frame)
+        return NULL;
+    if (av_frame_ref(frame, s->rev_frames[i]) < 0) {
+        sxpi_framepool_release_frame(s->framepool, &frame);
+        return NULL;
+    }
+    return frame;
+}
+
+/*
+ * Decide if going forward from the frame at ref_ts to the stream time stt is
+ * faster with a seek than by decoding every frame in between. The packet
+ * index knows where the keyframes are; until it covers stt, we fall back on
+ * the dist_time_seek_trigger distance.
+ */
+static int need_forward_seek(struct sxplayer_ctx *s, int64_t ref_ts, int64_t stt)
 {
-    int64_t diff;
     const struct sxplayer_opts *o = &s->opts;
 
-    START_FUNC_T("GET FRAME", t64 / 1000000.);
+    const int ret = sxpi_async_index_should_seek(s->actx, ref_ts, stt);
+    if (ret != AVERROR(EAGAIN))
+        return ret > 0;
+    return av_compare_ts(stt - ref_ts, s->st_timebase, o->dist_time_seek_trigger64, AV_TIME_BASE_Q) >= 0;
+}
 
-#if SYNTH_FRAME
-    return ret_synth_frame(s, t64);
-#endif
+/*
+ * In keyframes only mode, move the media time vt to where the closest
+ * keyframe is displayed. Until the packet index covers vt, it is left
+ * untouched, which selects the keyframe preceding it.
+ */
+static int64_t snap_to_keyframe(struct sxplayer_ctx *s, int64_t vt, int64_t deadline)
+{
+    const struct sxplayer_opts *o = &s->opts;
 
-    int ret = configure_context(s);
+    if (fetch_timebase(s, deadline) < 0)
+        return vt;
+
+    const int64_t stt = stream_time(s, vt);
+    const int64_t snapped = sxpi_async_index_snap_to_keyframe(s->actx, stt);
+    if (snapped == AV_NOPTS_VALUE || snapped == stt)
+        return vt;
+
+    const int64_t snapped_vt = av_rescale_q(snapped, s->st_timebase, AV_TIME_BASE_Q);
+    TRACE(s, "snap %s to %s", PTS2TIMESTR(vt), PTS2TIMESTR(snapped_vt));
+    return o->end_time64 == AV_NOPTS_VALUE ? snapped_vt : FFMIN(snapped_vt, o->end_time64);
+}
+
+/*
+ * Outside of the precise seek mode, the first frame obtained after a seek is
+ * returned as is, without decoding up to the requested time.
+ */
+static int is_landing(const struct sxplayer_ctx *s)
+{
+    return s->seek_inflight_ts != AV_NOPTS_VALUE && s->opts.seek_mode != SXPLAYER_SEEK_PRECISE;
+}
+
+/* Get the best AVFrame for the timeline time t64, without filtering out the
+ * frame previously returned. If a deadline is set (absolute time, see
+ * av_gettime_relative()), the closest frame obtained before it is returned
+ * instead of blocking until the most accurate one is decoded. */
+static AVFrame *get_frame_ms(struct sxplayer_ctx *s, int64_t t64, int64_t deadline)
+{
+    int64_t diff;
+    const struct sxplayer_opts *o = &s->opts;
+
+    int ret = configure_pull_context(s);
     if (ret < 0)
-        return ret_frame(s, NULL);
+        return NULL;
 
     if (t64 < 0) {
         sxplayer_start(s);
-        return ret_frame(s, NULL);
+        return NULL;
     }
 
-    const int64_t vt = get_media_time(o, t64);
+    int64_t vt = get_media_time(o, t64);
+    if (o->keyframes_only)
+        vt = snap_to_keyframe(s, vt, deadline);
     TRACE(s, "t=%s -> vt=%s", PTS2TIMESTR(t64), PTS2TIMESTR(vt));
 
+    /* The frame landed on by the latest seek was returned for this time: in
+     * progressive mode, we now decode up to it without seeking again */
+    const int refine = vt == s->landing_vt;
+    if (refine && o->seek_mode == SXPLAYER_SEEK_KEYFRAME) {
+        TRACE(s, "requested the time served by the keyframe landed on again");
+        return NULL;
+    }
+    s->landing_vt = AV_NOPTS_VALUE;
+
+    if (o->reverse && s->last_pushed_frame_ts != AV_NOPTS_VALUE) {
+        const int64_t stt = stream_time(s, vt);
+        const int in_window = s->nb_rev_frames && stt >= s->rev_frames[0]->pts &&
+                              (s->rev_end == AV_NOPTS_VALUE || stt < s->rev_end);
+        if (stt < s->last_pushed_frame_ts || in_window) {
+            TRACE(s, "backward request, use the reverse window");
+            return reverse_get_frame(s, stt);
+        }
+    }
+    reverse_reset(s);
+
     if (s->last_ts != AV_NOPTS_VALUE && stream_time(s, vt) >= s->last_ts &&
         s->last_pushed_frame_ts == s->last_ts) {
         TRACE(s, "requested the last frame again");
-        return ret_frame(s, NULL);
+        return NULL;
     }
 
     if (s->first_ts != AV_NOPTS_VALUE && stream_time(s, vt) <= s->first_ts &&
         s->last_pushed_frame_ts == s->first_ts) {
         TRACE(s, "requested the first frame again");
-        return ret_frame(s, NULL);
+        return NULL;
     }
 
     AVFrame *candidate = NULL;
 
     /* If no frame was ever pushed, we need to pop one */
     if (s->last_pushed_frame_ts == AV_NOPTS_VALUE) {
+        s->frame_from_cache = 0;
 
         /* If prefetch wasn't done (async not started), and we requested a time
          * that is beyond the initial start_time, we request an appropriate seek
          * before we start the decoding process in order to save one seek and
          * some decoding (a seek for the initial start_time, then another one soon
          * after to reach the requested time). */
-        if (!sxpi_sxpi_async_started(s->actx) && vt > o->start_time64) {
+        ret = sxpi_sxpi_async_started(s->actx, deadline);
+        if (ret == AVERROR(EAGAIN)) {
+            TRACE(s, "control thread is busy, try again later");
+            return NULL;
+        }
+        if (!ret && vt > o->start_time64) {
             TRACE(s, "no prefetch, but requested time (%s) beyond initial start_time (%s)",
                   PTS2TIMESTR(vt), PTS2TIMESTR(o->start_time64));
-            sxpi_async_seek(s->actx, vt);
+            s->seek_inflight_ts = vt;
+            sxpi_async_seek(s->actx, vt, get_seek_mode(s));
         }
 
         TRACE(s, "no frame ever pushed yet, pop a candidate");
-        candidate = pop_frame(s);
+        const int landing = is_landing(s);
+        ret = pop_frame(s, &candidate, deadline);
+        if (ret == AVERROR(EAGAIN)) {
+            TRACE(s, "no frame decoded yet, try again later");
+            return NULL;
+        }
         if (!candidate) {
             TRACE(s, "can not get a single frame for this media");
-            return ret_frame(s, NULL);
+            return NULL;
         }
 
         /* At this point we can assume the stream timebase is known because
@@ -793,34 +1323,71 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
              * candidate if the first time requested is not actually 0 */
             if (t64 == 0)
                 s->first_ts = candidate->pts;
-            return ret_frame(s, candidate);
+            return candidate;
+        }
+
+        if (landing) {
+            TRACE(s, "return the frame landed on");
+            s->landing_vt = vt;
+            return candidate;
         }
 
     } else {
         /* At this point we can assume the stream timebase is known because
          * a frame was already pushed. */
         const int64_t stt = stream_time(s, vt);
-        diff = stt - s->last_pushed_frame_ts;
 
-        TRACE(s, "diff with latest frame (t=%s) returned: %s [%"PRId64"]",
-              av_ts2timestr(s->last_pushed_frame_ts, &s->st_timebase),
+        /* If the latest frame came from the frame cache, the pipeline is
+         * positioned after the latest frame obtained from it instead */
+        const int64_t ref_ts = s->frame_from_cache && s->last_frame_poped_ts != AV_NOPTS_VALUE
+                             ? s->last_frame_poped_ts : s->last_pushed_frame_ts;
+        diff = stt - ref_ts;
+
+        TRACE(s, "diff with latest frame (t=%s) %s: %s [%"PRId64"]",
+              av_ts2timestr(ref_ts, &s->st_timebase),
+              s->frame_from_cache ? "decoded" : "returned",
               av_ts2timestr(diff, &s->st_timebase),
               diff);
     }
 
-    if (!diff)
-        return ret_frame(s, candidate);
+    if (!diff && !s->frame_from_cache)
+        return candidate;
 
     /* Check if a seek is needed */
-    const int forward_seek = av_compare_ts(diff, s->st_timebase, o->dist_time_seek_trigger64, AV_TIME_BASE_Q) >= 0;
-    if (diff < 0 || forward_seek) {
+    const int64_t target_ts = stream_time(s, vt);
+    const int forward_seek = diff > 0 && !refine && need_forward_seek(s, target_ts - diff, target_ts);
+
+    /* The frame may have been decoded already, in which case there is no need
+     * to move the pipeline */
+    if (diff < 0 || forward_seek || s->frame_from_cache) {
+        AVFrame *cached = sxpi_async_get_cached_frame(s->actx, stream_time(s, vt));
+        if (cached) {
+            TRACE(s, "got frame %s from the cache", av_ts2timestr(cached->pts, &s->st_timebase));
+            sxpi_framepool_release_frame(s->framepool, &candidate);
+            s->frame_from_cache = 1;
+            return cached;
+        }
+    }
+
+    const int seek_inflight = s->seek_inflight_ts != AV_NOPTS_VALUE &&
+                              vt >= s->seek_inflight_ts &&
+                              vt - s->seek_inflight_ts < o->dist_time_seek_trigger64;
+    if (seek_inflight) {
+        TRACE(s, "a seek to %s is still in progress, wait for it",
+              PTS2TIMESTR(s->seek_inflight_ts));
+    } else if (deadline != AV_NOPTS_VALUE && (diff < 0 || forward_seek) &&
+               sxpi_async_sync_pending(s->actx)) {
+        /* The previous control requests are not honored yet: do not stack
+         * another seek on top of them, and return what we have */
+        TRACE(s, "control thread is busy, postpone the seek");
+        return candidate;
+    } else if (diff < 0 || forward_seek) {
         if (diff < 0)
             TRACE(s, "diff %s [%"PRId64"] < 0 request backward seek",
                   av_ts2timestr(diff, &s->st_timebase), diff);
         else
-            TRACE(s, "diff %s > %s request future seek",
-                  av_ts2timestr(diff, &s->st_timebase),
-                  PTS2TIMESTR(o->dist_time_seek_trigger64));
+            TRACE(s, "diff %s [%"PRId64"] > 0 request future seek",
+                  av_ts2timestr(diff, &s->st_timebase), diff);
 
         /* If we never returned a frame and got a candidate, we do not free it
          * immediately, because after the seek we might not actually get
@@ -834,15 +1401,16 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
          */
         if ((candidate && candidate->format == AV_PIX_FMT_MEDIACODEC) ||
             (diff > 0 && s->last_pushed_frame_ts != AV_NOPTS_VALUE)) {
-            av_frame_free(&candidate);
+            sxpi_framepool_release_frame(s->framepool, &candidate);
         }
 
-        av_frame_free(&s->cached_frame);
+        sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
 
-        ret = sxpi_async_seek(s->actx, vt);
+        s->seek_inflight_ts = vt;
+        ret = sxpi_async_seek(s->actx, vt, get_seek_mode(s));
         if (ret < 0) {
-            av_frame_free(&candidate);
-            return ret_frame(s, NULL);
+            sxpi_framepool_release_frame(s->framepool, &candidate);
+            return NULL;
         }
     }
 
@@ -851,8 +1419,14 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
         const int next_is_cached_frame = !!s->cached_frame;
 
         TRACE(s, "grab another frame");
-        AVFrame *next = pop_frame(s);
+        AVFrame *next;
+        const int landing = is_landing(s);
+        ret = pop_frame(s, &next, deadline);
         av_assert0(!s->cached_frame);
+        if (ret == AVERROR(EAGAIN)) {
+            TRACE(s, "deadline reached, return the closest frame so far");
+            break;
+        }
         if (!next) {
             TRACE(s, "no more frame");
             break;
@@ -867,13 +1441,22 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
         if (s->opts.use_pkt_duration && next->pkt_duration > 0 && rescaled_vt >= next->pts) {
             const int64_t next_guessed_pts = next->pts + next->pkt_duration;
             if (rescaled_vt < next_guessed_pts) {
-                av_frame_free(&candidate);
-                av_frame_free(&s->cached_frame);
+                sxpi_framepool_release_frame(s->framepool, &candidate);
+                sxpi_framepool_release_frame(s->framepool, &s->cached_frame);
                 s->cached_frame = NULL;
-                return ret_frame(s, next);
+                s->frame_from_cache = 0;
+                return next;
             }
         }
 
+        if (landing && next->pts <= rescaled_vt) {
+            TRACE(s, "grabbed frame %s landed on", av_ts2timestr(next->pts, &s->st_timebase));
+            sxpi_framepool_release_frame(s->framepool, &candidate);
+            s->landing_vt = vt;
+            candidate = next;
+            break;
+        }
+
         if (next->pts > rescaled_vt) {
             TRACE(s, "grabbed frame is in the future %s > %s",
                   av_ts2timestr(next->pts, &s->st_timebase), PTS2TIMESTR(vt));
@@ -886,7 +1469,7 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
             }
             break;
         }
-        av_frame_free(&candidate);
+        sxpi_framepool_release_frame(s->framepool, &candidate);
         candidate = next;
         if (candidate->pts == rescaled_vt) {
             TRACE(s, "grabbed exact frame %s", av_ts2timestr(candidate->pts, &s->st_timebase));
@@ -894,7 +1477,190 @@ struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64
         }
     }
 
-    return ret_frame(s, candidate);
+    /* The frame to display may have been obtained from the pipeline while
+     * the cached frame was displayed: it is now in the cache */
+    if (!candidate && s->frame_from_cache) {
+        candidate = sxpi_async_get_cached_frame(s->actx, stream_time(s, vt));
+        return candidate;
+    }
+
+    if (candidate)
+        s->frame_from_cache = 0;
+    return candidate;
+}
+
+struct sxplayer_frame *sxplayer_get_frame_ms(struct sxplayer_ctx *s, int64_t t64)
+{
+    START_FUNC_T("GET FRAME", t64 / 1000000.);
+
+#if SYNTH_FRAME
+    return ret_synth_frame(s, t64);
+#endif
+
+    return ret_frame(s, get_frame_ms(s, t64, AV_NOPTS_VALUE));
+}
+
+struct sxplayer_frame *sxplayer_get_frame_deadline_ms(struct sxplayer_ctx *s, int64_t t64, int64_t budget_us)
+{
+    START_FUNC_T("GET FRAME DEADLINE", t64 / 1000000.);
+
+    const int64_t deadline = av_gettime_relative() + FFMAX(budget_us, 0);
+    return ret_frame(s, get_frame_ms(s, t64, deadline));
+}
+
+struct sxplayer_frame *sxplayer_try_get_frame_ms(struct sxplayer_ctx *s, int64_t t64)
+{
+    return sxplayer_get_frame_deadline_ms(s, t64, 0);
+}
+
+struct frame_target {
+    int64_t t64;
+    int idx;
+};
+
+static int cmp_frame_target(const void *a, const void *b)
+{
+    const struct frame_target *t0 = a;
+    const struct frame_target *t1 = b;
+    if (t0->t64 != t1->t64)
+        return t0->t64 < t1->t64 ? -1 : 1;
+    return t0->idx - t1->idx;
+}
+
+/*
+ * Decide if reaching the timeline time t64 requires a seek. ref_ts is the
+ * timestamp of the frame we are currently standing on (or AV_NOPTS_VALUE if
+ * the decoding position is unknown), and is_prev tells if that frame was
+ * obtained during the current batch (and can thus be returned again without
+ * fetching it from the pipeline).
+ */
+static int batch_need_seek(struct sxplayer_ctx *s, int64_t t64, int64_t ref_ts, int is_prev)
+{
+    const struct sxplayer_opts *o = &s->opts;
+
+    if (ref_ts == AV_NOPTS_VALUE)
+        return 0;
+
+    const int64_t stt = stream_time(s, get_media_time(o, t64));
+
+    /* The frame we are standing on is the one expected, but it was returned
+     * to the user before this batch started: we need to decode it again.
+     * Without a frame fetched ahead, this is only known once it is (see
+     * sxplayer_get_frames_at()). */
+    if (!is_prev && (stt < ref_ts || (s->cached_frame && stt < s->cached_frame->pts)))
+        return 1;
+
+    return stt > ref_ts && need_forward_seek(s, ref_ts, stt);
+}
+
+int sxplayer_get_frames_at(struct sxplayer_ctx *s, const int64_t *ts, int n, struct sxplayer_frame **out)
+{
+    START_FUNC("GET FRAMES AT");
+
+    int ret = 0;
+    struct frame_target *targets = NULL;
+    const AVFrame *prev = NULL;
+
+    if (n < 0 || (n && (!ts || !out))) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (!n)
+        goto end;
+    memset(out, 0, n * sizeof(*out));
+
+    ret = configure_pull_context(s);
+    if (ret < 0)
+        goto end;
+
+    targets = av_malloc_array(n, sizeof(*targets));
+    if (!targets) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < n; i++) {
+        targets[i].t64 = ts[i];
+        targets[i].idx = i;
+    }
+
+    /* Walking through the targets in order allows decoding every GOP at most
+     * once: going backward is never needed, and going forward is either done
+     * by decoding or seeking depending on the size of the gap */
+    qsort(targets, n, sizeof(*targets), cmp_frame_target);
+
+    for (int i = 0; i < n; i++) {
+        const int64_t t64 = targets[i].t64;
+        const int idx = targets[i].idx;
+
+        if (t64 < 0) {
+            TRACE(s, "ignore negative target %s", PTS2TIMESTR(t64));
+            continue;
+        }
+
+        AVFrame *frame = NULL;
+        const int64_t ref_ts = prev ? prev->pts : s->last_pushed_frame_ts;
+
+        if (prev && stream_time(s, get_media_time(&s->opts, t64)) < prev->pts) {
+            TRACE(s, "target %s is before the previous frame, reuse it", PTS2TIMESTR(t64));
+        } else {
+            const int need_seek = batch_need_seek(s, t64, ref_ts, !!prev);
+            if (need_seek) {
+                TRACE(s, "target %s requires a seek", PTS2TIMESTR(t64));
+                ret = seek_media_time(s, get_media_time(&s->opts, t64));
+                if (ret < 0)
+                    goto end;
+            }
+            frame = get_frame_ms(s, t64, AV_NOPTS_VALUE);
+
+            /* Decoding forward found no newer frame for this target: the one
+             * returned before this batch started is the match */
+            if (!frame && !prev && !need_seek && ref_ts != AV_NOPTS_VALUE) {
+                TRACE(s, "target %s is on the frame returned before the batch, seek back to it",
+                      PTS2TIMESTR(t64));
+                ret = seek_media_time(s, get_media_time(&s->opts, t64));
+                if (ret < 0)
+                    goto end;
+                frame = get_frame_ms(s, t64, AV_NOPTS_VALUE);
+            }
+        }
+
+        /* No frame means the previous one is still the best match (or that
+         * the media has no frame for this target) */
+        if (!frame && prev) {
+            frame = sxpi_framepool_get_frame(s->framepool, &s->framepool_cache);
+            if (!frame) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            ret = av_frame_ref(frame, prev);
+            if (ret < 0) {
+                sxpi_framepool_release_frame(s->framepool, &frame);
+                goto end;
+            }
+        }
+        if (!frame) {
+            TRACE(s, "no frame for target %s", PTS2TIMESTR(t64));
+            continue;
+        }
+
+        out[idx] = wrap_frame(s, &s->framepool_cache, frame);
+        if (!out[idx]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        prev = out[idx]->internal;
+        s->last_pushed_frame_ts = prev->pts;
+    }
+
+end:
+    if (ret < 0 && out && n > 0) {
+        for (int i = 0; i < n; i++)
+            sxplayer_release_frame(out[i]);
+        memset(out, 0, n * sizeof(*out));
+    }
+    av_freep(&targets);
+    END_FUNC(MAX_ASYNC_OP_TIME);
+    return ret;
 }
 
 struct sxplayer_frame *sxplayer_get_frame(struct sxplayer_ctx *s, double t)
@@ -906,11 +1672,68 @@ struct sxplayer_frame *sxplayer_get_next_frame(struct sxplayer_ctx *s)
 {
     START_FUNC("GET NEXT FRAME");
 
+    int ret = configure_pull_context(s);
+    if (ret < 0)
+        return ret_frame(s, NULL);
+
+    reverse_reset(s);
+    s->frame_from_cache = 0;
+
+    AVFrame *frame;
+    pop_frame(s, &frame, AV_NOPTS_VALUE);
+    return ret_frame(s, frame);
+}
+
+int sxplayer_try_get_next_frame(struct sxplayer_ctx *s, struct sxplayer_frame **framep)
+{
+    START_FUNC("TRY GET NEXT FRAME");
+
+    *framep = NULL;
+    int ret = configure_pull_context(s);
+    if (ret < 0) {
+        ret_frame(s, NULL);
+        return ret;
+    }
+
+    reverse_reset(s);
+    s->frame_from_cache = 0;
+
+    AVFrame *frame;
+    ret = pop_frame(s, &frame, av_gettime_relative());
+    *framep = ret_frame(s, frame);
+    if (*framep)
+        return 1;
+    return ret == AVERROR(EAGAIN) ? 0 : FFMIN(ret, 0);
+}
+
+int sxplayer_get_event_fd(struct sxplayer_ctx *s)
+{
+    START_FUNC("GET EVENT FD");
+
     int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    ret = sxpi_async_get_event_fd(s->actx);
+    END_FUNC(MAX_ASYNC_OP_TIME);
+    return ret;
+}
+
+struct sxplayer_frame *sxplayer_get_prev_frame(struct sxplayer_ctx *s)
+{
+    START_FUNC("GET PREV FRAME");
+
+    int ret = configure_pull_context(s);
     if (ret < 0)
         return ret_frame(s, NULL);
 
-    AVFrame *frame = pop_frame(s);
+    const int64_t last_ts = s->last_pushed_frame_ts;
+    if (last_ts != AV_NOPTS_VALUE && last_ts <= stream_time(s, s->opts.start_time64)) {
+        TRACE(s, "already at the beginning of the media");
+        return ret_frame(s, NULL);
+    }
+
+    AVFrame *frame = reverse_get_frame(s, last_ts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : last_ts - 1);
     return ret_frame(s, frame);
 }
 
@@ -921,7 +1744,7 @@ int sxplayer_get_info(struct sxplayer_ctx *s, struct sxplayer_info *info)
     int ret = configure_context(s);
     if (ret < 0)
         goto end;
-    ret = sxpi_async_fetch_info(s->actx, info);
+    ret = sxpi_async_fetch_info(s->actx, info, AV_NOPTS_VALUE);
     if (ret < 0)
         goto end;
     TRACE(s, "media info: %dx%d %f tb:%d/%d",
@@ -933,6 +1756,47 @@ end:
     return ret;
 }
 
+int sxplayer_get_info_async(struct sxplayer_ctx *s, void *arg, sxplayer_info_callback_type callback)
+{
+    START_FUNC("GET INFO ASYNC");
+
+    int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    ret = sxpi_async_fetch_info_cb(s->actx, arg, callback);
+    END_FUNC(MAX_ASYNC_OP_TIME);
+    return ret;
+}
+
+int sxplayer_prepare(struct sxplayer_ctx *s)
+{
+    START_FUNC("PREPARE");
+
+    int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    ret = sxpi_async_prepare(s->actx);
+    END_FUNC(MAX_ASYNC_OP_TIME);
+    return ret;
+}
+
+int sxplayer_get_stats(struct sxplayer_ctx *s, struct sxplayer_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    sxpi_framepool_get_stats(s->framepool, stats);
+    if (s->actx) {
+        sxpi_async_get_cache_stats(s->actx, &stats->nb_cache_hits, &stats->nb_cache_misses);
+        sxpi_async_get_open_stats(s->actx, &stats->open_duration, &stats->fast_opened);
+        sxpi_async_get_seek_stats(s->actx, &stats->nb_superseded_seeks);
+        stats->sink_depth = sxpi_async_get_sink_depth(s->actx);
+        stats->queued_bytes = sxpi_async_get_queued_bytes(s->actx);
+    }
+    stats->time_to_first_frame = atomic_load_explicit(&s->time_to_first_frame, memory_order_relaxed);
+    return 0;
+}
+
 int sxplayer_get_duration(struct sxplayer_ctx *s, double *duration)
 {
     START_FUNC("GET DURATION");
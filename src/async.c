@@ -19,6 +19,9 @@
  */
 
 
+#include <math.h>
+#include <stdatomic.h>
+
 #include <libavcodec/avcodec.h>
 #include <libavutil/avassert.h>
 #include <libavutil/avstring.h>
@@ -29,8 +32,14 @@
 
 #include "internal.h"
 #include "async.h"
+#include "framecache.h"
 #include "log.h"
+#include "pktindex.h"
 #include "pthread_compat.h"
+#include "readyfd.h"
+#include "sidecar.h"
+#include "wakeup.h"
+#include "workpool.h"
 
 #include "mod_demuxing.h"
 #include "mod_decoding.h"
@@ -43,10 +52,28 @@ struct info_message {
     AVRational timebase;
 };
 
+/* Data of a MSG_INFO_CB message */
+struct info_request {
+    sxplayer_info_callback_type callback;
+    void *arg;
+};
+
 struct async_context {
     void *log_ctx;
     const char *filename;
     const struct sxplayer_opts *o;
+    struct framepool *framepool;
+    struct framecache *framecache;          // frames delivered to the user, NULL if disabled
+    struct pktindex *pktindex;              // packets of the stream, outlives the modules
+    int pktindex_built;
+    struct sidecar *sidecar;                // NULL if disabled
+    struct workpool *workpool;              // shared workers running the modules, NULL for dedicated threads
+    filtering_frame_func frame_cb;          // frames delivery callback, NULL to queue them in the sink
+    void *frame_cb_arg;
+    struct wakeup filterer_wakeup;          // see sxpi_filtering_set_wakeup()
+    int fused;                              // the filtering runs inline in the decoder (see pipeline_layout)
+    AVRational timebase;                    // stream timebase, set once the modules are initialized
+    _Atomic(struct readyfd *) readyfd;      // signaled when the user may make progress, NULL until requested
 
     struct demuxing_ctx  *demuxer;
     struct decoding_ctx  *decoder;
@@ -57,100 +84,244 @@ struct async_context {
     pthread_t filterer_tid;
     pthread_t control_tid;
 
+    struct workpool_task *demuxer_task;
+    struct workpool_task *decoder_task;
+    struct workpool_task *filterer_task;
+    struct workpool_task *control_task;     // blocking task of the pool
+
     int demuxer_started;
     int decoder_started;
     int filterer_started;
     int control_started;
 
-    AVThreadMessageQueue *src_queue;        // user     <-> demuxer
-    AVThreadMessageQueue *pkt_queue;        // demuxer  <-> decoder
-    AVThreadMessageQueue *frames_queue;     // decoder  <-> filterer
-    AVThreadMessageQueue *sink_queue;       // filterer <-> user
+    struct msgqueue *src_queue;        // user     <-> demuxer
+    struct msgqueue *pkt_queue;        // demuxer  <-> decoder
+    struct msgqueue *frames_queue;     // decoder  <-> filterer
+    struct msgqueue *sink_queue;       // filterer <-> user
 
     AVThreadMessageQueue *ctl_in_queue;
-    AVThreadMessageQueue *ctl_out_queue;
+    struct msgqueue *ctl_out_queue;
 
     int thread_stack_size;
 
     int64_t request_seek;
+    enum seek_mode request_seek_mode;
 
     struct info_message info;
     int has_info;
 
     int modules_initialized;
 
-    int need_sync;
+    /* The control messages are numbered so we can tell if the control thread
+     * processed all of them when receiving back a sync message */
+    int ctl_seq;                            // number of the last control message sent
+    int synced_seq;                         // number of the last control message known to be processed
+    int sync_pending;                       // a sync message is waiting to be sent back
+    int info_pending;                       // an info message is waiting to be sent back
+
+    /* Control message met while coalescing a burst of seeks, to be processed
+     * next by the control thread */
+    struct message ctl_next;
+    int has_ctl_next;
 
     int playing;
+
+    /* Written by the control thread, read by the user */
+    atomic_llong open_duration;
+    atomic_int fast_opened;
+    atomic_llong nb_superseded_seeks;
+
+    /* Incremented by the control thread right before sending a seek to the
+     * modules, which drop their obsolete work until they receive it */
+    atomic_int seek_gen;
+
+    /* Prefetch (see adaptive_prefetch and prefetch_duration): the sink is
+     * allocated for the whole budget, but the filterer only fills it up to
+     * sink_depth */
+    int prefetch;                           // the sink depth is not its capacity
+    int min_sink_depth;                     // set by the control thread when initializing the modules
+    int max_sink_depth;                     // capacity of the sink
+    atomic_int sink_depth;
+    atomic_llong frame_time;                // peak time spent producing a frame (see sxpi_filtering_set_sink_depth())
+    int64_t last_pop_time;
+    int64_t request_interval;               // average interval between two frames requested by the user
+
+    /* Bytes of the packets and frames in the queues */
+    struct membudget pkt_budget;
+    struct membudget frames_budget;
+    struct membudget sink_budget;
 };
 
-/* Send a message to the control input and fetch from the output until we get
- * it back */
-static int send_wait_ctl_message(struct async_context *actx,
-                                 struct message *msg)
+#define TASK_MAX_STEPS    8                 // number of steps a module runs before yielding its pool worker
+
+/* In pool mode, the modules are not blocked on their queues: they must be
+ * woken up after any change on them they could be waiting for */
+static void wake_modules_except(struct async_context *actx, const struct workpool_task *self)
 {
-    const int message_type = msg->type;
-    const char *msg_type_str = sxpi_async_get_msg_type_string(message_type);
-    TRACE(actx, "--> send %s", msg_type_str);
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, msg, 0);
+    if (!actx->workpool)
+        return;
+    if (actx->demuxer_task != self)
+        sxpi_workpool_task_wake(actx->demuxer_task);
+    if (actx->decoder_task != self)
+        sxpi_workpool_task_wake(actx->decoder_task);
+    if (actx->filterer_task && actx->filterer_task != self)
+        sxpi_workpool_task_wake(actx->filterer_task);
+}
+
+static void wake_modules(void *arg)
+{
+    wake_modules_except(arg, NULL);
+}
+
+/* Signal the event fd (if any) after the sink received a frame or ended, or
+ * the control thread processed a request */
+static void notify_ready(void *arg)
+{
+    struct async_context *actx = arg;
+    struct readyfd *readyfd = atomic_load(&actx->readyfd);
+    if (readyfd)
+        sxpi_readyfd_signal(readyfd);
+}
+
+/* Grant the filterer enough frames in the sink to cover the slowest frame
+ * recently produced while the user keeps requesting at the same pace. The
+ * depth grows at once, but shrinks one frame at a time. */
+static void adapt_sink_depth(struct async_context *actx)
+{
+    const int64_t now = av_gettime_relative();
+    const int64_t last_pop_time = actx->last_pop_time;
+    actx->last_pop_time = now;
+    if (last_pop_time == AV_NOPTS_VALUE)
+        return;
+    const int64_t interval = now - last_pop_time;
+    actx->request_interval = actx->request_interval ? (actx->request_interval * 7 + interval) / 8 : interval;
+
+    const int64_t request_interval = FFMAX(actx->request_interval, 1);
+    const int64_t frame_time = atomic_load_explicit(&actx->frame_time, memory_order_relaxed);
+    const int target = av_clip64((frame_time + request_interval - 1) / request_interval + 1,
+                                 actx->min_sink_depth, actx->max_sink_depth);
+    const int depth = atomic_load_explicit(&actx->sink_depth, memory_order_relaxed);
+    if (target == depth)
+        return;
+    const int new_depth = target > depth ? target : depth - 1;
+    TRACE(actx, "sink depth: %d -> %d (frame time:%"PRId64" request interval:%"PRId64")",
+          depth, new_depth, frame_time, actx->request_interval);
+    atomic_store_explicit(&actx->sink_depth, new_depth, memory_order_relaxed);
+}
+
+/* Fetch one reply from the control output queue, waiting at most until the
+ * deadline (absolute time in the av_gettime_relative() reference,
+ * AV_NOPTS_VALUE to wait indefinitely), and update the async state
+ * accordingly */
+static int wait_ctl_reply(struct async_context *actx, int64_t deadline)
+{
+    struct message msg;
+    int ret = deadline == AV_NOPTS_VALUE ? sxpi_msg_recv(actx->ctl_out_queue, &msg, 0)
+                                         : sxpi_msg_recv_deadline(actx->ctl_out_queue, &msg, deadline);
     if (ret < 0) {
-        TRACE(actx, "couldn't send %s: %s", msg_type_str, av_err2str(ret));
+        if (ret != AVERROR(EAGAIN))
+            TRACE(actx, "couldn't get control reply: %s", av_err2str(ret));
         return ret;
     }
-    TRACE(actx, "wait %s", msg_type_str);
-    memset(msg, 0, sizeof(*msg));
-    for (;;) {
-        ret = av_thread_message_queue_recv(actx->ctl_out_queue, msg, 0);
-        if (ret < 0 || msg->type == message_type)
-            break;
-        sxpi_msg_free_data(msg);
+
+    TRACE(actx, "got %s", sxpi_async_get_msg_type_string(msg.type));
+    if (msg.type == MSG_SYNC) {
+        actx->synced_seq = (int)(intptr_t)msg.data;
+        actx->sync_pending = 0;
+        msg.data = NULL;
+    } else if (msg.type == MSG_INFO) {
+        memcpy(&actx->info, msg.data, sizeof(actx->info));
+        TRACE(actx, "info fetched: %dx%d duration=%s",
+              actx->info.width, actx->info.height,
+              PTS2TIMESTR(actx->info.duration));
+        actx->has_info = 1;
+        actx->info_pending = 0;
     }
-    if (ret < 0)
-        TRACE(actx, "couldn't get %s: %s", msg_type_str, av_err2str(ret));
-    else
-        TRACE(actx, "got %s", msg_type_str);
+    sxpi_msg_free_data(&msg);
+    return 0;
+}
+
+/* Queue a message to the control, without numbering it */
+static int post_ctl_message(struct async_context *actx, struct message *msg)
+{
+    int ret = av_thread_message_queue_send(actx->ctl_in_queue, msg, 0);
+    if (ret >= 0 && actx->control_task)
+        sxpi_workpool_task_wake(actx->control_task);
     return ret;
 }
 
+static int send_ctl_message(struct async_context *actx, struct message *msg)
+{
+    int ret = post_ctl_message(actx, msg);
+    if (ret < 0) {
+        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
+        return ret;
+    }
+    actx->ctl_seq++;
+    return 0;
+}
+
 /* There might be some actions still processing in the control thread, so we
- * send a sync message to make sure every actions has been processed */
-static int sync_control_thread(struct async_context *actx)
+ * send a sync message to make sure every actions has been processed. If the
+ * deadline is reached before, AVERROR(EAGAIN) is returned and the next call
+ * will resume the wait. */
+static int sync_control_thread(struct async_context *actx, int64_t deadline)
 {
-    if (actx->need_sync) {
-        TRACE(actx, "need sync");
-        struct message sync_msg = { .type = MSG_SYNC };
-        int ret = send_wait_ctl_message(actx, &sync_msg);
+    if (actx->synced_seq == actx->ctl_seq) {
+        TRACE(actx, "no need to sync");
+        return 0;
+    }
+
+    TRACE(actx, "need sync");
+    while (actx->synced_seq != actx->ctl_seq) {
+        if (!actx->sync_pending) {
+            /* The sync message carries the number of the last message sent,
+             * and is itself not numbered */
+            struct message sync_msg = {
+                .type = MSG_SYNC,
+                .data = (void *)(intptr_t)actx->ctl_seq,
+            };
+            int ret = post_ctl_message(actx, &sync_msg);
+            if (ret < 0) {
+                TRACE(actx, "couldn't send sync: %s", av_err2str(ret));
+                return ret;
+            }
+            actx->sync_pending = 1;
+        }
+        int ret = wait_ctl_reply(actx, deadline);
         if (ret < 0)
             return ret;
-        av_assert0(!sync_msg.data);
-        actx->need_sync = 0;
-    } else {
-        TRACE(actx, "no need to sync");
     }
     return 0;
 }
 
-static int fetch_mod_info(struct async_context *actx)
+/* Ask the control thread for the info without waiting for the reply */
+static int request_mod_info(struct async_context *actx)
 {
-    TRACE(actx, "fetch module info");
-    if (actx->has_info)
+    if (actx->has_info || actx->info_pending)
         return 0;
 
-    int ret = sync_control_thread(actx);
-    if (ret < 0)
-        return ret;
-
     struct message msg = { .type = MSG_INFO };
-    ret = send_wait_ctl_message(actx, &msg);
-    if (ret < 0)
+    int ret = post_ctl_message(actx, &msg);
+    if (ret < 0) {
+        TRACE(actx, "couldn't send info: %s", av_err2str(ret));
         return ret;
-    av_assert0(msg.type == MSG_INFO);
-    memcpy(&actx->info, msg.data, sizeof(actx->info));
-    TRACE(actx, "info fetched: %dx%d duration=%s",
-          actx->info.width, actx->info.height,
-          PTS2TIMESTR(actx->info.duration));
-    sxpi_msg_free_data(&msg);
-    actx->has_info = 1;
+    }
+    actx->info_pending = 1;
+    return 0;
+}
+
+static int fetch_mod_info(struct async_context *actx, int64_t deadline)
+{
+    TRACE(actx, "fetch module info");
+    while (!actx->has_info) {
+        int ret = request_mod_info(actx);
+        if (ret < 0)
+            return ret;
+        ret = wait_ctl_reply(actx, deadline);
+        if (ret < 0)
+            return ret;
+    }
     return 0;
 }
 
@@ -159,30 +330,86 @@ struct async_context *sxpi_async_alloc_context(void)
     struct async_context *actx = av_mallocz(sizeof(*actx));
     if (!actx)
         return NULL;
+    sxpi_wakeup_init(&actx->filterer_wakeup);
     return actx;
 }
 
-int sxpi_async_fetch_info(struct async_context *actx, struct sxplayer_info *info)
+static void fill_info(struct async_context *actx, const struct info_message *mod_info,
+                      struct sxplayer_info *info)
+{
+    info->width    = mod_info->width;
+    info->height   = mod_info->height;
+    info->duration = mod_info->duration * av_q2d(AV_TIME_BASE_Q);
+    info->is_image = mod_info->is_image;
+    info->timebase[0] = mod_info->timebase.num;
+    info->timebase[1] = mod_info->timebase.den;
+    if (sxpi_pktindex_get_stats(actx->pktindex, &info->nb_frames, &info->nb_keyframes,
+                                &info->avg_gop_length) < 0) {
+        info->nb_frames      = 0;
+        info->nb_keyframes   = 0;
+        info->avg_gop_length = 0;
+    }
+}
+
+int sxpi_async_fetch_info(struct async_context *actx, struct sxplayer_info *info,
+                          int64_t deadline)
 {
-    int ret = fetch_mod_info(actx);
+    int ret = fetch_mod_info(actx, deadline);
     if (ret < 0)
         return ret;
-    info->width    = actx->info.width;
-    info->height   = actx->info.height;
-    info->duration = actx->info.duration * av_q2d(AV_TIME_BASE_Q);
-    info->is_image = actx->info.is_image;
-    info->timebase[0] = actx->info.timebase.num;
-    info->timebase[1] = actx->info.timebase.den;
+    fill_info(actx, &actx->info, info);
     return 0;
 }
 
-int sxpi_async_pop_frame(struct async_context *actx, AVFrame **framep)
+int sxpi_async_fetch_info_cb(struct async_context *actx, void *arg,
+                             sxplayer_info_callback_type callback)
+{
+    TRACE(actx, "--> send info callback msg");
+    struct info_request *req = av_malloc(sizeof(*req));
+    if (!req)
+        return AVERROR(ENOMEM);
+    req->callback = callback;
+    req->arg      = arg;
+    struct message msg = { .type = MSG_INFO_CB, .data = req };
+    int ret = send_ctl_message(actx, &msg);
+    if (ret < 0)
+        av_freep(&msg.data);
+    return ret;
+}
+
+int sxpi_async_prepare(struct async_context *actx)
+{
+    /* The info request is queued first so the info is available without
+     * waiting for the preroll */
+    int ret = request_mod_info(actx);
+    if (ret < 0)
+        return ret;
+    return sxpi_async_start(actx);
+}
+
+int sxpi_async_index_should_seek(struct async_context *actx, int64_t cur, int64_t target)
+{
+    return sxpi_pktindex_should_seek(actx->pktindex, cur, target, actx->o->keyframes_only);
+}
+
+int64_t sxpi_async_index_snap_to_keyframe(struct async_context *actx, int64_t ts)
+{
+    return sxpi_pktindex_snap_to_keyframe(actx->pktindex, ts);
+}
+
+int64_t sxpi_async_index_get_prev_keyframe(struct async_context *actx, int64_t ts)
+{
+    return sxpi_pktindex_get_prev_keyframe(actx->pktindex, ts);
+}
+
+int sxpi_async_pop_frame(struct async_context *actx, AVFrame **framep,
+                         int64_t deadline)
 {
     int ret;
 
     *framep = NULL;
 
-    ret = sync_control_thread(actx);
+    ret = sync_control_thread(actx, deadline);
     if (ret < 0)
         return ret;
 
@@ -191,76 +418,205 @@ int sxpi_async_pop_frame(struct async_context *actx, AVFrame **framep)
         ret = sxpi_async_start(actx);
         if (ret < 0)
             return ret;
-        ret = sync_control_thread(actx);
+        ret = sync_control_thread(actx, deadline);
         if (ret < 0)
             return ret;
     }
 
+    if (actx->o->adaptive_prefetch)
+        adapt_sink_depth(actx);
+
     TRACE(actx, "fetching a frame from the sink");
     struct message msg;
-    ret = av_thread_message_queue_recv(actx->sink_queue, &msg, 0);
+    if (deadline == AV_NOPTS_VALUE) {
+        ret = sxpi_msg_recv(actx->sink_queue, &msg, 0);
+    } else {
+        ret = sxpi_msg_recv_deadline(actx->sink_queue, &msg, deadline);
+        if (ret == AVERROR(EAGAIN)) {
+            TRACE(actx, "no frame available in the sink before the deadline");
+            return ret;
+        }
+    }
     if (ret < 0) {
         TRACE(actx, "couldn't fetch frame from sink because %s", av_err2str(ret));
-        av_thread_message_queue_set_err_send(actx->sink_queue, ret);
+        sxpi_msg_set_err_send(actx->sink_queue, ret);
         (void)sxpi_async_stop(actx);
         return ret;
     }
     av_assert0(msg.type == MSG_FRAME);
     *framep = msg.data;
+    /* A slot was freed below the sink depth, which also covers the depth
+     * growing when adapted above */
+    if (actx->prefetch)
+        sxpi_wakeup_signal(&actx->filterer_wakeup);
+    wake_modules(actx);
+
+    if (actx->framecache) {
+        /* The frames dropped by the decoding module left a hole before this
+         * one, so it does not tell until when the previous one is displayed */
+        if (av_dict_get((*framep)->metadata, SXPI_FRAME_GAP_KEY, NULL, 0))
+            sxpi_framecache_break(actx->framecache);
+        ret = sxpi_framecache_add(actx->framecache, *framep);
+        if (ret < 0)
+            LOG(actx, WARNING, "unable to cache frame: %s", av_err2str(ret));
+    }
     return 0;
 }
 
-static int create_seek_msg(struct message *msg, int64_t ts)
+AVFrame *sxpi_async_get_cached_frame(struct async_context *actx, int64_t ts)
 {
-    msg->type = MSG_SEEK,
-    msg->data = av_malloc(sizeof(ts));
-    if (!msg->data)
+    if (!actx->framecache)
+        return NULL;
+    return sxpi_framecache_get(actx->framecache, ts);
+}
+
+void sxpi_async_get_cache_stats(const struct async_context *actx, int64_t *nb_hits, int64_t *nb_misses)
+{
+    *nb_hits = *nb_misses = 0;
+    if (actx->framecache)
+        sxpi_framecache_get_stats(actx->framecache, nb_hits, nb_misses);
+}
+
+void sxpi_async_set_frame_cb(struct async_context *actx, filtering_frame_func cb, void *arg)
+{
+    av_assert0(!actx->modules_initialized);
+    actx->frame_cb = cb;
+    actx->frame_cb_arg = arg;
+}
+
+void sxpi_async_resume_frame_cb(struct async_context *actx)
+{
+    sxpi_wakeup_signal(&actx->filterer_wakeup);
+    wake_modules(actx);
+}
+
+int sxpi_async_get_event_fd(struct async_context *actx)
+{
+    struct readyfd *readyfd = atomic_load(&actx->readyfd);
+    if (!readyfd) {
+        int ret = sxpi_readyfd_alloc(&readyfd);
+        if (ret < 0) {
+            LOG(actx, ERROR, "Unable to create the event fd: %s", av_err2str(ret));
+            return ret;
+        }
+        atomic_store(&actx->readyfd, readyfd);
+
+        /* The user may already be able to make progress */
+        sxpi_readyfd_signal(readyfd);
+    }
+    return sxpi_readyfd_get_fd(readyfd);
+}
+
+AVRational sxpi_async_get_timebase(const struct async_context *actx)
+{
+    return actx->timebase;
+}
+
+void sxpi_async_get_open_stats(struct async_context *actx, int64_t *open_duration, int *fast_opened)
+{
+    *open_duration = atomic_load(&actx->open_duration);
+    *fast_opened   = atomic_load(&actx->fast_opened);
+}
+
+void sxpi_async_get_seek_stats(struct async_context *actx, int64_t *nb_superseded)
+{
+    *nb_superseded = atomic_load(&actx->nb_superseded_seeks);
+}
+
+int sxpi_async_get_sink_depth(struct async_context *actx)
+{
+    return atomic_load_explicit(&actx->sink_depth, memory_order_relaxed);
+}
+
+int64_t sxpi_async_get_queued_bytes(struct async_context *actx)
+{
+    return sxpi_membudget_get_used(&actx->pkt_budget) +
+           sxpi_membudget_get_used(&actx->frames_budget) +
+           sxpi_membudget_get_used(&actx->sink_budget);
+}
+
+/* The prefetch duration is expressed in media time, so it depends on the
+ * frame rate of the stream, which is unknown until the modules are
+ * initialized */
+static void init_sink_depth(struct async_context *actx, const AVStream *st)
+{
+    const struct sxplayer_opts *o = actx->o;
+
+    if (!actx->prefetch)
+        return;
+
+    int depth = o->max_nb_sink;
+    if (o->prefetch_duration > 0) {
+        AVRational rate = st->avg_frame_rate;
+        if (!rate.num || !rate.den)
+            rate = st->r_frame_rate;
+        if (rate.num && rate.den)
+            depth = (int)FFMIN(ceil(o->prefetch_duration * av_q2d(rate)), INT_MAX);
+        else
+            LOG(actx, WARNING, "Unknown frame rate, prefetching %d frames", depth);
+    }
+    actx->min_sink_depth = av_clip(depth, 1, actx->max_sink_depth);
+    atomic_store(&actx->sink_depth, actx->min_sink_depth);
+    TRACE(actx, "sink depth: %d (capacity:%d)", actx->min_sink_depth, actx->max_sink_depth);
+}
+
+static int create_seek_msg(struct async_context *actx, struct message *msg, int64_t ts, enum seek_mode mode)
+{
+    struct seek_request *req = av_malloc(sizeof(*req));
+    if (!req)
         return AVERROR(ENOMEM);
-    *(int64_t *)msg->data = ts;
+    req->ts   = ts;
+    req->mode = mode;
+    req->gen  = atomic_load(&actx->seek_gen);
+    *msg = (struct message){
+        .type = MSG_SEEK,
+        .data = req,
+    };
     return 0;
 }
 
-int sxpi_async_seek(struct async_context *actx, int64_t ts)
+int sxpi_async_seek(struct async_context *actx, int64_t ts, enum seek_mode mode)
 {
-    TRACE(actx, "--> send seek msg @ %s", PTS2TIMESTR(ts));
+    TRACE(actx, "--> send seek msg @ %s (mode:%d)", PTS2TIMESTR(ts), mode);
     struct message msg;
-    int ret = create_seek_msg(&msg, ts);
+    int ret = create_seek_msg(actx, &msg, ts, mode);
     if (ret < 0)
         return ret;
-    ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
-    if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
+    if (actx->framecache)
+        sxpi_framecache_break(actx->framecache);
+    ret = send_ctl_message(actx, &msg);
+    if (ret < 0)
         av_freep(&msg.data);
-        return ret;
-    }
-    actx->need_sync = 1;
-    return 0;
+    return ret;
+}
+
+int sxpi_async_sync_pending(const struct async_context *actx)
+{
+    return actx->synced_seq != actx->ctl_seq;
 }
 
 int sxpi_async_start(struct async_context *actx)
 {
     TRACE(actx, "--> send start msg");
     struct message msg = { .type = MSG_START };
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
-    if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
-        return ret;
-    }
-    actx->need_sync = 1;
-    return 0;
+    return send_ctl_message(actx, &msg);
 }
 
 int sxpi_async_stop(struct async_context *actx)
 {
     TRACE(actx, "--> send stop msg");
+    if (actx->framecache)
+        sxpi_framecache_break(actx->framecache);
     struct message msg = { .type = MSG_STOP };
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
-    if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
-        return ret;
-    }
-    actx->need_sync = 1;
-    return 0;
+    return send_ctl_message(actx, &msg);
+}
+
+/* In the fused layout, the decoder hands its messages over to the filterer
+ * directly */
+static int filter_message(void *arg, struct message *msg, int flags)
+{
+    struct async_context *actx = arg;
+    return sxpi_filtering_push_message(actx->filterer, msg, flags);
 }
 
 static int initialize_modules_once(struct async_context *actx,
@@ -285,20 +641,59 @@ static int initialize_modules_once(struct async_context *actx,
     if ((ret = sxpi_demuxing_init(actx->log_ctx,
                                   actx->demuxer,
                                   actx->src_queue, actx->pkt_queue,
-                                  actx->filename, opts)) < 0 ||
+                                  actx->filename, opts, actx->sidecar)) < 0 ||
         (ret = sxpi_decoding_init(actx->log_ctx,
                                   actx->decoder,
                                   actx->pkt_queue, actx->frames_queue,
                                   sxpi_demuxing_is_image(actx->demuxer),
-                                  sxpi_demuxing_get_stream(actx->demuxer), opts)) < 0 ||
+                                  sxpi_demuxing_get_stream(actx->demuxer),
+                                  actx->framepool, opts)) < 0 ||
         (ret = sxpi_filtering_init(actx->log_ctx,
                                    actx->filterer,
                                    actx->frames_queue, actx->sink_queue,
                                    sxpi_demuxing_get_stream(actx->demuxer),
                                    sxpi_decoding_get_avctx(actx->decoder),
-                                   sxpi_demuxing_probe_rotation(actx->demuxer), opts)) < 0)
+                                   sxpi_demuxing_probe_rotation(actx->demuxer),
+                                   actx->framepool, opts)) < 0)
         return ret;
 
+    if (actx->workpool)
+        sxpi_decoding_set_wake_cb(actx->decoder, wake_modules, actx);
+    if (actx->fused)
+        sxpi_decoding_set_msg_cb(actx->decoder, filter_message, actx);
+    if (actx->frame_cb)
+        sxpi_filtering_set_frame_cb(actx->filterer, actx->frame_cb, actx->frame_cb_arg);
+    sxpi_filtering_set_wakeup(actx->filterer, &actx->filterer_wakeup);
+    sxpi_filtering_set_sink_cb(actx->filterer, notify_ready, actx);
+    sxpi_demuxing_set_seek_gen(actx->demuxer,  &actx->seek_gen);
+    sxpi_decoding_set_seek_gen(actx->decoder,  &actx->seek_gen);
+    sxpi_filtering_set_seek_gen(actx->filterer, &actx->seek_gen);
+    if (actx->prefetch)
+        sxpi_filtering_set_sink_depth(actx->filterer, &actx->sink_depth, &actx->frame_time);
+    init_sink_depth(actx, sxpi_demuxing_get_stream(actx->demuxer));
+    sxpi_demuxing_set_budget(actx->demuxer,  &actx->pkt_budget);
+    sxpi_decoding_set_budget(actx->decoder,  actx->fused ? &actx->sink_budget : &actx->frames_budget);
+    sxpi_filtering_set_budget(actx->filterer, &actx->sink_budget);
+
+    actx->timebase = sxpi_demuxing_get_stream(actx->demuxer)->time_base;
+    if (!actx->timebase.num || !actx->timebase.den) {
+        LOG(actx, WARNING, "Invalid timebase %d/%d, assuming 1/1",
+            actx->timebase.num, actx->timebase.den);
+        actx->timebase = av_make_q(1, 1);
+    }
+
+    atomic_store(&actx->open_duration, sxpi_demuxing_get_open_duration(actx->demuxer));
+    atomic_store(&actx->fast_opened, sxpi_demuxing_is_fast_opened(actx->demuxer));
+
+    if (!actx->pktindex_built) {
+        ret = sxpi_demuxing_build_index(actx->demuxer, actx->pktindex,
+                                        actx->filename, opts->index_scan || opts->reverse,
+                                        actx->workpool);
+        if (ret < 0)
+            return ret;
+        actx->pktindex_built = 1;
+    }
+
     actx->modules_initialized = 1;
     return 0;
 }
@@ -312,6 +707,15 @@ static int alloc_msg_queue(AVThreadMessageQueue **q, int n)
     return 0;
 }
 
+static int alloc_module_queue(struct msgqueue **q, int n)
+{
+    int ret = sxpi_msgqueue_alloc(q, n, sizeof(struct message));
+    if (ret < 0)
+        return ret;
+    sxpi_msgqueue_set_free_func(*q, sxpi_msg_free_data);
+    return 0;
+}
+
 #define MODULE_THREAD_FUNC(name, action)                                        \
 static void *name##_thread(void *arg)                                           \
 {                                                                               \
@@ -323,6 +727,31 @@ static void *name##_thread(void *arg)
     return NULL;                                                                \
 }
 
+#define MODULE_TASK_FUNC(name, action)                                          \
+static enum workpool_status name##_task_func(void *arg)                         \
+{                                                                               \
+    struct async_context *actx = arg;                                           \
+    enum workpool_status status = WORKPOOL_TASK_AGAIN;                          \
+    int progress = 0;                                                           \
+    for (int i = 0; i < TASK_MAX_STEPS; i++) {                                  \
+        const int ret = sxpi_##action##_step(actx->name,                        \
+                                             AV_THREAD_MESSAGE_NONBLOCK);       \
+        if (ret == AVERROR(EAGAIN)) {                                           \
+            status = WORKPOOL_TASK_IDLE;                                        \
+            break;                                                              \
+        }                                                                       \
+        progress = 1;                                                           \
+        if (ret < 0) {                                                          \
+            TRACE(actx, "[<] " AV_STRINGIFY(action) " task ending");            \
+            status = WORKPOOL_TASK_DONE;                                        \
+            break;                                                              \
+        }                                                                       \
+    }                                                                           \
+    if (progress)                                                               \
+        wake_modules_except(actx, actx->name##_task);                           \
+    return status;                                                              \
+}
+
 #define START_MODULE_THREAD(name) do {                                          \
     if (actx->name##_started) {                                                 \
         TRACE(actx, "not starting " AV_STRINGIFY(name)                          \
@@ -371,10 +800,34 @@ static void *name##_thread(void *arg)
     }                                                                           \
 } while (0)
 
+#define START_MODULE(name) do {                                                 \
+    if (!actx->workpool) {                                                      \
+        START_MODULE_THREAD(name);                                              \
+    } else if (!actx->name##_started) {                                         \
+        TRACE(actx, "[>] starting " AV_STRINGIFY(name) " task");                \
+        sxpi_workpool_task_start(actx->name##_task);                            \
+        actx->name##_started = 1;                                               \
+    }                                                                           \
+} while (0)
+
+#define JOIN_MODULE(name) do {                                                  \
+    if (!actx->workpool) {                                                      \
+        JOIN_MODULE_THREAD(name);                                               \
+    } else if (actx->name##_started) {                                          \
+        TRACE(actx, "waiting for " AV_STRINGIFY(name) " task");                 \
+        sxpi_workpool_task_wait(actx->name##_task);                             \
+        actx->name##_started = 0;                                               \
+    }                                                                           \
+} while (0)
+
 MODULE_THREAD_FUNC(demuxer,  demuxing)
 MODULE_THREAD_FUNC(decoder,  decoding)
 MODULE_THREAD_FUNC(filterer, filtering)
 
+MODULE_TASK_FUNC(demuxer,  demuxing)
+MODULE_TASK_FUNC(decoder,  decoding)
+MODULE_TASK_FUNC(filterer, filtering)
+
 static int is_seek_possible(const struct async_context *actx)
 {
     return sxpi_demuxing_probe_duration(actx->demuxer) != AV_NOPTS_VALUE;
@@ -384,6 +837,7 @@ static int op_start(struct async_context *actx)
 {
     struct message msg;
     int64_t seek_to = AV_NOPTS_VALUE;
+    enum seek_mode seek_mode = SEEK_MODE_PRECISE;
     const struct sxplayer_opts *o = actx->o;
 
     TRACE(actx, "exec");
@@ -397,6 +851,7 @@ static int op_start(struct async_context *actx)
     if (actx->request_seek != AV_NOPTS_VALUE) {
         TRACE(actx, "request seek is set to %s", PTS2TIMESTR(actx->request_seek));
         seek_to = actx->request_seek;
+        seek_mode = actx->request_seek_mode;
     } else if (o->start_time64) {
         TRACE(actx, "start_time is set to %s", PTS2TIMESTR(actx->o->start_time64));
         seek_to = o->start_time64;
@@ -410,15 +865,15 @@ static int op_start(struct async_context *actx)
     if (seek_to != AV_NOPTS_VALUE) {
         TRACE(actx, "seek to: %s", PTS2TIMESTR(seek_to));
 
-        int ret = create_seek_msg(&msg, seek_to);
+        int ret = create_seek_msg(actx, &msg, seek_to, seek_mode);
         if (ret < 0)
             return ret;
 
         // Queue a seek request which we will pull out after the demuxer is started
-        ret = av_thread_message_queue_send(actx->src_queue, &msg, 0);
+        ret = sxpi_msgqueue_send(actx->src_queue, &msg, 0);
         if (ret < 0) {
             LOG(actx, ERROR, "Unable to queue a seek message to the demuxer, shouldn't happen!");
-            av_thread_message_queue_set_err_recv(actx->src_queue, ret);
+            sxpi_msgqueue_set_err_recv(actx->src_queue, ret);
             sxpi_msg_free_data(&msg);
             return ret;
         }
@@ -426,12 +881,19 @@ static int op_start(struct async_context *actx)
 
     actx->request_seek = AV_NOPTS_VALUE;
 
-    START_MODULE_THREAD(demuxer);
-    START_MODULE_THREAD(decoder);
-    START_MODULE_THREAD(filterer);
+    /* The depth adapted to the previous run tells nothing about this one */
+    if (actx->prefetch) {
+        atomic_store(&actx->sink_depth, actx->min_sink_depth);
+        atomic_store(&actx->frame_time, 0);
+    }
+
+    START_MODULE(demuxer);
+    START_MODULE(decoder);
+    if (!actx->fused)
+        START_MODULE(filterer);
     if (!actx->demuxer_started ||
         !actx->decoder_started ||
-        !actx->filterer_started)
+        (!actx->fused && !actx->filterer_started))
         return AVERROR(ENOMEM);
 
     actx->playing = 1;
@@ -440,11 +902,12 @@ static int op_start(struct async_context *actx)
         TRACE(actx, "wait for seek (to %s) to come back", PTS2TIMESTR(seek_to));
         memset(&msg, 0, sizeof(msg));
         do {
-            ret = av_thread_message_queue_recv(actx->sink_queue, &msg, 0);
+            ret = sxpi_msg_recv(actx->sink_queue, &msg, 0);
             if (ret < 0) {
-                av_thread_message_queue_set_err_send(actx->sink_queue, ret);
+                sxpi_msg_set_err_send(actx->sink_queue, ret);
                 return ret;
             }
+            wake_modules(actx);
             sxpi_msg_free_data(&msg);
         } while (msg.type != MSG_SEEK);
     }
@@ -482,15 +945,9 @@ static int op_info(struct async_context *actx, struct message *msg)
         .height   = st->codecpar->height,
         .duration = end_time,
         .is_image = is_image,
-        .timebase = st->time_base,
+        .timebase = actx->timebase,
     };
 
-    if (!info.timebase.num || !info.timebase.den) {
-        LOG(actx, WARNING, "Invalid timebase %d/%d, assuming 1/1",
-            info.timebase.num, info.timebase.den);
-        info.timebase = av_make_q(1, 1);
-    }
-
     msg->data = av_memdup(&info, sizeof(info));
     if (!msg->data)
         return AVERROR(ENOMEM);
@@ -498,40 +955,68 @@ static int op_info(struct async_context *actx, struct message *msg)
     return 0;
 }
 
+static int op_info_cb(struct async_context *actx, struct message *msg)
+{
+    struct info_request *req = msg->data;
+    struct message info_msg = { .type = MSG_INFO };
+
+    int ret = op_info(actx, &info_msg);
+    if (ret < 0) {
+        req->callback(req->arg, ret, NULL);
+        return ret;
+    }
+
+    struct sxplayer_info info;
+    fill_info(actx, info_msg.data, &info);
+    sxpi_msg_free_data(&info_msg);
+    req->callback(req->arg, 0, &info);
+    return 0;
+}
+
 static void kill_join_reset_workers(struct async_context *actx)
 {
     TRACE(actx, "prevent modules from feeding and reading from the queues");
-    av_thread_message_queue_set_err_send(actx->src_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->pkt_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->frames_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->sink_queue,   AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->src_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->pkt_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->frames_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->sink_queue,   AVERROR_EXIT);
-
-    // they won't fill the queues anymore, so we can empty them
-    av_thread_message_flush(actx->src_queue);
-    av_thread_message_flush(actx->pkt_queue);
-    av_thread_message_flush(actx->frames_queue);
-    av_thread_message_flush(actx->sink_queue);
+    sxpi_msg_set_err_send(actx->src_queue,    AVERROR_EXIT);
+    sxpi_msg_set_err_send(actx->pkt_queue,    AVERROR_EXIT);
+    sxpi_msg_set_err_send(actx->frames_queue, AVERROR_EXIT);
+    sxpi_msg_set_err_send(actx->sink_queue,   AVERROR_EXIT);
+    sxpi_msgqueue_set_err_recv(actx->src_queue,    AVERROR_EXIT);
+    sxpi_msgqueue_set_err_recv(actx->pkt_queue,    AVERROR_EXIT);
+    sxpi_msgqueue_set_err_recv(actx->frames_queue, AVERROR_EXIT);
+    sxpi_msgqueue_set_err_recv(actx->sink_queue,   AVERROR_EXIT);
+
+    // a filterer waiting for a busy frame callback does not watch its queues
+    if (actx->filterer)
+        sxpi_filtering_abort(actx->filterer);
+
+    // they won't fill the queues anymore, so we can empty them (the messages
+    // are actually freed once the modules are joined)
+    sxpi_msgqueue_flush(actx->src_queue);
+    sxpi_msgqueue_flush(actx->pkt_queue);
+    sxpi_msgqueue_flush(actx->frames_queue);
+    sxpi_msgqueue_flush(actx->sink_queue);
 
     // now that we are sure the threads modules will stop by themselves, we can
     // join them
     TRACE(actx, "waiting for modules to end");
-    JOIN_MODULE_THREAD(filterer);
-    JOIN_MODULE_THREAD(decoder);
-    JOIN_MODULE_THREAD(demuxer);
+    wake_modules(actx);
+    JOIN_MODULE(filterer);
+    JOIN_MODULE(decoder);
+    JOIN_MODULE(demuxer);
 
     // every worker ended, reset queues states
-    av_thread_message_queue_set_err_send(actx->src_queue,    0);
-    av_thread_message_queue_set_err_send(actx->pkt_queue,    0);
-    av_thread_message_queue_set_err_send(actx->frames_queue, 0);
-    av_thread_message_queue_set_err_send(actx->sink_queue,   0);
-    av_thread_message_queue_set_err_recv(actx->src_queue,    0);
-    av_thread_message_queue_set_err_recv(actx->pkt_queue,    0);
-    av_thread_message_queue_set_err_recv(actx->frames_queue, 0);
-    av_thread_message_queue_set_err_recv(actx->sink_queue,   0);
+    sxpi_msgqueue_drain(actx->src_queue);
+    sxpi_msgqueue_drain(actx->pkt_queue);
+    sxpi_msgqueue_drain(actx->frames_queue);
+    sxpi_msgqueue_drain(actx->sink_queue);
+    sxpi_msgqueue_set_err_send(actx->src_queue,    0);
+    sxpi_msgqueue_set_err_send(actx->pkt_queue,    0);
+    sxpi_msgqueue_set_err_send(actx->frames_queue, 0);
+    sxpi_msgqueue_set_err_send(actx->sink_queue,   0);
+    sxpi_msgqueue_set_err_recv(actx->src_queue,    0);
+    sxpi_msgqueue_set_err_recv(actx->pkt_queue,    0);
+    sxpi_msgqueue_set_err_recv(actx->frames_queue, 0);
+    sxpi_msgqueue_set_err_recv(actx->sink_queue,   0);
 }
 
 /* Forward the message to the modules if they are running, otherwise memorize
@@ -556,14 +1041,22 @@ static int op_seek(struct async_context *actx, struct message *seek_msg)
         return 0;
     }
 
-    actx->request_seek = *(int64_t *)seek_msg->data;
+    struct seek_request *req = seek_msg->data;
+    actx->request_seek      = req->ts;
+    actx->request_seek_mode = req->mode;
 
     if (!actx->playing) {
         sxpi_msg_free_data(seek_msg);
         return 0;
     }
 
-    ret = av_thread_message_queue_send(actx->src_queue, seek_msg, 0);
+    /* From now on, whatever the modules are doing is obsolete: this makes
+     * them skip it instead of waiting for the seek to reach them behind the
+     * packets and frames already queued */
+    req->gen = atomic_fetch_add(&actx->seek_gen, 1) + 1;
+    sxpi_wakeup_signal(&actx->filterer_wakeup);
+    ret = sxpi_msgqueue_send(actx->src_queue, seek_msg, 0);
+    wake_modules(actx);
     if (ret < 0) {
         /* If this errors out, it means the modules ended by themselves (no
          * stop requested by the user), so we delay the seek, reset the workers
@@ -577,12 +1070,13 @@ static int op_seek(struct async_context *actx, struct message *seek_msg)
     memset(seek_msg, 0, sizeof(*seek_msg));
     for (;;) {
         TRACE(actx, "seek request sent, wait for its return");
-        ret = av_thread_message_queue_recv(actx->sink_queue, seek_msg, 0);
+        ret = sxpi_msg_recv(actx->sink_queue, seek_msg, 0);
         if (ret < 0) {
             TRACE(actx, "unable to get request seek back");
             kill_join_reset_workers(actx);
             return op_start(actx);
         }
+        wake_modules(actx);
         sxpi_msg_free_data(seek_msg);
         if (seek_msg->type == MSG_SEEK)
             break;
@@ -606,6 +1100,118 @@ static void op_stop(struct async_context *actx)
     actx->request_seek = AV_NOPTS_VALUE;
 }
 
+static int recv_ctl_message(struct async_context *actx, struct message *msg, int flags)
+{
+    if (actx->has_ctl_next) {
+        *msg = actx->ctl_next;
+        actx->has_ctl_next = 0;
+        return 0;
+    }
+    return av_thread_message_queue_recv(actx->ctl_in_queue, msg, flags);
+}
+
+/*
+ * Replace the seek message with the last one of the seeks queued right after
+ * it: while scrubbing, only the latest target of a burst is worth executing.
+ * The first message of another type ends the burst, and is kept aside to be
+ * processed next so the messages order is preserved.
+ */
+static void coalesce_seeks(struct async_context *actx, struct message *seek_msg)
+{
+    struct message msg;
+
+    while (!actx->has_ctl_next &&
+           av_thread_message_queue_recv(actx->ctl_in_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK) >= 0) {
+        if (msg.type != MSG_SEEK) {
+            actx->ctl_next = msg;
+            actx->has_ctl_next = 1;
+            break;
+        }
+        TRACE(actx, "seek to %s superseded by a seek to %s",
+              PTS2TIMESTR(((const struct seek_request *)seek_msg->data)->ts),
+              PTS2TIMESTR(((const struct seek_request *)msg.data)->ts));
+        sxpi_msg_free_data(seek_msg);
+        *seek_msg = msg;
+        atomic_fetch_add(&actx->nb_superseded_seeks, 1);
+    }
+}
+
+/* Execute a control message, return a negative error if the control must
+ * end */
+static int process_ctl_message(struct async_context *actx, struct message *msg)
+{
+    int ret = 0;
+    enum msg_type type = msg->type;
+    TRACE(actx, "--- handling OP %s", sxpi_async_get_msg_type_string(type));
+
+    switch (type) {
+    case MSG_SEEK:
+        coalesce_seeks(actx, msg);
+        ret = op_seek(actx, msg);
+        break;
+    case MSG_START:
+        // XXX: fetch info first?
+        if (!actx->playing)
+            ret = op_start(actx);
+        break;
+    case MSG_STOP:
+        if (actx->playing)
+            op_stop(actx);
+        break;
+    case MSG_INFO:
+        ret = op_info(actx, msg);
+        break;
+    case MSG_INFO_CB:
+        ret = op_info_cb(actx, msg);
+        sxpi_msg_free_data(msg);
+        break;
+    case MSG_SYNC:
+        break;
+    default:
+        av_assert0(0);
+    }
+
+    TRACE(actx, "<-- OP %s processed", sxpi_async_get_msg_type_string(type));
+
+    if (ret < 0) {
+        LOG(actx, ERROR, "Unable to honor %s message: %s",
+            sxpi_async_get_msg_type_string(type), av_err2str(ret));
+        sxpi_msg_free_data(msg);
+        return ret;
+    }
+
+    // Forward the message to the out queue now that it has been processed
+    // if it's a sync OP
+    if (type == MSG_INFO || type == MSG_SYNC) {
+        TRACE(actx, "forward %s to control out queue",
+              sxpi_async_get_msg_type_string(type));
+        ret = sxpi_msg_send(actx->ctl_out_queue, NULL, msg, 0);
+        if (ret < 0) {
+            // shouldn't happen
+            LOG(actx, ERROR, "Unable to forward %s message to the output async queue: %s",
+                sxpi_async_get_msg_type_string(type), av_err2str(ret));
+            sxpi_msg_free_data(msg);
+        }
+    }
+
+    notify_ready(actx);
+    return 0;
+}
+
+static void end_control(struct async_context *actx, int ret)
+{
+    if (ret < 0) {
+        av_thread_message_queue_set_err_send(actx->ctl_in_queue, ret);
+        sxpi_msgqueue_set_err_recv(actx->ctl_out_queue, ret);
+    }
+    if (actx->has_ctl_next) {
+        sxpi_msg_free_data(&actx->ctl_next);
+        actx->has_ctl_next = 0;
+    }
+    TRACE(actx, "control ending");
+    op_stop(actx);
+}
+
 static void *control_thread(void *arg)
 {
     int ret = 0;
@@ -617,7 +1223,7 @@ static void *control_thread(void *arg)
 
     for (;;) {
         struct message msg;
-        ret = av_thread_message_queue_recv(actx->ctl_in_queue, &msg, 0);
+        ret = recv_ctl_message(actx, &msg, 0);
         if (ret < 0) {
             if (ret != AVERROR_EXIT) {
                 LOG(actx, ERROR, "Unable to pull a message "
@@ -626,68 +1232,39 @@ static void *control_thread(void *arg)
             }
             break;
         }
-
-        enum msg_type type = msg.type;
-        TRACE(actx, "--- handling OP %s", sxpi_async_get_msg_type_string(type));
-
-        switch (type) {
-        case MSG_SEEK:
-            ret = op_seek(actx, &msg);
-            break;
-        case MSG_START:
-            // XXX: fetch info first?
-            if (!actx->playing)
-                ret = op_start(actx);
-            break;
-        case MSG_STOP:
-            if (actx->playing)
-                op_stop(actx);
-            break;
-        case MSG_INFO:
-            ret = op_info(actx, &msg);
-            break;
-        case MSG_SYNC:
-            break;
-        default:
-            av_assert0(0);
-        }
-
-        TRACE(actx, "<-- OP %s processed", sxpi_async_get_msg_type_string(type));
-
-        if (ret < 0) {
-            LOG(actx, ERROR, "Unable to honor %s message: %s",
-                sxpi_async_get_msg_type_string(type), av_err2str(ret));
-            sxpi_msg_free_data(&msg);
+        ret = process_ctl_message(actx, &msg);
+        if (ret < 0)
             break;
-        }
-
-        // Forward the message to the out queue now that it has been processed
-        // if it's a sync OP
-        if (type == MSG_INFO || type == MSG_SYNC) {
-            TRACE(actx, "forward %s to control out queue",
-                  sxpi_async_get_msg_type_string(type));
-            ret = av_thread_message_queue_send(actx->ctl_out_queue, &msg, 0);
-            if (ret < 0) {
-                // shouldn't happen
-                LOG(actx, ERROR, "Unable to forward %s message to the output async queue: %s",
-                    sxpi_async_get_msg_type_string(type), av_err2str(ret));
-                sxpi_msg_free_data(&msg);
-            }
-        }
     }
 
-    if (ret < 0) {
-        av_thread_message_queue_set_err_send(actx->ctl_in_queue, ret);
-        av_thread_message_queue_set_err_recv(actx->ctl_out_queue, ret);
-    }
-    TRACE(actx, "control thread ending");
-    op_stop(actx);
-
+    end_control(actx, ret);
     return NULL;
 }
 
+/* In pool mode, the control runs as a blocking task of the pool instead of a
+ * thread, woken up by send_ctl_message() */
+static enum workpool_status control_task_func(void *arg)
+{
+    struct async_context *actx = arg;
+    struct message msg;
+
+    int ret = recv_ctl_message(actx, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret == AVERROR(EAGAIN))
+        return WORKPOOL_TASK_IDLE;
+    if (ret >= 0)
+        ret = process_ctl_message(actx, &msg);
+    else if (ret != AVERROR_EXIT)
+        LOG(actx, ERROR, "Unable to pull a message "
+            "from the async queue: %s", av_err2str(ret));
+    if (ret >= 0)
+        return WORKPOOL_TASK_AGAIN;
+    end_control(actx, ret);
+    return WORKPOOL_TASK_DONE;
+}
+
 int sxpi_async_init(struct async_context *actx, void *log_ctx,
-               const char *filename, const struct sxplayer_opts *o)
+               const char *filename, const struct sxplayer_opts *o,
+               struct framepool *framepool, struct workpool *workpool)
 {
     int ret;
 
@@ -696,22 +1273,65 @@ int sxpi_async_init(struct async_context *actx, void *log_ctx,
     actx->log_ctx = log_ctx;
     actx->filename = filename;
     actx->o = o;
+    actx->framepool = framepool;
     actx->thread_stack_size = o->thread_stack_size;
     actx->request_seek = AV_NOPTS_VALUE;
+    actx->last_pop_time = AV_NOPTS_VALUE;
+    actx->fused = o->pipeline_layout == SXPLAYER_PIPELINE_FUSED;
+
+    /* The depth can only be changed below the capacity of the sink */
+    actx->prefetch = o->adaptive_prefetch || o->prefetch_duration > 0;
+    actx->max_sink_depth = actx->prefetch ? FFMAX(o->max_nb_prefetch, o->max_nb_sink) : o->max_nb_sink;
+    actx->min_sink_depth = o->max_nb_sink;
+    atomic_init(&actx->sink_depth, o->max_nb_sink);
+    atomic_init(&actx->frame_time, 0);
+
+    sxpi_membudget_init(&actx->pkt_budget,    o->max_packets_bytes);
+    sxpi_membudget_init(&actx->frames_budget, o->max_frames_bytes);
+    sxpi_membudget_init(&actx->sink_budget,   o->max_sink_bytes);
+
+    actx->pktindex = sxpi_pktindex_alloc(log_ctx);
+    if (!actx->pktindex)
+        return AVERROR(ENOMEM);
+
+    if (workpool) {
+        actx->workpool = sxpi_workpool_ref(workpool);
+        actx->demuxer_task  = sxpi_workpool_task_alloc(workpool, demuxer_task_func,  actx);
+        actx->decoder_task  = sxpi_workpool_task_alloc(workpool, decoder_task_func,  actx);
+        if (!actx->fused)
+            actx->filterer_task = sxpi_workpool_task_alloc(workpool, filterer_task_func, actx);
+        actx->control_task  = sxpi_workpool_task_alloc_blocking(workpool, control_task_func, actx);
+        if (!actx->demuxer_task || !actx->decoder_task || (!actx->fused && !actx->filterer_task) ||
+            !actx->control_task)
+            return AVERROR(ENOMEM);
+    }
+
+    if (o->index_cache_dir) {
+        ret = sxpi_sidecar_alloc(&actx->sidecar, log_ctx, o->index_cache_dir, filename);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (o->frame_cache_size) {
+        actx->framecache = sxpi_framecache_alloc(framepool, (int64_t)o->frame_cache_size << 20,
+                                                 o->use_pkt_duration);
+        if (!actx->framecache)
+            return AVERROR(ENOMEM);
+    }
 
     TRACE(actx, "alloc modules queues");
-    if ((ret = alloc_msg_queue(&actx->src_queue,    1))                 < 0 ||
-        (ret = alloc_msg_queue(&actx->pkt_queue,    o->max_nb_packets)) < 0 ||
-        (ret = alloc_msg_queue(&actx->frames_queue, o->max_nb_frames))  < 0 ||
-        (ret = alloc_msg_queue(&actx->sink_queue,   o->max_nb_sink))    < 0)
+    if ((ret = alloc_module_queue(&actx->src_queue,    1))                    < 0 ||
+        (ret = alloc_module_queue(&actx->pkt_queue,    o->max_nb_packets))    < 0 ||
+        (ret = alloc_module_queue(&actx->frames_queue, o->max_nb_frames))     < 0 ||
+        (ret = alloc_module_queue(&actx->sink_queue,   actx->max_sink_depth)) < 0)
         return ret;
 
     TRACE(actx, "allocate async queues");
-    if ((ret = alloc_msg_queue(&actx->ctl_in_queue,  5)) < 0 ||
-        (ret = alloc_msg_queue(&actx->ctl_out_queue, 5)) < 0)
+    if ((ret = alloc_msg_queue(&actx->ctl_in_queue, 5))     < 0 ||
+        (ret = alloc_module_queue(&actx->ctl_out_queue, 5)) < 0)
         return ret;
 
-    START_MODULE_THREAD(control);
+    START_MODULE(control);
     if (!actx->control_started)
         return AVERROR(ENOMEM); // XXX
 
@@ -721,13 +1341,14 @@ int sxpi_async_init(struct async_context *actx, void *log_ctx,
 const char *sxpi_async_get_msg_type_string(enum msg_type type)
 {
     static const char * const s[NB_MSG] = {
-        [MSG_FRAME]  = "frame",
-        [MSG_PACKET] = "packet",
-        [MSG_SEEK]   = "seek",
-        [MSG_INFO]   = "info",
-        [MSG_START]  = "start",
-        [MSG_STOP]   = "stop",
-        [MSG_SYNC]   = "sync",
+        [MSG_FRAME]   = "frame",
+        [MSG_PACKET]  = "packet",
+        [MSG_SEEK]    = "seek",
+        [MSG_INFO]    = "info",
+        [MSG_START]   = "start",
+        [MSG_STOP]    = "stop",
+        [MSG_SYNC]    = "sync",
+        [MSG_INFO_CB] = "info callback",
     };
     return s[type];
 }
@@ -735,19 +1356,21 @@ const char *sxpi_async_get_msg_type_string(enum msg_type type)
 static void control_quit(struct async_context *actx)
 {
     sxpi_async_stop(actx);
-    sync_control_thread(actx);
-    av_thread_message_queue_set_err_send(actx->ctl_in_queue,  AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->ctl_out_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->ctl_in_queue,  AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->ctl_out_queue, AVERROR_EXIT);
+    sync_control_thread(actx, AV_NOPTS_VALUE);
+    av_thread_message_queue_set_err_send(actx->ctl_in_queue, AVERROR_EXIT);
+    av_thread_message_queue_set_err_recv(actx->ctl_in_queue, AVERROR_EXIT);
+    sxpi_msgqueue_set_err_send(actx->ctl_out_queue, AVERROR_EXIT);
+    sxpi_msgqueue_set_err_recv(actx->ctl_out_queue, AVERROR_EXIT);
     av_thread_message_flush(actx->ctl_in_queue);
-    av_thread_message_flush(actx->ctl_out_queue);
-    JOIN_MODULE_THREAD(control);
+    sxpi_msgqueue_flush(actx->ctl_out_queue);
+    if (actx->control_task)
+        sxpi_workpool_task_wake(actx->control_task);
+    JOIN_MODULE(control);
 }
 
-int sxpi_sxpi_async_started(struct async_context *actx)
+int sxpi_sxpi_async_started(struct async_context *actx, int64_t deadline)
 {
-    int ret = sync_control_thread(actx);
+    int ret = sync_control_thread(actx, deadline);
     if (ret < 0)
         return ret;
     return actx->playing;
@@ -762,13 +1385,28 @@ void sxpi_async_free(struct async_context **actxp)
 
     control_quit(actx);
 
-    av_thread_message_queue_free(&actx->src_queue);
-    av_thread_message_queue_free(&actx->pkt_queue);
-    av_thread_message_queue_free(&actx->frames_queue);
-    av_thread_message_queue_free(&actx->sink_queue);
+    sxpi_msgqueue_free(&actx->src_queue);
+    sxpi_msgqueue_free(&actx->pkt_queue);
+    sxpi_msgqueue_free(&actx->frames_queue);
+    sxpi_msgqueue_free(&actx->sink_queue);
 
     av_thread_message_queue_free(&actx->ctl_in_queue);
-    av_thread_message_queue_free(&actx->ctl_out_queue);
+    sxpi_msgqueue_free(&actx->ctl_out_queue);
+
+    sxpi_workpool_task_free(&actx->demuxer_task);
+    sxpi_workpool_task_free(&actx->decoder_task);
+    sxpi_workpool_task_free(&actx->filterer_task);
+    sxpi_workpool_task_free(&actx->control_task);
+    sxpi_workpool_unref(&actx->workpool);
+
+    sxpi_framecache_free(&actx->framecache);
+    sxpi_pktindex_free(&actx->pktindex);
+    sxpi_sidecar_free(&actx->sidecar);
+
+    struct readyfd *readyfd = atomic_load(&actx->readyfd);
+    sxpi_readyfd_free(&readyfd);
+
+    sxpi_wakeup_destroy(&actx->filterer_wakeup);
 
     TRACE(actx, "free done");
 
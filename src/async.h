@@ -24,8 +24,11 @@
 #include <stdint.h>
 
 #include "sxplayer.h"
+#include "framepool.h"
+#include "mod_filtering.h"
 #include "opts.h"
 #include "msg.h"
+#include "workpool.h"
 
 const char *sxpi_async_get_msg_type_string(enum msg_type type);
 
@@ -33,20 +36,101 @@ void sxpi_msg_free_data(void *arg);
 
 struct async_context *sxpi_async_alloc_context(void);
 
+/*
+ * If workpool is not NULL, the modules run as tasks of this pool instead of
+ * having their own threads.
+ */
 int sxpi_async_init(struct async_context *actx, void *log_ctx,
-                    const char *filename, const struct sxplayer_opts *o);
+                    const char *filename, const struct sxplayer_opts *o,
+                    struct framepool *framepool, struct workpool *workpool);
+
+/*
+ * Deliver the frames to the callback from the filtering module instead of
+ * queuing them for sxpi_async_pop_frame(). Must be called before the first
+ * operation on the context.
+ */
+void sxpi_async_set_frame_cb(struct async_context *actx, filtering_frame_func cb, void *arg);
+
+/* Offer again the frame refused by the frame callback, from any thread */
+void sxpi_async_resume_frame_cb(struct async_context *actx);
+
+/*
+ * Get the file descriptor becoming readable when sxpi_async_pop_frame() may
+ * make progress, created on the first call.
+ */
+int sxpi_async_get_event_fd(struct async_context *actx);
+
+/* Get the stream timebase, only valid once the modules are initialized */
+AVRational sxpi_async_get_timebase(const struct async_context *actx);
 
 int sxpi_async_start(struct async_context *actx);
 
-int sxpi_async_fetch_info(struct async_context *actx, struct sxplayer_info *info);
+/*
+ * The functions taking a deadline wait at most until this absolute time
+ * (av_gettime_relative() reference), and return AVERROR(EAGAIN) if the
+ * operation could not complete in time. AV_NOPTS_VALUE disables the deadline.
+ */
+int sxpi_async_fetch_info(struct async_context *actx, struct sxplayer_info *info,
+                          int64_t deadline);
+
+/*
+ * Call the callback from the control thread once the info is available,
+ * without waiting for it.
+ */
+int sxpi_async_fetch_info_cb(struct async_context *actx, void *arg,
+                             sxplayer_info_callback_type callback);
+
+/*
+ * Request the info and the start of the modules without waiting for them, so
+ * the media is opened, probed and prerolled in the background.
+ */
+int sxpi_async_prepare(struct async_context *actx);
+
+/*
+ * Tell if moving from the frame at cur to the frame at target (stream time
+ * base unit) deserves a seek according to the packet index, or
+ * AVERROR(EAGAIN) if the index can not tell yet.
+ */
+int sxpi_async_index_should_seek(struct async_context *actx, int64_t cur, int64_t target);
+
+int64_t sxpi_async_index_snap_to_keyframe(struct async_context *actx, int64_t ts);
+
+/* See sxpi_pktindex_get_prev_keyframe() */
+int64_t sxpi_async_index_get_prev_keyframe(struct async_context *actx, int64_t ts);
+
+int sxpi_async_seek(struct async_context *actx, int64_t ts, enum seek_mode mode);
+
+int sxpi_async_sync_pending(const struct async_context *actx);
+
+int sxpi_async_pop_frame(struct async_context *actx, AVFrame **framep,
+                         int64_t deadline);
+
+/*
+ * Get a reference to the cached frame to display at the stream time ts, or
+ * NULL if the cache is disabled or has no such frame.
+ */
+AVFrame *sxpi_async_get_cached_frame(struct async_context *actx, int64_t ts);
+
+void sxpi_async_get_cache_stats(const struct async_context *actx, int64_t *nb_hits, int64_t *nb_misses);
+
+/*
+ * Get the time spent opening and probing the media (0 until it is opened), and
+ * whether probing the packets was skipped.
+ */
+void sxpi_async_get_open_stats(struct async_context *actx, int64_t *open_duration, int *fast_opened);
+
+/* Get the number of seeks dropped because a later seek was queued behind them */
+void sxpi_async_get_seek_stats(struct async_context *actx, int64_t *nb_superseded);
 
-int sxpi_async_seek(struct async_context *actx, int64_t ts);
+/* Get the number of frames the filterer is currently allowed to queue in the sink */
+int sxpi_async_get_sink_depth(struct async_context *actx);
 
-int sxpi_async_pop_frame(struct async_context *actx, AVFrame **framep);
+/* Get the bytes of the packets and frames currently held in the queues */
+int64_t sxpi_async_get_queued_bytes(struct async_context *actx);
 
 int sxpi_async_stop(struct async_context *actx);
 
-int sxpi_sxpi_async_started(struct async_context *actx);
+int sxpi_sxpi_async_started(struct async_context *actx, int64_t deadline);
 
 void sxpi_async_free(struct async_context **actxp);
 
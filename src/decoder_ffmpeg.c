@@ -189,7 +189,7 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
         const int draining = flush && pkt_consumed;
         int64_t next_pts = AV_NOPTS_VALUE;
         while (ret >= 0 || (draining && ret == AVERROR(EAGAIN))) {
-            AVFrame *dec_frame = av_frame_alloc();
+            AVFrame *dec_frame = sxpi_decoding_get_frame(ctx->decoding_ctx);
 
             if (!dec_frame)
                 return AVERROR(ENOMEM);
@@ -199,7 +199,7 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
                 LOG(ctx, ERROR, "Error receiving frame from %s decoder: %s",
                     av_get_media_type_string(avctx->codec_type),
                     av_err2str(ret));
-                    av_frame_free(&dec_frame);
+                sxpi_decoding_release_frame(ctx->decoding_ctx, &dec_frame);
                 return ret;
             }
 
@@ -220,11 +220,11 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
                 ret = sxpi_decoding_queue_frame(ctx->decoding_ctx, dec_frame);
                 if (ret < 0) {
                     TRACE(ctx, "Could not queue frame: %s", av_err2str(ret));
-                    av_frame_free(&dec_frame);
+                    sxpi_decoding_release_frame(ctx->decoding_ctx, &dec_frame);
                     return ret;
                 }
             } else {
-                av_frame_free(&dec_frame);
+                sxpi_decoding_release_frame(ctx->decoding_ctx, &dec_frame);
             }
         }
     }
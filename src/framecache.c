@@ -0,0 +1,229 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+
+#include "framecache.h"
+
+struct cache_entry {
+    AVFrame *frame;
+    int64_t next_ts;                        // ts of the following frame, AV_NOPTS_VALUE if unknown
+    int64_t last_use;
+    size_t size;
+};
+
+struct framecache {
+    struct framepool *pool;
+    struct framepool_cache pool_cache;
+    int use_pkt_duration;
+
+    struct cache_entry *entries;            // sorted by ascending frame ts
+    int nb_entries;
+    int nb_allocated;
+    size_t total_size;
+    size_t max_size;
+    int64_t use_clock;
+
+    int64_t prev_ts;                        // ts of the latest added frame, AV_NOPTS_VALUE after a break
+
+    int64_t nb_hits;
+    int64_t nb_misses;
+};
+
+struct framecache *sxpi_framecache_alloc(struct framepool *pool, int64_t max_size, int use_pkt_duration)
+{
+    struct framecache *fc = av_mallocz(sizeof(*fc));
+    if (!fc)
+        return NULL;
+    fc->pool = sxpi_framepool_ref(pool);
+    fc->max_size = max_size;
+    fc->use_pkt_duration = use_pkt_duration;
+    fc->prev_ts = AV_NOPTS_VALUE;
+    return fc;
+}
+
+static void remove_entry(struct framecache *fc, int idx)
+{
+    struct cache_entry *entry = &fc->entries[idx];
+    fc->total_size -= entry->size;
+    sxpi_framepool_release_frame(fc->pool, &entry->frame);
+    memmove(entry, entry + 1, (fc->nb_entries - idx - 1) * sizeof(*entry));
+    fc->nb_entries--;
+}
+
+void sxpi_framecache_free(struct framecache **fcp)
+{
+    struct framecache *fc = *fcp;
+    if (!fc)
+        return;
+    while (fc->nb_entries)
+        remove_entry(fc, fc->nb_entries - 1);
+    av_freep(&fc->entries);
+    if (fc->pool)
+        sxpi_framepool_flush_cache(fc->pool, &fc->pool_cache);
+    sxpi_framepool_unref(&fc->pool);
+    av_freep(fcp);
+}
+
+/* Index of the last entry with a ts lower or equal to ts, -1 if none */
+static int find_entry(const struct framecache *fc, int64_t ts)
+{
+    int lo = 0, hi = fc->nb_entries;
+    while (lo < hi) {
+        const int mid = (lo + hi) >> 1;
+        if (fc->entries[mid].frame->pts <= ts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+static size_t get_frame_size(const AVFrame *frame)
+{
+    size_t size = sizeof(*frame);
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
+    return size;
+}
+
+static void evict_lru(struct framecache *fc)
+{
+    int lru = 0;
+    for (int i = 1; i < fc->nb_entries; i++)
+        if (fc->entries[i].last_use < fc->entries[lru].last_use)
+            lru = i;
+    remove_entry(fc, lru);
+}
+
+int sxpi_framecache_add(struct framecache *fc, const AVFrame *frame)
+{
+    const int64_t prev_ts = fc->prev_ts;
+    fc->prev_ts = frame->pts;
+
+    if (frame->pts == AV_NOPTS_VALUE) {
+        fc->prev_ts = AV_NOPTS_VALUE;
+        return 0;
+    }
+
+    /* Hardware frames are backed by a limited set of surfaces owned by the
+     * decoder, retaining them could stall the decoding */
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    if (frame->hw_frames_ctx || (frame->width && desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)))
+        return 0;
+
+    /* Link the previous frame to this one */
+    if (prev_ts != AV_NOPTS_VALUE && prev_ts < frame->pts) {
+        const int prev_idx = find_entry(fc, prev_ts);
+        if (prev_idx >= 0 && fc->entries[prev_idx].frame->pts == prev_ts)
+            fc->entries[prev_idx].next_ts = frame->pts;
+    }
+
+    const int idx = find_entry(fc, frame->pts);
+    if (idx >= 0 && fc->entries[idx].frame->pts == frame->pts) {
+        fc->entries[idx].last_use = ++fc->use_clock;
+        return 0;
+    }
+
+    const size_t size = get_frame_size(frame);
+    if (size > fc->max_size)
+        return 0;
+
+    AVFrame *ref = sxpi_framepool_get_frame(fc->pool, &fc->pool_cache);
+    if (!ref)
+        return AVERROR(ENOMEM);
+    int ret = av_frame_ref(ref, frame);
+    if (ret < 0) {
+        sxpi_framepool_release_frame(fc->pool, &ref);
+        return ret;
+    }
+
+    while (fc->nb_entries && fc->total_size + size > fc->max_size)
+        evict_lru(fc);
+
+    if (fc->nb_entries == fc->nb_allocated) {
+        const int nb_allocated = fc->nb_allocated ? fc->nb_allocated * 2 : 16;
+        struct cache_entry *entries = av_realloc_array(fc->entries, nb_allocated, sizeof(*entries));
+        if (!entries) {
+            sxpi_framepool_release_frame(fc->pool, &ref);
+            return AVERROR(ENOMEM);
+        }
+        fc->entries = entries;
+        fc->nb_allocated = nb_allocated;
+    }
+
+    /* The eviction may have shifted the entries */
+    const int pos = find_entry(fc, frame->pts) + 1;
+    struct cache_entry *entry = &fc->entries[pos];
+    memmove(entry + 1, entry, (fc->nb_entries - pos) * sizeof(*entry));
+    entry->frame    = ref;
+    entry->next_ts  = AV_NOPTS_VALUE;
+    entry->last_use = ++fc->use_clock;
+    entry->size     = size;
+    fc->nb_entries++;
+    fc->total_size += size;
+    return 0;
+}
+
+void sxpi_framecache_break(struct framecache *fc)
+{
+    fc->prev_ts = AV_NOPTS_VALUE;
+}
+
+AVFrame *sxpi_framecache_get(struct framecache *fc, int64_t ts)
+{
+    const int idx = find_entry(fc, ts);
+    if (idx < 0)
+        goto miss;
+
+    struct cache_entry *entry = &fc->entries[idx];
+    int64_t end_ts = entry->next_ts;
+    if (end_ts == AV_NOPTS_VALUE && fc->use_pkt_duration && entry->frame->pkt_duration > 0)
+        end_ts = entry->frame->pts + entry->frame->pkt_duration;
+    if (end_ts == AV_NOPTS_VALUE || ts >= end_ts)
+        goto miss;
+
+    AVFrame *frame = sxpi_framepool_get_frame(fc->pool, &fc->pool_cache);
+    if (!frame || av_frame_ref(frame, entry->frame) < 0) {
+        sxpi_framepool_release_frame(fc->pool, &frame);
+        goto miss;
+    }
+    entry->last_use = ++fc->use_clock;
+    fc->nb_hits++;
+    return frame;
+
+miss:
+    fc->nb_misses++;
+    return NULL;
+}
+
+void sxpi_framecache_get_stats(const struct framecache *fc, int64_t *nb_hits, int64_t *nb_misses)
+{
+    *nb_hits   = fc->nb_hits;
+    *nb_misses = fc->nb_misses;
+}
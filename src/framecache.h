@@ -0,0 +1,53 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "framepool.h"
+
+/*
+ * Memory bounded LRU of the frames delivered by the pipeline, keyed by their
+ * timestamp (stream time base unit).
+ *
+ * Each entry also records the timestamp of the frame delivered right after it
+ * (if it was not separated by a seek), which tells the time range for which
+ * the entry is the correct frame to display.
+ *
+ * The cache is not thread safe.
+ */
+
+struct framecache;
+
+struct framecache *sxpi_framecache_alloc(struct framepool *pool, int64_t max_size, int use_pkt_duration);
+void sxpi_framecache_free(struct framecache **fcp);
+
+int sxpi_framecache_add(struct framecache *fc, const AVFrame *frame);
+void sxpi_framecache_break(struct framecache *fc);
+
+AVFrame *sxpi_framecache_get(struct framecache *fc, int64_t ts);
+
+void sxpi_framecache_get_stats(const struct framecache *fc, int64_t *nb_hits, int64_t *nb_misses);
+
+#endif
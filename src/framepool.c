@@ -0,0 +1,216 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include <libavutil/mem.h>
+
+#include "framepool.h"
+
+/*
+ * The released entries are pushed on shared lists with a CAS loop (safe from
+ * any thread), but they are never popped individually: consumers detach the
+ * whole list at once with an atomic exchange. This makes the lists immune to
+ * the ABA problem without requiring any tagged pointer.
+ *
+ * While pooled, the AVFrame containers are chained through their opaque
+ * field, which is reset by av_frame_unref() anyway.
+ */
+
+struct pooled_frame {
+    struct sxplayer_frame pub;              // must be first
+    struct pooled_frame *next;
+    struct framepool *pool;
+};
+
+struct framepool {
+    atomic_int refcount;
+    _Atomic(AVFrame *) frames;
+    _Atomic(struct pooled_frame *) wrappers;
+    atomic_llong nb_frame_allocs;
+    atomic_llong nb_wrapper_allocs;
+    atomic_llong nb_pool_reuses;
+};
+
+struct framepool *sxpi_framepool_alloc(void)
+{
+    struct framepool *pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    atomic_init(&pool->refcount, 1);
+    atomic_init(&pool->frames, NULL);
+    atomic_init(&pool->wrappers, NULL);
+    atomic_init(&pool->nb_frame_allocs, 0);
+    atomic_init(&pool->nb_wrapper_allocs, 0);
+    atomic_init(&pool->nb_pool_reuses, 0);
+    return pool;
+}
+
+struct framepool *sxpi_framepool_ref(struct framepool *pool)
+{
+    if (pool)
+        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    return pool;
+}
+
+static void free_frames(AVFrame *frame)
+{
+    while (frame) {
+        AVFrame *next = frame->opaque;
+        av_frame_free(&frame);
+        frame = next;
+    }
+}
+
+static void free_wrappers(struct pooled_frame *wrapper)
+{
+    while (wrapper) {
+        struct pooled_frame *next = wrapper->next;
+        av_free(wrapper);
+        wrapper = next;
+    }
+}
+
+void sxpi_framepool_unref(struct framepool **poolp)
+{
+    struct framepool *pool = *poolp;
+    if (!pool)
+        return;
+    *poolp = NULL;
+    if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) != 1)
+        return;
+    free_frames(atomic_load_explicit(&pool->frames, memory_order_acquire));
+    free_wrappers(atomic_load_explicit(&pool->wrappers, memory_order_acquire));
+    av_free(pool);
+}
+
+static void push_frames(struct framepool *pool, AVFrame *first, AVFrame *last)
+{
+    AVFrame *head = atomic_load_explicit(&pool->frames, memory_order_relaxed);
+    do {
+        last->opaque = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->frames, &head, first,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+static void push_wrappers(struct framepool *pool, struct pooled_frame *first, struct pooled_frame *last)
+{
+    struct pooled_frame *head = atomic_load_explicit(&pool->wrappers, memory_order_relaxed);
+    do {
+        last->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->wrappers, &head, first,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+AVFrame *sxpi_framepool_get_frame(struct framepool *pool, struct framepool_cache *cache)
+{
+    if (!pool)
+        return av_frame_alloc();
+
+    if (!cache->frames)
+        cache->frames = atomic_exchange_explicit(&pool->frames, NULL, memory_order_acquire);
+
+    AVFrame *frame = cache->frames;
+    if (frame) {
+        cache->frames = frame->opaque;
+        frame->opaque = NULL;
+        atomic_fetch_add_explicit(&pool->nb_pool_reuses, 1, memory_order_relaxed);
+        return frame;
+    }
+
+    atomic_fetch_add_explicit(&pool->nb_frame_allocs, 1, memory_order_relaxed);
+    return av_frame_alloc();
+}
+
+void sxpi_framepool_release_frame(struct framepool *pool, AVFrame **framep)
+{
+    AVFrame *frame = *framep;
+    if (!frame)
+        return;
+    *framep = NULL;
+    if (!pool) {
+        av_frame_free(&frame);
+        return;
+    }
+    av_frame_unref(frame);
+    push_frames(pool, frame, frame);
+}
+
+struct sxplayer_frame *sxpi_framepool_get_wrapper(struct framepool *pool, struct framepool_cache *cache)
+{
+    if (!cache->wrappers)
+        cache->wrappers = atomic_exchange_explicit(&pool->wrappers, NULL, memory_order_acquire);
+
+    struct pooled_frame *wrapper = cache->wrappers;
+    if (wrapper) {
+        cache->wrappers = wrapper->next;
+        memset(wrapper, 0, sizeof(*wrapper));
+        atomic_fetch_add_explicit(&pool->nb_pool_reuses, 1, memory_order_relaxed);
+    } else {
+        wrapper = av_mallocz(sizeof(*wrapper));
+        if (!wrapper)
+            return NULL;
+        atomic_fetch_add_explicit(&pool->nb_wrapper_allocs, 1, memory_order_relaxed);
+    }
+
+    /* Every wrapper holds a reference to the pool since it may be released
+     * by the user after the destruction of the player context */
+    wrapper->pool = sxpi_framepool_ref(pool);
+    return &wrapper->pub;
+}
+
+void sxpi_framepool_release_wrapper(struct sxplayer_frame *frame)
+{
+    struct pooled_frame *wrapper = (struct pooled_frame *)frame;
+    struct framepool *pool = wrapper->pool;
+    AVFrame *avframe = frame->internal;
+
+    sxpi_framepool_release_frame(pool, &avframe);
+    push_wrappers(pool, wrapper, wrapper);
+    sxpi_framepool_unref(&pool);
+}
+
+void sxpi_framepool_flush_cache(struct framepool *pool, struct framepool_cache *cache)
+{
+    if (cache->frames) {
+        AVFrame *last = cache->frames;
+        while (last->opaque)
+            last = last->opaque;
+        push_frames(pool, cache->frames, last);
+        cache->frames = NULL;
+    }
+    if (cache->wrappers) {
+        struct pooled_frame *last = cache->wrappers;
+        while (last->next)
+            last = last->next;
+        push_wrappers(pool, cache->wrappers, last);
+        cache->wrappers = NULL;
+    }
+}
+
+void sxpi_framepool_get_stats(struct framepool *pool, struct sxplayer_stats *stats)
+{
+    stats->nb_frame_allocs   = atomic_load_explicit(&pool->nb_frame_allocs,   memory_order_relaxed);
+    stats->nb_wrapper_allocs = atomic_load_explicit(&pool->nb_wrapper_allocs, memory_order_relaxed);
+    stats->nb_pool_reuses    = atomic_load_explicit(&pool->nb_pool_reuses,    memory_order_relaxed);
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <libavutil/frame.h>
+
+#include "sxplayer.h"
+
+/*
+ * Recycling pool for the AVFrame containers circulating in the pipeline and
+ * the user frame wrappers.
+ *
+ * Releasing into the pool can be done from any thread. Getting from the pool
+ * requires a cache owned by the calling module: each module grabs all the
+ * released entries at once into its cache, and serves its requests from it.
+ */
+
+struct framepool;
+struct pooled_frame;
+
+struct framepool_cache {
+    AVFrame *frames;
+    struct pooled_frame *wrappers;
+};
+
+struct framepool *sxpi_framepool_alloc(void);
+struct framepool *sxpi_framepool_ref(struct framepool *pool);
+void sxpi_framepool_unref(struct framepool **poolp);
+
+AVFrame *sxpi_framepool_get_frame(struct framepool *pool, struct framepool_cache *cache);
+void sxpi_framepool_release_frame(struct framepool *pool, AVFrame **framep);
+
+struct sxplayer_frame *sxpi_framepool_get_wrapper(struct framepool *pool, struct framepool_cache *cache);
+void sxpi_framepool_release_wrapper(struct sxplayer_frame *frame);
+
+void sxpi_framepool_flush_cache(struct framepool *pool, struct framepool_cache *cache);
+
+void sxpi_framepool_get_stats(struct framepool *pool, struct sxplayer_stats *stats);
+
+#endif
@@ -22,6 +22,7 @@
 #define SXPLAYER_INTERNAL_H
 
 #include <stdio.h>
+#include <sys/stat.h>
 #include <libavcodec/version.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/rational.h>
@@ -40,6 +41,11 @@
 #define HAVE_VAAPI_HWACCEL 0
 #endif
 
+/* The MSVC runtime does not define the file type test macros */
+#ifndef S_ISREG
+#define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#endif
+
 enum AVPixelFormat sxpi_pix_fmts_sx2ff(enum sxplayer_pixel_format pix_fmt);
 enum sxplayer_pixel_format sxpi_pix_fmts_ff2sx(enum AVPixelFormat pix_fmt);
 enum sxplayer_pixel_format sxpi_smp_fmts_ff2sx(enum AVSampleFormat smp_fmt);
@@ -51,4 +57,25 @@ void sxpi_update_dimensions(int *width, int *height, int max_pixels);
 
 #define SXPI_STATIC_ASSERT(id, c) typedef char sxpi_checking_##id[(c) ? 1 : -1]
 
+/*
+ * Header of the motion vectors grid buffer attached to the frames (through
+ * their opaque_ref) by the filtering module. The dx and dy planes follow the
+ * header at the specified offsets.
+ */
+struct sxpi_mvs_grid {
+    int width;          // number of macroblock columns
+    int height;         // number of macroblock rows
+    int dx_offset;      // offset in bytes of the dx plane from the header
+    int dy_offset;      // offset in bytes of the dy plane from the header
+};
+
+#define SXPI_MVS_GRID_BLOCK_SIZE 16
+
+/*
+ * Metadata key set by the decoding module on the frames following frames it
+ * dropped (because of the playback rate or a progressive seek): they must not
+ * be considered as the successor of the frame delivered before them.
+ */
+#define SXPI_FRAME_GAP_KEY "sxplayer.gap"
+
 #endif
@@ -0,0 +1,127 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <libavutil/error.h>
+
+#include "membudget.h"
+#include "pthread_compat.h"
+
+static struct membudget global_budget;
+
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int nb_waiters;
+
+void sxpi_membudget_init(struct membudget *b, int64_t limit)
+{
+    b->parent = &global_budget;
+    atomic_init(&b->limit, limit);
+    atomic_init(&b->used, 0);
+}
+
+static int exceeds(const struct membudget *b, int64_t used)
+{
+    const int64_t limit = atomic_load_explicit(&b->limit, memory_order_relaxed);
+    return limit && used > limit;
+}
+
+/* The bytes are added before checking the limit, so concurrent charges can
+ * not overcommit the budget together (at worst, they both fail) */
+static int charge(struct membudget *b, int64_t size, int force)
+{
+    const int64_t used = atomic_fetch_add_explicit(&b->used, size, memory_order_relaxed) + size;
+    if (!force && exceeds(b, used)) {
+        atomic_fetch_sub_explicit(&b->used, size, memory_order_relaxed);
+        return AVERROR(EAGAIN);
+    }
+    return 0;
+}
+
+int sxpi_membudget_charge(struct membudget *b, int64_t size, int force)
+{
+    int ret = charge(b, size, force);
+    if (ret < 0 || !b->parent)
+        return ret;
+    ret = charge(b->parent, size, force);
+    if (ret < 0)
+        atomic_fetch_sub_explicit(&b->used, size, memory_order_relaxed);
+    return ret;
+}
+
+int sxpi_membudget_fits(const struct membudget *b, int64_t size)
+{
+    for (; b; b = b->parent)
+        if (exceeds(b, atomic_load_explicit(&b->used, memory_order_relaxed) + size))
+            return 0;
+    return 1;
+}
+
+int sxpi_membudget_charge_wait(struct membudget *b, int64_t size, int (*get_err)(void *arg), void *arg)
+{
+    int ret = sxpi_membudget_charge(b, size, !sxpi_membudget_get_used(b));
+    if (ret >= 0)
+        return ret;
+
+    /* Registered as a waiter before charging again, so a release made in
+     * between either is seen by the charge or signals the condition */
+    pthread_mutex_lock(&wait_lock);
+    atomic_fetch_add(&nb_waiters, 1);
+    for (;;) {
+        atomic_thread_fence(memory_order_seq_cst);
+        ret = sxpi_membudget_charge(b, size, !sxpi_membudget_get_used(b));
+        if (ret >= 0)
+            break;
+        ret = get_err(arg);
+        if (ret)
+            break;
+        pthread_cond_wait(&wait_cond, &wait_lock);
+    }
+    atomic_fetch_sub(&nb_waiters, 1);
+    pthread_mutex_unlock(&wait_lock);
+    return ret;
+}
+
+void sxpi_membudget_release(struct membudget *b, int64_t size)
+{
+    for (; b; b = b->parent)
+        atomic_fetch_sub_explicit(&b->used, size, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&nb_waiters, memory_order_relaxed))
+        sxpi_membudget_wake();
+}
+
+void sxpi_membudget_wake(void)
+{
+    pthread_mutex_lock(&wait_lock);
+    pthread_cond_broadcast(&wait_cond);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+int64_t sxpi_membudget_get_used(const struct membudget *b)
+{
+    return atomic_load_explicit(&b->used, memory_order_relaxed);
+}
+
+void sxpi_membudget_set_global_limit(int64_t limit)
+{
+    atomic_store_explicit(&global_budget.limit, limit, memory_order_relaxed);
+    sxpi_membudget_wake();
+}
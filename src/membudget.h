@@ -0,0 +1,75 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Accounting of the bytes held by a pipeline queue. Every charge is also
+ * made against a process-wide budget shared by all the contexts (see
+ * sxplayer_set_memory_budget()), so a charge fails when either of them is
+ * exhausted.
+ *
+ * The budgets are soft: a charge can always be forced, which the queues do
+ * when they are empty so that each stage keeps making progress whatever the
+ * other contexts hold.
+ *
+ * The charges waiting for bytes to be released share a single process-wide
+ * condition, since a release in any context may be what they wait for. It is
+ * only signaled while somebody waits.
+ */
+
+struct membudget {
+    struct membudget *parent;               // process-wide budget, NULL for the process-wide budget itself
+    atomic_llong limit;                     // maximum number of bytes, 0 for unlimited
+    atomic_llong used;
+};
+
+void sxpi_membudget_init(struct membudget *b, int64_t limit);
+
+/* Return 0 if the bytes are charged, or AVERROR(EAGAIN) if they exceed the budget */
+int sxpi_membudget_charge(struct membudget *b, int64_t size, int force);
+
+/* Same as sxpi_membudget_charge() without charging the bytes */
+int sxpi_membudget_fits(const struct membudget *b, int64_t size);
+
+/*
+ * Charge the bytes, waiting for enough of them to be released while they
+ * exceed the budget. The charge is forced when nothing is charged to the
+ * budget. Before each wait, get_err(arg) is called: a non-zero value aborts
+ * the wait and is returned, and it must be followed by a call to
+ * sxpi_membudget_wake(). Return 0 if the bytes are charged.
+ */
+int sxpi_membudget_charge_wait(struct membudget *b, int64_t size, int (*get_err)(void *arg), void *arg);
+
+void sxpi_membudget_release(struct membudget *b, int64_t size);
+
+/* Wake up every charge waiting, so they check their error again */
+void sxpi_membudget_wake(void);
+
+int64_t sxpi_membudget_get_used(const struct membudget *b);
+
+void sxpi_membudget_set_global_limit(int64_t limit);
+
+#endif
@@ -18,6 +18,9 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+#include <stdatomic.h>
+
 #include <libavutil/pixdesc.h>
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
@@ -27,6 +30,7 @@
 #include "internal.h"
 #include "msg.h"
 #include "log.h"
+#include "pthread_compat.h"
 
 extern const struct decoder sxpi_decoder_ffmpeg_sw;
 extern const struct decoder sxpi_decoder_ffmpeg_hw;
@@ -41,18 +45,57 @@ static const struct decoder *decoder_def_hwaccel = &sxpi_decoder_ffmpeg_hw;
 
 struct decoding_ctx {
     void *log_ctx;
+    const struct sxplayer_opts *opts;
 
-    AVThreadMessageQueue *pkt_queue;
-    AVThreadMessageQueue *frames_queue;
+    struct msgqueue *pkt_queue;
+    struct msgqueue *frames_queue;
 
     int is_image;
     int frame_count;
 
     struct decoder_ctx *decoder;
 
+    struct framepool *framepool;
+    struct framepool_cache framepool_cache;
+
     AVRational st_timebase;
+    int64_t frame_duration;                 // nominal frame duration (stream time base), 0 if unknown
+    double nominal_duration;                // same as frame_duration, without rounding
     AVFrame *tmp_frame;
     int64_t seek_request;
+    int seek_placeholder;                   // the first frame of the seek is to be delivered right away
+    int placeholder_sent;                   // the first frame of the seek was delivered ahead of the requested one
+    int gap;                                // frames were dropped since the last queued frame
+    int keep_next;                          // the next frame is the one requested, it can not be dropped
+    struct membudget *budget;               // bytes budget of the frames queue, NULL if unbounded
+
+    /* Schedule of the frames kept above the nominal playback rate */
+    double rate;                            // playback rate the schedule is computed for
+    int64_t rate_anchor;                    // ts of the first frame of the schedule, AV_NOPTS_VALUE if none
+    int64_t rate_nb_steps;                  // index of the next frame to keep in the schedule
+    atomic_llong rate_skip_ts;              // frames before this ts are dropped, AV_NOPTS_VALUE if none
+
+    const atomic_int *seek_gen;             // generation of the latest seek requested, NULL if unknown
+    int gen;                                // generation of the latest seek received
+
+    int running;
+    int ending;                             // the decoder is flushed, waiting for the pending messages to be sent
+    int end_ret;
+    int send_flags;
+
+    /* Messages the frames queue could not accept yet in non-blocking mode,
+     * as many as the queue holds at most. Frames may be queued from a decoder
+     * thread (VideoToolbox), hence the lock. */
+    pthread_mutex_t pending_lock;
+    struct message *pending;
+    int nb_pending;
+    int max_pending;
+
+    void (*wake_cb)(void *arg);
+    void *wake_arg;
+
+    decoding_msg_func msg_cb;               // NULL to send the messages to the frames queue
+    void *msg_arg;
 };
 
 struct decoding_ctx *sxpi_decoding_alloc(void)
@@ -65,6 +108,8 @@ struct decoding_ctx *sxpi_decoding_alloc(void)
         av_freep(&ctx);
         return NULL;
     }
+    pthread_mutex_init(&ctx->pending_lock, NULL);
+    atomic_init(&ctx->rate_skip_ts, AV_NOPTS_VALUE);
     return ctx;
 }
 
@@ -73,12 +118,43 @@ const AVCodecContext *sxpi_decoding_get_avctx(struct decoding_ctx *ctx)
     return ctx->decoder->avctx;
 }
 
+void sxpi_decoding_set_wake_cb(struct decoding_ctx *ctx, void (*wake_cb)(void *arg), void *arg)
+{
+    ctx->wake_cb  = wake_cb;
+    ctx->wake_arg = arg;
+}
+
+void sxpi_decoding_set_msg_cb(struct decoding_ctx *ctx, decoding_msg_func cb, void *arg)
+{
+    ctx->msg_cb  = cb;
+    ctx->msg_arg = arg;
+}
+
+void sxpi_decoding_set_seek_gen(struct decoding_ctx *ctx, const atomic_int *seek_gen)
+{
+    ctx->seek_gen = seek_gen;
+}
+
+void sxpi_decoding_set_budget(struct decoding_ctx *ctx, struct membudget *budget)
+{
+    ctx->budget = budget;
+}
+
+/* A seek was requested after the latest one received: the packets and frames
+ * to come until then, including the ones catching up with the previous seek,
+ * are obsolete */
+static int is_stale(const struct decoding_ctx *ctx)
+{
+    return ctx->seek_gen && atomic_load_explicit(ctx->seek_gen, memory_order_relaxed) != ctx->gen;
+}
+
 int sxpi_decoding_init(void *log_ctx,
                        struct decoding_ctx *ctx,
-                       AVThreadMessageQueue *pkt_queue,
-                       AVThreadMessageQueue *frames_queue,
+                       struct msgqueue *pkt_queue,
+                       struct msgqueue *frames_queue,
                        int is_image,
                        const AVStream *stream,
+                       struct framepool *framepool,
                        const struct sxplayer_opts *opts)
 {
     int ret;
@@ -88,10 +164,19 @@ int sxpi_decoding_init(void *log_ctx,
     if (!par)
         return AVERROR(ENOMEM);
 
+    ctx->max_pending = opts->max_nb_frames;
+    ctx->pending = av_malloc_array(ctx->max_pending, sizeof(*ctx->pending));
+    if (!ctx->pending) {
+        avcodec_parameters_free(&par);
+        return AVERROR(ENOMEM);
+    }
+
     ctx->log_ctx = log_ctx;
+    ctx->opts = opts;
     ctx->pkt_queue = pkt_queue;
     ctx->frames_queue = frames_queue;
     ctx->is_image = is_image;
+    ctx->framepool = sxpi_framepool_ref(framepool);
 
     if (opts->auto_hwaccel && decoder_def_hwaccel) {
         dec_def          = decoder_def_hwaccel;
@@ -102,6 +187,10 @@ int sxpi_decoding_init(void *log_ctx,
     }
 
     ctx->st_timebase = stream->time_base;
+    if (stream->avg_frame_rate.num && stream->avg_frame_rate.den) {
+        ctx->frame_duration = av_rescale_q(1, av_inv_q(stream->avg_frame_rate), ctx->st_timebase);
+        ctx->nominal_duration = 1. / (av_q2d(stream->avg_frame_rate) * av_q2d(ctx->st_timebase));
+    }
 
 #define DUMP_INFO(par, name) do {                                       \
     if ((par)->codec_type == AVMEDIA_TYPE_AUDIO) {                      \
@@ -146,30 +235,214 @@ int sxpi_decoding_init(void *log_ctx,
     return 0;
 }
 
+AVFrame *sxpi_decoding_get_frame(struct decoding_ctx *ctx)
+{
+    return sxpi_framepool_get_frame(ctx->framepool, &ctx->framepool_cache);
+}
+
+void sxpi_decoding_release_frame(struct decoding_ctx *ctx, AVFrame **framep)
+{
+    sxpi_framepool_release_frame(ctx->framepool, framep);
+}
+
 static int64_t get_best_effort_ts(const AVFrame *f)
 {
     const int64_t t = f->best_effort_timestamp;
     return t != AV_NOPTS_VALUE ? t : f->pts;
 }
 
+static void drop_pending(struct decoding_ctx *ctx)
+{
+    for (int i = 0; i < ctx->nb_pending; i++)
+        sxpi_msg_free_data(&ctx->pending[i]);
+    ctx->nb_pending = 0;
+}
+
+/* Hand a message over to the frames queue, or to the message callback. In the
+ * latter case, the frames queue carries no message but still reports the end
+ * of the next stage. */
+static int deliver_message(struct decoding_ctx *ctx, struct message *msg, int flags)
+{
+    if (!ctx->msg_cb)
+        return sxpi_msg_send(ctx->frames_queue, ctx->budget, msg, flags);
+
+    int ret = sxpi_msgqueue_get_err_send(ctx->frames_queue);
+    if (ret < 0)
+        return ret;
+    ret = ctx->msg_cb(ctx->msg_arg, msg, flags);
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        const int err = sxpi_msgqueue_get_err_send(ctx->frames_queue);
+        if (err < 0)
+            ret = err;
+    }
+    return ret;
+}
+
+/* Send a message to the frames queue. In non-blocking mode, the message is
+ * kept for later if the queue is full, or if older messages are still waiting
+ * to be sent (to preserve their order). Once as many messages as the queue
+ * holds are kept, the consumer stalled: the oldest one is sent in blocking
+ * mode, so the frames held outside of the queue stay bounded. */
+static int send_message(struct decoding_ctx *ctx, struct message *msg)
+{
+    if (!ctx->send_flags)
+        return deliver_message(ctx, msg, 0);
+
+    pthread_mutex_lock(&ctx->pending_lock);
+    int ret = ctx->nb_pending ? AVERROR(EAGAIN)
+                              : deliver_message(ctx, msg, ctx->send_flags);
+    if (ret == AVERROR(EAGAIN) && ctx->nb_pending == ctx->max_pending) {
+        TRACE(ctx, "%d messages pending, wait for the frames queue", ctx->nb_pending);
+        ret = deliver_message(ctx, &ctx->pending[0], 0);
+        if (ret >= 0) {
+            ctx->nb_pending--;
+            memmove(ctx->pending, ctx->pending + 1, ctx->nb_pending * sizeof(*ctx->pending));
+            ret = AVERROR(EAGAIN);
+        }
+    }
+    if (ret == AVERROR(EAGAIN)) {
+        ctx->pending[ctx->nb_pending++] = *msg;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ctx->pending_lock);
+
+    if (ret >= 0 && ctx->wake_cb)
+        ctx->wake_cb(ctx->wake_arg);
+    return ret;
+}
+
+/* Send as many pending messages as the frames queue accepts. Returns the
+ * number of messages sent, or AVERROR(EAGAIN) if none could be sent while
+ * some remain. */
+static int send_pending(struct decoding_ctx *ctx)
+{
+    int ret = 0, nb_sent = 0;
+
+    pthread_mutex_lock(&ctx->pending_lock);
+    while (nb_sent < ctx->nb_pending) {
+        ret = deliver_message(ctx, &ctx->pending[nb_sent], ctx->send_flags);
+        if (ret < 0)
+            break;
+        nb_sent++;
+    }
+    if (nb_sent) {
+        ctx->nb_pending -= nb_sent;
+        memmove(ctx->pending, ctx->pending + nb_sent, ctx->nb_pending * sizeof(*ctx->pending));
+    }
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+            LOG(ctx, ERROR, "Unable to push frame: %s", av_err2str(ret));
+        sxpi_msgqueue_set_err_recv(ctx->frames_queue, ret);
+        drop_pending(ctx);
+    }
+    pthread_mutex_unlock(&ctx->pending_lock);
+
+    if (ret == AVERROR(EAGAIN) && nb_sent)
+        ret = 0;
+    return ret < 0 ? ret : nb_sent;
+}
+
+static void reset_rate_schedule(struct decoding_ctx *ctx)
+{
+    ctx->rate_anchor = AV_NOPTS_VALUE;
+    atomic_store_explicit(&ctx->rate_skip_ts, AV_NOPTS_VALUE, memory_order_relaxed);
+}
+
+/*
+ * Above the nominal playback rate, the consumer presents one frame per
+ * display refresh (the media frame rate when display_rate is not set), during
+ * which playback_rate refresh intervals of media elapse. The kept frames
+ * follow a schedule anchored on the first frame after a start or a seek,
+ * spaced by that media duration, and the others are dropped here, before
+ * reaching the filters. Nothing is dropped as long as the display is fast
+ * enough to present every frame. Return 1 if the frame must be dropped.
+ */
+static int drop_for_rate(struct decoding_ctx *ctx, const AVFrame *frame)
+{
+    const double rate = atomic_load_explicit(&ctx->opts->cur_playback_rate, memory_order_relaxed);
+    const double display_rate = ctx->opts->display_rate;
+    const double refresh = display_rate > 0. ? 1. / (display_rate * av_q2d(ctx->st_timebase))
+                                             : ctx->nominal_duration;
+    const double step = rate * refresh;
+
+    if (rate <= 1. || ctx->is_image || ctx->opts->avselect != SXPLAYER_SELECT_VIDEO ||
+        ctx->nominal_duration <= 0. || step <= ctx->nominal_duration ||
+        frame->pts == AV_NOPTS_VALUE) {
+        if (ctx->rate_anchor != AV_NOPTS_VALUE)
+            reset_rate_schedule(ctx);
+        return 0;
+    }
+
+    const int64_t margin = ctx->frame_duration / 2;
+
+    if (ctx->rate_anchor != AV_NOPTS_VALUE && rate == ctx->rate) {
+        const int64_t next_ts = ctx->rate_anchor + llrint(ctx->rate_nb_steps * step);
+        if (frame->pts < next_ts - margin) {
+            ctx->gap = 1;
+            return 1;
+        }
+        /* Timestamps jumped way past the schedule, start a new one */
+        if (frame->pts - next_ts >= step)
+            ctx->rate_anchor = AV_NOPTS_VALUE;
+    }
+
+    if (ctx->rate_anchor == AV_NOPTS_VALUE || rate != ctx->rate) {
+        ctx->rate = rate;
+        ctx->rate_anchor = frame->pts;
+        ctx->rate_nb_steps = 0;
+    }
+
+    int64_t next_ts;
+    do {
+        next_ts = ctx->rate_anchor + llrint(++ctx->rate_nb_steps * step);
+    } while (next_ts - margin <= frame->pts);
+    atomic_store_explicit(&ctx->rate_skip_ts, next_ts - margin, memory_order_relaxed);
+    return 0;
+}
+
 static int queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
 {
     int ret;
     struct message msg = {
         .type = MSG_FRAME,
         .data = frame,
+        .pool = ctx->framepool,
     };
 
     if (ctx->is_image && ctx->frame_count++ > 0)
         return AVERROR_EOF;
 
+    if (drop_for_rate(ctx, frame)) {
+        TRACE(ctx, "drop frame with ts=%s, not presented at the playback rate",
+              av_ts2timestr(frame->pts, &ctx->st_timebase));
+        sxpi_decoding_release_frame(ctx, &frame);
+        return 0;
+    }
+
+    if (ctx->budget && !ctx->keep_next && ctx->opts->budget_policy == SXPLAYER_BUDGET_DROP &&
+        sxpi_membudget_get_used(ctx->budget) && !sxpi_membudget_fits(ctx->budget, sxpi_msg_get_size(&msg))) {
+        TRACE(ctx, "drop frame with ts=%s, memory budget exhausted",
+              av_ts2timestr(frame->pts, &ctx->st_timebase));
+        sxpi_decoding_release_frame(ctx, &frame);
+        ctx->gap = 1;
+        return 0;
+    }
+    ctx->keep_next = 0;
+
+    if (ctx->gap) {
+        ret = av_dict_set(&frame->metadata, SXPI_FRAME_GAP_KEY, "1", 0);
+        if (ret < 0)
+            return ret;
+        ctx->gap = 0;
+    }
+
     TRACE(ctx, "queue frame with ts=%s", av_ts2timestr(frame->pts, &ctx->st_timebase));
 
-    ret = av_thread_message_queue_send(ctx->frames_queue, &msg, 0);
+    ret = send_message(ctx, &msg);
     if (ret < 0) {
         if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
             LOG(ctx, ERROR, "Unable to push frame: %s", av_err2str(ret));
-        av_thread_message_queue_set_err_recv(ctx->frames_queue, ret);
+        sxpi_msgqueue_set_err_recv(ctx->frames_queue, ret);
     }
     return ret;
 }
@@ -184,7 +457,7 @@ static int queue_cached_frame(struct decoding_ctx *ctx)
     prev_frame->pts = cached_ts;
     ret = queue_frame(ctx, prev_frame);
     if (ret < 0) {
-        av_frame_free(&prev_frame);
+        sxpi_decoding_release_frame(ctx, &prev_frame);
         return ret;
     }
     return 0;
@@ -207,26 +480,51 @@ int sxpi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
     const int64_t ts = get_best_effort_ts(frame);
     TRACE(ctx, "processing frame with ts=%s", av_ts2timestr(ts, &ctx->st_timebase));
 
+    if (is_stale(ctx)) {
+        TRACE(ctx, "drop obsolete frame");
+        sxpi_decoding_release_frame(ctx, &frame);
+        return 0;
+    }
+
+    if (ctx->seek_request != AV_NOPTS_VALUE && ts < ctx->seek_request && ctx->seek_placeholder) {
+        TRACE(ctx, "frame ts:%s (%"PRId64") landed on, push it as a placeholder for %s",
+              av_ts2timestr(ts, &ctx->st_timebase), ts,
+              av_ts2timestr(ctx->seek_request, &ctx->st_timebase));
+        ctx->seek_placeholder = 0;
+        ctx->placeholder_sent = 1;
+        frame->pts = ts;
+        return queue_frame(ctx, frame);
+    }
+
     if (ctx->seek_request != AV_NOPTS_VALUE && ts < ctx->seek_request) {
         TRACE(ctx, "frame ts:%s (%"PRId64"), skipping because before %s (%"PRId64")",
               av_ts2timestr(ts, &ctx->st_timebase), ts,
               av_ts2timestr(ctx->seek_request, &ctx->st_timebase), ctx->seek_request);
-        av_frame_free(&ctx->tmp_frame);
+        sxpi_decoding_release_frame(ctx, &ctx->tmp_frame);
         ctx->tmp_frame = frame;
         return 0;
     }
 
     frame->pts = ts;
 
+    /* The frames between the placeholder and the requested one were dropped,
+     * and the requested frame must not be dropped because of the placeholder
+     * anchoring the playback rate schedule */
+    if (ctx->placeholder_sent) {
+        reset_rate_schedule(ctx);
+        ctx->gap = 1;
+        ctx->keep_next = 1;
+    }
+
     if (ctx->tmp_frame) {
         if (ctx->seek_request != AV_NOPTS_VALUE && ts == ctx->seek_request) {
-            av_frame_free(&ctx->tmp_frame);
+            sxpi_decoding_release_frame(ctx, &ctx->tmp_frame);
         } else {
             ret = queue_cached_frame(ctx);
             if (ret < 0)
                 return ret;
         }
-    } else {
+    } else if (!ctx->placeholder_sent) {
         if (ctx->seek_request != AV_NOPTS_VALUE && ctx->seek_request > 0 && frame->pts > ctx->seek_request) {
             TRACE(ctx, "first frame obtained is after requested time, fixup its ts from %s to %s",
                   av_ts2timestr(frame->pts, &ctx->st_timebase),
@@ -236,71 +534,95 @@ int sxpi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
     }
 
     ctx->seek_request = AV_NOPTS_VALUE;
+    ctx->seek_placeholder = 0;
+    ctx->placeholder_sent = 0;
     return queue_frame(ctx, frame);
 }
 
-void sxpi_decoding_run(struct decoding_ctx *ctx)
+/*
+ * While catching up with a seek request, the frames before the requested time
+ * are decoded only to be dropped. If allowed, we ask the decoder to skip the
+ * non reference ones among them, since no other frame depends on them. The
+ * last frame before the requested time must still be decoded because it is
+ * the one returned when the requested time falls in between 2 frames, so we
+ * keep a safety margin of one frame.
+ *
+ * Similarly, above the nominal playback rate, the non reference frames placed
+ * before the next frame of the schedule are skipped: they would be dropped
+ * right after being decoded.
+ */
+static void update_skip_frame(struct decoding_ctx *ctx, const AVPacket *pkt)
 {
-    int ret;
-    int in_err, out_err;
-
-    TRACE(ctx, "decoding packets from %p into %p", ctx->pkt_queue, ctx->frames_queue);
-
-    ctx->seek_request = AV_NOPTS_VALUE;
-
-    for (;;) {
-        AVPacket *pkt;
-        struct message msg;
-
-        TRACE(ctx, "fetching a packet");
-        ret = av_thread_message_queue_recv(ctx->pkt_queue, &msg, 0);
-        if (ret < 0)
-            break;
-
-        if (msg.type == MSG_SEEK) {
-            const int64_t seek_ts = *(int64_t *)msg.data;
-
-            TRACE(ctx, "got a seek message (to %s) in the pkt queue",
-                  PTS2TIMESTR(seek_ts));
-
-            /* Make sure the decoder has no packet remaining to consume and
-             * pushed (or dropped) all its cached frames. After this flush, we
-             * can assume that the decoder will not called async_queue_frame()
-             * until a new packet is pushed. */
-            sxpi_decoder_flush(ctx->decoder);
+    AVCodecContext *avctx = ctx->decoder->avctx;
+    enum AVDiscard skip_frame = AVDISCARD_DEFAULT;
+
+    if (ctx->seek_request != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE &&
+        atomic_load_explicit(&ctx->opts->drop_ref, memory_order_relaxed)) {
+        const int64_t duration = pkt->duration > 0 ? pkt->duration : ctx->frame_duration;
+        if (duration > 0 && pkt->pts + 2 * duration <= ctx->seek_request)
+            skip_frame = AVDISCARD_NONREF;
+    }
 
-            av_frame_free(&ctx->tmp_frame);
+    const int64_t rate_skip_ts = atomic_load_explicit(&ctx->rate_skip_ts, memory_order_relaxed);
+    if (rate_skip_ts != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE && pkt->pts < rate_skip_ts &&
+        atomic_load_explicit(&ctx->opts->cur_playback_rate, memory_order_relaxed) > 1.)
+        skip_frame = AVDISCARD_NONREF;
 
-            /* Let's save some little time by dropping frames in the queue so
-             * the user don't get a shit ton of false positives before the
-             * frames he requested. */
-            av_thread_message_flush(ctx->frames_queue);
+    if (avctx->skip_frame != skip_frame) {
+        TRACE(ctx, "%s non reference frames from pts=%s",
+              skip_frame == AVDISCARD_NONREF ? "skip" : "stop skipping",
+              av_ts2timestr(pkt->pts, &ctx->st_timebase));
+        avctx->skip_frame = skip_frame;
+    }
+}
 
-            /* Mark the seek request so async_queue_frame() can do its
-             * "filtering" work. */
-            ctx->seek_request = av_rescale_q(seek_ts, AV_TIME_BASE_Q, ctx->st_timebase);
+static int finish_decoding(struct decoding_ctx *ctx)
+{
+    int in_err, out_err;
 
-            /* Forward seek message */
-            ret = av_thread_message_queue_send(ctx->frames_queue, &msg, 0);
-            if (ret < 0) {
-                sxpi_msg_free_data(&msg);
-                break;
-            }
+    /* The frames queue must only report the end once it received every
+     * frame */
+    int ret = send_pending(ctx);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0)
+        ctx->end_ret = ret;
+    else if (ctx->nb_pending) // no more concurrent queuing at this point
+        return 0;
+    ret = ctx->end_ret;
 
-            continue;
-        }
+    if (ret < 0 && ret != AVERROR_EOF) {
+        in_err = out_err = ret;
+    } else {
+        in_err = AVERROR_EXIT;
+        out_err = AVERROR_EOF;
+    }
+    TRACE(ctx, "notify demuxer with %s and frames queue with %s",
+          av_err2str(in_err), av_err2str(out_err));
+    sxpi_msg_set_err_send(ctx->pkt_queue, in_err);
+    sxpi_msgqueue_flush(ctx->pkt_queue);
+    sxpi_msgqueue_set_err_recv(ctx->frames_queue, out_err);
 
-        pkt = msg.data;
-        TRACE(ctx, "got a packet of size %d, push it to decoder", pkt->size);
-        ret = sxpi_decoder_push_packet(ctx->decoder, pkt);
-        av_packet_unref(pkt);
-        av_freep(&pkt);
-        if (ret < 0)
-            break;
+    /* The next stage running inline receives the end from the frames queue,
+     * unless it already ended by itself */
+    if (ctx->msg_cb && !sxpi_msgqueue_get_err_send(ctx->frames_queue)) {
+        do {
+            ret = ctx->msg_cb(ctx->msg_arg, NULL, ctx->send_flags);
+        } while (ret >= 0);
+        if (ret == AVERROR(EAGAIN))
+            return ret;
     }
 
+    ctx->running = 0;
+    ctx->ending = 0;
+    return AVERROR_EOF;
+}
+
+static int end_decoding(struct decoding_ctx *ctx, int ret)
+{
     /* Fetch remaining frames */
     if (ret == AVERROR_EOF) {
+        ctx->decoder->avctx->skip_frame = AVDISCARD_DEFAULT;
         TRACE(ctx, "flush cached frames");
         do {
             ret = sxpi_decoder_push_packet(ctx->decoder, NULL);
@@ -311,19 +633,120 @@ void sxpi_decoding_run(struct decoding_ctx *ctx)
      * queuing callback won't be called anymore */
     sxpi_decoder_flush(ctx->decoder);
 
-    av_frame_free(&ctx->tmp_frame);
+    sxpi_decoding_release_frame(ctx, &ctx->tmp_frame);
 
-    if (ret < 0 && ret != AVERROR_EOF) {
-        in_err = out_err = ret;
-    } else {
-        in_err = AVERROR_EXIT;
-        out_err = AVERROR_EOF;
+    ctx->end_ret = ret;
+    ctx->ending = 1;
+    ret = finish_decoding(ctx);
+    return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+int sxpi_decoding_step(struct decoding_ctx *ctx, int flags)
+{
+    int ret;
+    AVPacket *pkt;
+    struct message msg;
+
+    if (!ctx->running) {
+        TRACE(ctx, "decoding packets from %p into %p", ctx->pkt_queue, ctx->frames_queue);
+        ctx->seek_request = AV_NOPTS_VALUE;
+        ctx->seek_placeholder = 0;
+        ctx->placeholder_sent = 0;
+        ctx->gap = 0;
+        ctx->keep_next = 1;
+        reset_rate_schedule(ctx);
+        ctx->gen = ctx->seek_gen ? atomic_load(ctx->seek_gen) : 0;
+        ctx->send_flags = flags;
+        ctx->running = 1;
     }
-    TRACE(ctx, "notify demuxer with %s and frames queue with %s",
-          av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->pkt_queue,    in_err);
-    av_thread_message_flush(ctx->pkt_queue);
-    av_thread_message_queue_set_err_recv(ctx->frames_queue, out_err);
+
+    if (ctx->ending)
+        return finish_decoding(ctx);
+
+    ret = send_pending(ctx);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0)
+        return end_decoding(ctx, ret);
+    if (ret > 0)
+        return 0;
+
+    TRACE(ctx, "fetching a packet");
+    ret = sxpi_msg_recv(ctx->pkt_queue, &msg, flags);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0)
+        return end_decoding(ctx, ret);
+
+    if (msg.type == MSG_SEEK) {
+        const struct seek_request *req = msg.data;
+        const int64_t seek_ts = req->ts;
+
+        TRACE(ctx, "got a seek message (to %s) in the pkt queue",
+              PTS2TIMESTR(seek_ts));
+
+        /* Make sure the decoder has no packet remaining to consume and
+         * pushed (or dropped) all its cached frames. After this flush, we
+         * can assume that the decoder will not called async_queue_frame()
+         * until a new packet is pushed. */
+        sxpi_decoder_flush(ctx->decoder);
+
+        sxpi_decoding_release_frame(ctx, &ctx->tmp_frame);
+        reset_rate_schedule(ctx);
+        ctx->gap = 0;
+        ctx->keep_next = 1;
+
+        /* Let's save some little time by dropping frames in the queue so
+         * the user don't get a shit ton of false positives before the
+         * frames he requested. */
+        pthread_mutex_lock(&ctx->pending_lock);
+        drop_pending(ctx);
+        pthread_mutex_unlock(&ctx->pending_lock);
+        sxpi_msgqueue_flush(ctx->frames_queue);
+
+        /* Mark the seek request so async_queue_frame() can do its
+         * "filtering" work. In keyframe mode, every frame is kept, and
+         * so are the keyframes landed on in keyframes only mode. In
+         * progressive mode, the frame landed on is delivered before the
+         * filtering starts. */
+        if (req->mode != SEEK_MODE_KEYFRAME && !ctx->opts->keyframes_only)
+            ctx->seek_request = av_rescale_q(seek_ts, AV_TIME_BASE_Q, ctx->st_timebase);
+        else
+            ctx->seek_request = AV_NOPTS_VALUE;
+        ctx->seek_placeholder = req->mode == SEEK_MODE_PROGRESSIVE;
+        ctx->placeholder_sent = 0;
+        ctx->gen = req->gen;
+
+        /* Forward seek message */
+        ret = send_message(ctx, &msg);
+        if (ret < 0) {
+            sxpi_msg_free_data(&msg);
+            return end_decoding(ctx, ret);
+        }
+
+        return 0;
+    }
+
+    pkt = &msg.pkt;
+    if (is_stale(ctx)) {
+        TRACE(ctx, "drop obsolete packet");
+        sxpi_msg_free_data(&msg);
+        return 0;
+    }
+
+    TRACE(ctx, "got a packet of size %d, push it to decoder", pkt->size);
+    update_skip_frame(ctx, pkt);
+    ret = sxpi_decoder_push_packet(ctx->decoder, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+        return end_decoding(ctx, ret);
+
+    return 0;
+}
+
+void sxpi_decoding_run(struct decoding_ctx *ctx)
+{
+    while (sxpi_decoding_step(ctx, 0) >= 0);
 }
 
 void sxpi_decoding_free(struct decoding_ctx **ctxp)
@@ -332,5 +755,11 @@ void sxpi_decoding_free(struct decoding_ctx **ctxp)
     if (!ctx)
         return;
     sxpi_decoder_free(&ctx->decoder);
+    drop_pending(ctx);
+    av_freep(&ctx->pending);
+    pthread_mutex_destroy(&ctx->pending_lock);
+    if (ctx->framepool)
+        sxpi_framepool_flush_cache(ctx->framepool, &ctx->framepool_cache);
+    sxpi_framepool_unref(&ctx->framepool);
     av_freep(ctxp);
 }
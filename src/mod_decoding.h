@@ -26,22 +26,69 @@
 #include <libavutil/frame.h>
 #include <libavutil/threadmessage.h>
 
+#include "framepool.h"
+#include "membudget.h"
+#include "msgqueue.h"
 #include "opts.h"
 
+struct message;
+
+/*
+ * Message delivery callback replacing the frames queue, so the next stage runs
+ * inline. It is given the frames and seek messages in order, and behaves as a
+ * send to the frames queue would: it takes the ownership of the message and
+ * returns 0, or returns AVERROR(EAGAIN) (only with
+ * AV_THREAD_MESSAGE_NONBLOCK) if it can not accept it yet, or any other
+ * negative value once the next stage ended, which must then be reported by
+ * the error to send of the frames queue. The end of the decoding is still
+ * reported by the error to receive of the frames queue, after which the
+ * callback is called with a NULL message until it returns a negative value.
+ */
+typedef int (*decoding_msg_func)(void *arg, struct message *msg, int flags);
+
 struct decoding_ctx *sxpi_decoding_alloc(void);
 
 int sxpi_decoding_init(void *log_ctx,
                        struct decoding_ctx *ctx,
-                       AVThreadMessageQueue *pkt_queue,
-                       AVThreadMessageQueue *frames_queue,
+                       struct msgqueue *pkt_queue,
+                       struct msgqueue *frames_queue,
                        int is_image,
                        const AVStream *stream,
+                       struct framepool *framepool,
                        const struct sxplayer_opts *opts);
 
 const AVCodecContext *sxpi_decoding_get_avctx(struct decoding_ctx *ctx);
 
+AVFrame *sxpi_decoding_get_frame(struct decoding_ctx *ctx);
+
+void sxpi_decoding_release_frame(struct decoding_ctx *ctx, AVFrame **framep);
+
 int sxpi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame);
 
+/*
+ * Callback called every time a frame or message is queued, possibly from a
+ * decoder thread.
+ */
+void sxpi_decoding_set_wake_cb(struct decoding_ctx *ctx, void (*wake_cb)(void *arg), void *arg);
+
+/* Deliver the messages to the callback instead of the frames queue. Must be
+ * called before the decoding runs. */
+void sxpi_decoding_set_msg_cb(struct decoding_ctx *ctx, decoding_msg_func cb, void *arg);
+
+/* See sxpi_demuxing_set_seek_gen() */
+void sxpi_decoding_set_seek_gen(struct decoding_ctx *ctx, const atomic_int *seek_gen);
+
+/* See sxpi_demuxing_set_budget() */
+void sxpi_decoding_set_budget(struct decoding_ctx *ctx, struct membudget *budget);
+
+/*
+ * Decode one packet (or forward one message). With AV_THREAD_MESSAGE_NONBLOCK,
+ * AVERROR(EAGAIN) is returned when no progress can be made until a packet is
+ * queued or the frames queue is consumed. Any other negative value means the
+ * decoding ended, and the next call starts it over.
+ */
+int sxpi_decoding_step(struct decoding_ctx *ctx, int flags);
+
 void sxpi_decoding_run(struct decoding_ctx *ctx);
 
 void sxpi_decoding_free(struct decoding_ctx **ctxp);
@@ -22,22 +22,37 @@
 #include <libavutil/avassert.h>
 #include <libavutil/display.h>
 #include <libavutil/eval.h>
+#include <libavutil/time.h>
 
 #include "mod_demuxing.h"
 #include "internal.h"
 #include "log.h"
 #include "msg.h"
+#include "pktindex.h"
+#include "probecache.h"
 
 struct demuxing_ctx {
     void *log_ctx;
     int pkt_skip_mod;
+    int keyframes_only;
     int64_t pkt_count;
     AVFormatContext *fmt_ctx;
     AVStream *stream;
     int stream_idx;
     int is_image;
-    AVThreadMessageQueue *src_queue;
-    AVThreadMessageQueue *pkt_queue;
+    struct sidecar *sidecar;                // NULL if disabled
+    int64_t open_duration;                  // time spent opening and probing the media in microseconds
+    int fast_opened;                        // the stream packets were not probed
+    int64_t duration;                       // probed duration in AV_TIME_BASE, or AV_NOPTS_VALUE
+    double rotation;                        // rotation of the stream in degrees
+    struct msgqueue *src_queue;
+    struct msgqueue *pkt_queue;
+    const atomic_int *seek_gen;             // generation of the latest seek requested, NULL if unknown
+    int gen;                                // generation of the latest seek received
+    struct membudget *budget;               // bytes budget of the packets queue, NULL if unbounded
+    int running;
+    struct message pending;                 // message to send before anything else
+    int has_pending;
 };
 
 struct demuxing_ctx *sxpi_demuxing_alloc(void)
@@ -50,7 +65,7 @@ struct demuxing_ctx *sxpi_demuxing_alloc(void)
 
 // XXX: we should probably prefer the stream duration over the format
 // duration
-int64_t sxpi_demuxing_probe_duration(const struct demuxing_ctx *ctx)
+static int64_t probe_duration(const struct demuxing_ctx *ctx)
 {
     if (!ctx->is_image) {
         int64_t probe_duration64 = ctx->fmt_ctx->duration;
@@ -67,7 +82,7 @@ int64_t sxpi_demuxing_probe_duration(const struct demuxing_ctx *ctx)
     return AV_NOPTS_VALUE;
 }
 
-double sxpi_demuxing_probe_rotation(const struct demuxing_ctx *ctx)
+static double probe_rotation(const struct demuxing_ctx *ctx)
 {
     AVStream *st = (AVStream *)ctx->stream; // XXX: Fix FFmpeg.
     AVDictionaryEntry *rotate_tag = av_dict_get(st->metadata, "rotate", NULL, 0);
@@ -86,6 +101,16 @@ double sxpi_demuxing_probe_rotation(const struct demuxing_ctx *ctx)
     return theta;
 }
 
+int64_t sxpi_demuxing_probe_duration(const struct demuxing_ctx *ctx)
+{
+    return ctx->duration;
+}
+
+double sxpi_demuxing_probe_rotation(const struct demuxing_ctx *ctx)
+{
+    return ctx->rotation;
+}
+
 const AVStream *sxpi_demuxing_get_stream(const struct demuxing_ctx *ctx)
 {
     return ctx->stream;
@@ -96,20 +121,50 @@ int sxpi_demuxing_is_image(const struct demuxing_ctx *ctx)
     return ctx->is_image;
 }
 
+int64_t sxpi_demuxing_get_open_duration(const struct demuxing_ctx *ctx)
+{
+    return ctx->open_duration;
+}
+
+int sxpi_demuxing_is_fast_opened(const struct demuxing_ctx *ctx)
+{
+    return ctx->fast_opened;
+}
+
+/* Tell if the container headers describe the stream enough for the decoder to
+ * be initialized, in which case probing its packets is not needed */
+static int is_stream_described(const AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+
+    if (par->codec_id == AV_CODEC_ID_NONE || !st->time_base.num || !st->time_base.den)
+        return 0;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        return par->width > 0 && par->height > 0;
+    if (par->codec_type == AVMEDIA_TYPE_AUDIO)
+        return par->sample_rate > 0 && par->channels > 0;
+    return 0;
+}
+
 int sxpi_demuxing_init(void *log_ctx,
                        struct demuxing_ctx *ctx,
-                       AVThreadMessageQueue *src_queue,
-                       AVThreadMessageQueue *pkt_queue,
+                       struct msgqueue *src_queue,
+                       struct msgqueue *pkt_queue,
                        const char *filename,
-                       const struct sxplayer_opts *opts)
+                       const struct sxplayer_opts *opts,
+                       struct sidecar *sidecar)
 {
     enum AVMediaType media_type;
+    struct probe_result cached = {0};
+    int from_cache = 0, probed = 0;
 
     ctx->log_ctx = log_ctx;
 
     ctx->src_queue = src_queue;
     ctx->pkt_queue = pkt_queue;
     ctx->pkt_skip_mod = opts->pkt_skip_mod;
+    ctx->keyframes_only = opts->keyframes_only;
+    ctx->sidecar = sidecar;
 
     switch (opts->avselect) {
     case SXPLAYER_SELECT_VIDEO: media_type = AVMEDIA_TYPE_VIDEO; break;
@@ -118,6 +173,16 @@ int sxpi_demuxing_init(void *log_ctx,
         av_assert0(0);
     }
 
+    const int64_t open_start = av_gettime_relative();
+
+    ctx->fmt_ctx = avformat_alloc_context();
+    if (!ctx->fmt_ctx)
+        return AVERROR(ENOMEM);
+    if (opts->probesize)
+        ctx->fmt_ctx->probesize = opts->probesize;
+    if (opts->analyzeduration)
+        ctx->fmt_ctx->max_analyze_duration = TIME2INT64(opts->analyzeduration);
+
     TRACE(ctx, "opening %s", filename);
     int ret = avformat_open_input(&ctx->fmt_ctx, filename, NULL, NULL);
     if (ret < 0) {
@@ -125,20 +190,60 @@ int sxpi_demuxing_init(void *log_ctx,
         return ret;
     }
 
-    TRACE(ctx, "find stream info");
-    ret = avformat_find_stream_info(ctx->fmt_ctx, NULL);
-    if (ret < 0) {
-        LOG(ctx, ERROR, "Unable to find input stream information");
-        return ret;
+    ret = AVERROR_INVALIDDATA;
+    if (sidecar && sxpi_sidecar_load(sidecar) > 0) {
+        ret = sxpi_sidecar_apply(sidecar, ctx->fmt_ctx, media_type, opts->stream_idx);
+        if (ret == AVERROR(ENOMEM))
+            return ret;
+        if (ret >= 0)
+            TRACE(ctx, "stream information restored from the sidecar");
+    }
+
+    if (ret < 0 && opts->probe_cache) {
+        from_cache = sxpi_probecache_get(filename, ctx->fmt_ctx, media_type, opts->stream_idx, &cached);
+        if (from_cache < 0)
+            return from_cache;
+        if (from_cache) {
+            TRACE(ctx, "stream information taken from a previous probe");
+            ret = cached.stream_idx;
+        }
     }
 
-    TRACE(ctx, "find best stream");
-    ret = av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
+    if (ret < 0 && opts->fast_open) {
+        ret = av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
+        if (ret >= 0 && !is_stream_described(ctx->fmt_ctx->streams[ret])) {
+            TRACE(ctx, "stream %d not described by the headers, probe it", ret);
+            ret = AVERROR_INVALIDDATA;
+        }
+        if (ret >= 0)
+            TRACE(ctx, "stream information taken from the headers");
+    }
+    ctx->fast_opened = ret >= 0;
+
     if (ret < 0) {
-        LOG(ctx, ERROR, "Unable to find a %s stream in the input file",
-            av_get_media_type_string(media_type));
-        return ret;
+        TRACE(ctx, "find stream info");
+        ret = avformat_find_stream_info(ctx->fmt_ctx, NULL);
+        if (ret < 0) {
+            LOG(ctx, ERROR, "Unable to find input stream information");
+            return ret;
+        }
+
+        TRACE(ctx, "find best stream");
+        ret = av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
+        if (ret < 0) {
+            LOG(ctx, ERROR, "Unable to find a %s stream in the input file",
+                av_get_media_type_string(media_type));
+            return ret;
+        }
+        probed = 1;
+    }
+
+    if (sidecar) {
+        int err = sxpi_sidecar_set_stream(sidecar, ctx->fmt_ctx, ret);
+        if (err < 0)
+            return err;
     }
+    ctx->open_duration = av_gettime_relative() - open_start;
     ctx->stream_idx = ret;
     ctx->stream = ctx->fmt_ctx->streams[ctx->stream_idx];
     ctx->is_image = strstr(ctx->fmt_ctx->iformat->name, "image2") ||
@@ -146,17 +251,128 @@ int sxpi_demuxing_init(void *log_ctx,
     LOG(ctx, INFO, "Selected %s stream %d",
         av_get_media_type_string(media_type), ctx->stream_idx);
 
+    if (from_cache) {
+        ctx->duration = cached.duration;
+        ctx->rotation = cached.rotation;
+    } else {
+        ctx->duration = probe_duration(ctx);
+        ctx->rotation = probe_rotation(ctx);
+    }
+
+    if (probed && opts->probe_cache) {
+        const struct probe_result res = {
+            .stream_idx = ctx->stream_idx,
+            .duration   = ctx->duration,
+            .rotation   = ctx->rotation,
+        };
+        ret = sxpi_probecache_set(filename, ctx->fmt_ctx, media_type, opts->stream_idx, &res);
+        if (ret < 0)
+            return ret;
+    }
+
     /* Automatically discard all the other streams so we don't have to filter
      * them out most of the time */
     for (int i = 0; i < ctx->fmt_ctx->nb_streams; i++)
         if (i != ctx->stream_idx)
             ctx->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
 
+    /* Demuxers with an index (such as MP4) skip the non-key packets without
+     * even reading them, the others are filtered out in pull_packet() */
+    if (ctx->keyframes_only)
+        ctx->stream->discard = AVDISCARD_NONKEY;
+
     av_dump_format(ctx->fmt_ctx, 0, filename, 0);
 
     return 0;
 }
 
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+/* An index made only of keyframes either comes from an intra-only stream, or
+ * only lists the keyframes (such as the Matroska cues); only the former has
+ * about one entry per frame */
+static int has_every_packet(AVStream *st, int nb_entries)
+{
+    if (st->nb_frames > 0)
+        return nb_entries >= st->nb_frames;
+
+    const AVRational frame_rate = st->avg_frame_rate.num ? st->avg_frame_rate : st->r_frame_rate;
+    if (nb_entries < 2 || !frame_rate.num || !frame_rate.den)
+        return 0;
+    const int64_t frame_duration = av_rescale_q(1, av_inv_q(frame_rate), st->time_base);
+    const int64_t first_ts = avformat_index_get_entry(st, 0)->timestamp;
+    const int64_t last_ts  = avformat_index_get_entry(st, nb_entries - 1)->timestamp;
+    return (last_ts - first_ts) / (nb_entries - 1) <= frame_duration * 3 / 2;
+}
+#endif
+
+/*
+ * Only a demuxer index holding the non-key packets as well (typically MP4)
+ * describes the whole stream, a keyframe-only index (such as the Matroska
+ * cues) does not tell the GOP sizes.
+ *
+ * The index timestamps are decoding timestamps while the index is queried
+ * with presentation timestamps, so they are shifted by the decoding delay of
+ * the first packet: this is exact for the keyframes of streams with a
+ * constant reordering delay, which are the entries the queries rely on.
+ */
+static int fill_index_from_demuxer(struct demuxing_ctx *ctx, struct pktindex *idx)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    AVStream *st = ctx->stream;
+    const int nb_entries = avformat_index_get_entries_count(st);
+    int nb_keyframes = 0;
+
+    for (int i = 0; i < nb_entries; i++)
+        nb_keyframes += !!(avformat_index_get_entry(st, i)->flags & AVINDEX_KEYFRAME);
+    if (!nb_keyframes || (nb_keyframes == nb_entries && !has_every_packet(st, nb_entries)))
+        return 0;
+
+    const int64_t first_dts = avformat_index_get_entry(st, 0)->timestamp;
+    const int64_t delay = st->start_time != AV_NOPTS_VALUE ? FFMAX(st->start_time - first_dts, 0) : 0;
+    TRACE(ctx, "shift the demuxer index by a decoding delay of %"PRId64, delay);
+
+    for (int i = 0; i < nb_entries; i++) {
+        const AVIndexEntry *entry = avformat_index_get_entry(st, i);
+        int ret = sxpi_pktindex_add(idx, entry->timestamp + delay, entry->size,
+                                    entry->flags & AVINDEX_KEYFRAME);
+        if (ret < 0)
+            return ret;
+    }
+    sxpi_pktindex_set_complete(idx);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int sxpi_demuxing_build_index(struct demuxing_ctx *ctx, struct pktindex *idx,
+                              const char *filename, int scan, struct workpool *workpool)
+{
+    if (ctx->is_image)
+        return 0;
+
+    int ret = ctx->sidecar ? sxpi_sidecar_fill_index(ctx->sidecar, idx) : 0;
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        TRACE(ctx, "packet index filled from the sidecar");
+        return 0;
+    }
+
+    ret = fill_index_from_demuxer(ctx, idx);
+    if (ret < 0)
+        return ret;
+    if (ret > 0 || !scan) {
+        TRACE(ctx, "packet index %s", ret > 0 ? "filled from the demuxer index" : "not available");
+        if (ctx->sidecar)
+            sxpi_sidecar_write(ctx->sidecar, idx);
+        return 0;
+    }
+
+    TRACE(ctx, "no usable demuxer index, scan the packets");
+    return sxpi_pktindex_start_scan(idx, filename, ctx->stream_idx, ctx->sidecar, workpool);
+}
+
 static int pull_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
 {
     int ret;
@@ -175,6 +391,11 @@ static int pull_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
             continue;
         }
 
+        if (ctx->keyframes_only && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
         if (ctx->pkt_skip_mod) {
             ctx->pkt_count++;
             if (ctx->pkt_count % ctx->pkt_skip_mod && !(pkt->flags & AV_PKT_FLAG_KEY)) {
@@ -190,86 +411,154 @@ static int pull_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
     return ret;
 }
 
-void sxpi_demuxing_run(struct demuxing_ctx *ctx)
+/* Send a message to the decoder, or keep it for the next step if the queue is
+ * full in non-blocking mode */
+static int send_message(struct demuxing_ctx *ctx, struct message *msg, int flags)
+{
+    int ret = sxpi_msg_send(ctx->pkt_queue, ctx->budget, msg, flags);
+    if (ret == AVERROR(EAGAIN)) {
+        ctx->pending = *msg;
+        ctx->has_pending = 1;
+    }
+    return ret;
+}
+
+static int send_failed(struct demuxing_ctx *ctx, struct message *msg, int ret)
+{
+    const int is_packet = msg->type == MSG_PACKET;
+
+    sxpi_msg_free_data(msg);
+    if (is_packet) {
+        if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+            LOG(ctx, ERROR, "Unable to send packet to decoder: %s", av_err2str(ret));
+        TRACE(ctx, "can't send pkt to decoder: %s", av_err2str(ret));
+        sxpi_msgqueue_set_err_recv(ctx->pkt_queue, ret);
+    }
+    return ret;
+}
+
+static int end_demuxing(struct demuxing_ctx *ctx, int ret)
 {
-    int ret;
     int in_err, out_err;
 
-    TRACE(ctx, "demuxing packets in queue %p", ctx->pkt_queue);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        in_err = out_err = ret;
+    } else {
+        in_err = AVERROR_EXIT;
+        out_err = AVERROR_EOF;
+    }
+    TRACE(ctx, "notify user with %s and decoder with %s",
+          av_err2str(in_err), av_err2str(out_err));
+    sxpi_msgqueue_set_err_send(ctx->src_queue, in_err);
+    sxpi_msgqueue_flush(ctx->src_queue);
+    sxpi_msgqueue_set_err_recv(ctx->pkt_queue, out_err);
 
-    for (;;) {
-        AVPacket pkt;
-        struct message msg;
-
-        ret = av_thread_message_queue_recv(ctx->src_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
-        if (ret != AVERROR(EAGAIN)) {
-            if (ret < 0)
-                break;
-
-            if (msg.type == MSG_SEEK) {
-                av_assert0(!ctx->is_image);
-
-                /* Make later modules stop working ASAP */
-                av_thread_message_flush(ctx->pkt_queue);
-
-                /* do actual seek so the following packet that will be pulled in
-                 * this current thread will be at the (approximate) requested time */
-                const int64_t seek_to = *(int64_t *)msg.data;
-                LOG(ctx, INFO, "Seek in media at ts=%s", PTS2TIMESTR(seek_to));
-                ret = avformat_seek_file(ctx->fmt_ctx, -1, INT64_MIN, seek_to, seek_to, 0);
-                if (ret < 0) {
-                    sxpi_msg_free_data(&msg);
-                    break;
-                }
-            }
+    ctx->running = 0;
+    return AVERROR_EOF;
+}
+
+void sxpi_demuxing_set_seek_gen(struct demuxing_ctx *ctx, const atomic_int *seek_gen)
+{
+    ctx->seek_gen = seek_gen;
+}
+
+void sxpi_demuxing_set_budget(struct demuxing_ctx *ctx, struct membudget *budget)
+{
+    ctx->budget = budget;
+}
+
+/* A seek was requested after the latest one received: the packets to come
+ * until then are obsolete */
+static int is_stale(const struct demuxing_ctx *ctx)
+{
+    return ctx->seek_gen && atomic_load_explicit(ctx->seek_gen, memory_order_relaxed) != ctx->gen;
+}
+
+int sxpi_demuxing_step(struct demuxing_ctx *ctx, int flags)
+{
+    int ret;
+    struct message msg;
+
+    if (!ctx->running) {
+        TRACE(ctx, "demuxing packets in queue %p", ctx->pkt_queue);
+        ctx->gen = ctx->seek_gen ? atomic_load(ctx->seek_gen) : 0;
+        ctx->running = 1;
+    }
+
+    const int stale = is_stale(ctx);
+
+    if (ctx->has_pending && stale && ctx->pending.type == MSG_PACKET) {
+        TRACE(ctx, "drop obsolete packet");
+        sxpi_msg_free_data(&ctx->pending);
+        ctx->has_pending = 0;
+    }
+
+    if (ctx->has_pending) {
+        ret = sxpi_msg_send(ctx->pkt_queue, ctx->budget, &ctx->pending, flags);
+        if (ret == AVERROR(EAGAIN))
+            return ret;
+        ctx->has_pending = 0;
+        if (ret < 0)
+            return end_demuxing(ctx, send_failed(ctx, &ctx->pending, ret));
+        return 0;
+    }
 
-            /* Forward the message */
-            ret = av_thread_message_queue_send(ctx->pkt_queue, &msg, 0);
+    /* Instead of reading packets no one wants, wait for the seek */
+    ret = sxpi_msgqueue_recv(ctx->src_queue, &msg, stale ? flags : AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret == AVERROR(EAGAIN) && stale)
+        return ret;
+    if (ret != AVERROR(EAGAIN)) {
+        if (ret < 0)
+            return end_demuxing(ctx, ret);
+
+        if (msg.type == MSG_SEEK) {
+            av_assert0(!ctx->is_image);
+
+            /* Make later modules stop working ASAP */
+            sxpi_msgqueue_flush(ctx->pkt_queue);
+
+            /* do actual seek so the following packet that will be pulled in
+             * this current thread will be at the (approximate) requested time */
+            const int64_t seek_to = ((const struct seek_request *)msg.data)->ts;
+            ctx->gen = ((const struct seek_request *)msg.data)->gen;
+            LOG(ctx, INFO, "Seek in media at ts=%s", PTS2TIMESTR(seek_to));
+            ret = avformat_seek_file(ctx->fmt_ctx, -1, INT64_MIN, seek_to, seek_to, 0);
             if (ret < 0) {
                 sxpi_msg_free_data(&msg);
-                break;
+                return end_demuxing(ctx, ret);
             }
         }
 
-        msg.type = MSG_PACKET;
-
-        ret = pull_packet(ctx, &pkt);
+        /* Forward the message */
+        ret = send_message(ctx, &msg, flags);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
         if (ret < 0)
-            break;
+            return end_demuxing(ctx, send_failed(ctx, &msg, ret));
+    }
 
-        TRACE(ctx, "pulled a packet of size %d, sending to decoder", pkt.size);
+    msg = (struct message){
+        .type = MSG_PACKET,
+    };
+    ret = pull_packet(ctx, &msg.pkt);
+    if (ret < 0)
+        return end_demuxing(ctx, ret);
 
-        msg.data = av_memdup(&pkt, sizeof(pkt));
-        if (!msg.data) {
-            av_packet_unref(&pkt);
-            break;
-        }
+    TRACE(ctx, "pulled a packet of size %d, sending to decoder", msg.pkt.size);
 
-        ret = av_thread_message_queue_send(ctx->pkt_queue, &msg, 0);
-        TRACE(ctx, "sent packet to decoder, ret=%s", av_err2str(ret));
+    ret = send_message(ctx, &msg, flags);
+    TRACE(ctx, "sent packet to decoder, ret=%s", av_err2str(ret));
+    if (ret == AVERROR(EAGAIN))
+        return 0;
+    if (ret < 0)
+        return end_demuxing(ctx, send_failed(ctx, &msg, ret));
 
-        if (ret < 0) {
-            av_packet_unref(&pkt);
-            av_freep(&msg.data);
-            if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
-                LOG(ctx, ERROR, "Unable to send packet to decoder: %s", av_err2str(ret));
-            TRACE(ctx, "can't send pkt to decoder: %s", av_err2str(ret));
-            av_thread_message_queue_set_err_recv(ctx->pkt_queue, ret);
-            break;
-        }
-    }
+    return 0;
+}
 
-    if (ret < 0 && ret != AVERROR_EOF) {
-        in_err = out_err = ret;
-    } else {
-        in_err = AVERROR_EXIT;
-        out_err = AVERROR_EOF;
-    }
-    TRACE(ctx, "notify user with %s and decoder with %s",
-          av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->src_queue, in_err);
-    av_thread_message_flush(ctx->src_queue);
-    av_thread_message_queue_set_err_recv(ctx->pkt_queue, out_err);
+void sxpi_demuxing_run(struct demuxing_ctx *ctx)
+{
+    while (sxpi_demuxing_step(ctx, 0) >= 0);
 }
 
 void sxpi_demuxing_free(struct demuxing_ctx **ctxp)
@@ -277,6 +566,8 @@ void sxpi_demuxing_free(struct demuxing_ctx **ctxp)
     struct demuxing_ctx *ctx = *ctxp;
     if (!ctx)
         return;
+    if (ctx->has_pending)
+        sxpi_msg_free_data(&ctx->pending);
     avformat_close_input(&ctx->fmt_ctx);
     av_freep(ctxp);
 }
@@ -21,25 +21,63 @@
 #ifndef MOD_DEMUXING_H
 #define MOD_DEMUXING_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <libavformat/avformat.h>
 #include <libavutil/threadmessage.h>
 
+#include "membudget.h"
+#include "msgqueue.h"
 #include "opts.h"
+#include "pktindex.h"
+#include "sidecar.h"
 
 struct demuxing_ctx *sxpi_demuxing_alloc(void);
 
 int sxpi_demuxing_init(void *log_ctx,
                        struct demuxing_ctx *ctx,
-                       AVThreadMessageQueue *src_queue,
-                       AVThreadMessageQueue *pkt_queue,
+                       struct msgqueue *src_queue,
+                       struct msgqueue *pkt_queue,
                        const char *filename,
-                       const struct sxplayer_opts *opts);
+                       const struct sxplayer_opts *opts,
+                       struct sidecar *sidecar);
 
 int64_t sxpi_demuxing_probe_duration(const struct demuxing_ctx *ctx);
 double sxpi_demuxing_probe_rotation(const struct demuxing_ctx *ctx);
 const AVStream *sxpi_demuxing_get_stream(const struct demuxing_ctx *ctx);
 int sxpi_demuxing_is_image(const struct demuxing_ctx *ctx);
+int64_t sxpi_demuxing_get_open_duration(const struct demuxing_ctx *ctx);
+int sxpi_demuxing_is_fast_opened(const struct demuxing_ctx *ctx);
+
+/*
+ * Fill the packet index from the sidecar or from the demuxer index when it
+ * describes every packet, or start a background scan of the file otherwise
+ * (if scan is set), on workpool if not NULL. The sidecar is (re)written once
+ * the index is complete.
+ */
+int sxpi_demuxing_build_index(struct demuxing_ctx *ctx, struct pktindex *idx,
+                              const char *filename, int scan, struct workpool *workpool);
+
+/*
+ * Share the generation of the latest seek requested: while it differs from
+ * the one of the latest seek received, the module knows a seek is coming and
+ * stops producing obsolete data.
+ */
+void sxpi_demuxing_set_seek_gen(struct demuxing_ctx *ctx, const atomic_int *seek_gen);
+
+/*
+ * Bound the bytes of the messages sent to the out queue. Must be called
+ * before the module runs.
+ */
+void sxpi_demuxing_set_budget(struct demuxing_ctx *ctx, struct membudget *budget);
+
+/*
+ * Demux one packet (or forward one message). With AV_THREAD_MESSAGE_NONBLOCK,
+ * AVERROR(EAGAIN) is returned when no progress can be made until the packet
+ * queue is consumed. Any other negative value means the demuxing ended, and
+ * the next call starts it over.
+ */
+int sxpi_demuxing_step(struct demuxing_ctx *ctx, int flags);
 
 void sxpi_demuxing_run(struct demuxing_ctx *ctx);
 
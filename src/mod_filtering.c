@@ -18,22 +18,29 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include <libavcodec/avfft.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avstring.h>
+#include <libavutil/buffer.h>
 #include <libavutil/frame.h>
+#include <libavutil/motion_vector.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
 #include <libavutil/timestamp.h>
 
 #include "sxplayer.h"
 #include "internal.h"
 #include "mod_filtering.h"
+#include "framepool.h"
 #include "log.h"
 #include "msg.h"
+#include "wakeup.h"
 
 #define AUDIO_NBITS      10
 #define AUDIO_NBSAMPLES  (1<<(AUDIO_NBITS))
@@ -42,8 +49,8 @@
 struct filtering_ctx {
     void *log_ctx;
 
-    AVThreadMessageQueue *in_queue;
-    AVThreadMessageQueue *out_queue;
+    struct msgqueue *in_queue;
+    struct msgqueue *out_queue;
 
     AVCodecParameters *codecpar;
     char *filters;
@@ -51,8 +58,12 @@ struct filtering_ctx {
     int sw_pix_fmt;
     int max_pixels;
     int audio_texture;
+    int export_mvs_grid;
     AVRational st_timebase;
 
+    struct framepool *framepool;
+    struct framepool_cache framepool_cache;
+
     AVFilterGraph *filter_graph;
     enum AVPixelFormat last_frame_format;
     AVFilterContext *buffersink_ctx;        // sink of the graph (from where we pull)
@@ -60,6 +71,32 @@ struct filtering_ctx {
     float *window_func_lut;                 // audio window function lookup table
     RDFTContext *rdft;                      // real discrete fourier transform context
     FFTSample *rdft_data[AUDIO_NBCHANNELS]; // real discrete fourier transform data for each channel
+
+    AVBufferPool *mvs_grid_pool;            // pool of motion vectors grid buffers
+    int mvs_grid_size;                      // size of the buffers in the pool
+    int32_t *mvs_acc;                       // motion vectors accumulators (weighted dx, weighted dy, weight)
+
+    filtering_frame_func frame_cb;          // NULL to send the frames to the out queue
+    void *frame_cb_arg;
+    int refused;                            // the frame callback refused the pending frame
+    atomic_int aborted;                     // the frame callback must not be waited for anymore
+    struct wakeup *wakeup;                  // see sxpi_filtering_set_wakeup()
+    void (*sink_cb)(void *arg);
+    void *sink_arg;
+
+    const atomic_int *seek_gen;             // generation of the latest seek requested, NULL if unknown
+    int gen;                                // generation of the latest seek received
+
+    const atomic_int *sink_depth;           // number of frames allowed in the out queue, NULL for its capacity
+    atomic_llong *frame_time;               // see sxpi_filtering_set_sink_depth()
+    struct membudget *budget;               // bytes budget of the out queue, NULL if unbounded
+    int64_t last_send_time;                 // time the latest frame was sent, AV_NOPTS_VALUE after a seek
+
+    int running;
+    int flushing;                           // the filtergraph is being drained
+    int send_flags;
+    struct message pending;                 // message to send before anything else
+    int has_pending;
 };
 
 struct filtering_ctx *sxpi_filtering_alloc(void)
@@ -166,6 +203,38 @@ static void audio_frame_to_sound_texture(struct filtering_ctx *ctx, AVFrame *dst
     }
 }
 
+/* Software pixel format requested at the output of the filtergraph */
+static enum AVPixelFormat get_sw_pix_fmt(const struct filtering_ctx *ctx)
+{
+    if (ctx->sw_pix_fmt != SXPLAYER_PIXFMT_AUTO)
+        return sxpi_pix_fmts_sx2ff(ctx->sw_pix_fmt);
+    if (sxpi_pix_fmts_ff2sx(ctx->last_frame_format) == -1)
+        return AV_PIX_FMT_RGBA;
+    return ctx->last_frame_format;
+}
+
+/*
+ * Without any user filter nor downscaling, and with the frames already in the
+ * output pixel format, the filtergraph would only pass the frames through:
+ * the decoded frames are then delivered as is instead.
+ */
+static int is_passthrough(const struct filtering_ctx *ctx)
+{
+    const AVCodecParameters *codecpar = ctx->codecpar;
+
+    if (codecpar->codec_type != AVMEDIA_TYPE_VIDEO || ctx->filters)
+        return 0;
+
+    if (ctx->max_pixels) {
+        int w = codecpar->width, h = codecpar->height;
+        sxpi_update_dimensions(&w, &h, ctx->max_pixels);
+        if (w != codecpar->width || h != codecpar->height)
+            return 0;
+    }
+
+    return get_sw_pix_fmt(ctx) == ctx->last_frame_format;
+}
+
 /**
  * Setup the libavfilter filtergraph for user filter but also to have a way to
  * request a pixel format we want, and let libavfilter insert the necessary
@@ -186,6 +255,12 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
     if (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)
         return 0;
 
+    if (is_passthrough(ctx)) {
+        TRACE(ctx, "%s frames need no conversion, bypass the filtergraph",
+              av_get_pix_fmt_name(ctx->last_frame_format));
+        return 0;
+    }
+
     outputs = avfilter_inout_alloc();
     inputs  = avfilter_inout_alloc();
 
@@ -248,17 +323,10 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
     snprintf(args, sizeof(args), "sws_flags=+full_chroma_int;%s", ctx->filters ? ctx->filters : "");
     if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
         const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(ctx->last_frame_format);
-        enum AVPixelFormat sw_pix_fmt = sxpi_pix_fmts_sx2ff(ctx->sw_pix_fmt);
-        if (ctx->sw_pix_fmt == SXPLAYER_PIXFMT_AUTO) {
-            const enum sxplayer_pixel_format fmt = sxpi_pix_fmts_ff2sx(ctx->last_frame_format);
-            if (fmt == -1) {
-                LOG(ctx, DEBUG, "Unsupported software pixel format: %s, falling back to rgba",
-                    av_get_pix_fmt_name(ctx->last_frame_format));
-                sw_pix_fmt = AV_PIX_FMT_RGBA;
-            } else {
-                sw_pix_fmt = ctx->last_frame_format;
-            }
-        }
+        const enum AVPixelFormat sw_pix_fmt = get_sw_pix_fmt(ctx);
+        if (ctx->sw_pix_fmt == SXPLAYER_PIXFMT_AUTO && sw_pix_fmt != ctx->last_frame_format)
+            LOG(ctx, DEBUG, "Unsupported software pixel format: %s, falling back to rgba",
+                av_get_pix_fmt_name(ctx->last_frame_format));
         const enum AVPixelFormat pix_fmt = !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL) ? sw_pix_fmt : ctx->last_frame_format;
 
         if (ctx->max_pixels) {
@@ -339,19 +407,22 @@ static char *update_filters_str(char *filters, const char *append)
 
 int sxpi_filtering_init(void *log_ctx,
                         struct filtering_ctx *ctx,
-                        AVThreadMessageQueue *in_queue,
-                        AVThreadMessageQueue *out_queue,
+                        struct msgqueue *in_queue,
+                        struct msgqueue *out_queue,
                         const AVStream *stream,
                         const AVCodecContext *avctx,
                         double media_rotation,
+                        struct framepool *framepool,
                         const struct sxplayer_opts *o)
 {
     ctx->log_ctx = log_ctx;
+    ctx->framepool = sxpi_framepool_ref(framepool);
     ctx->in_queue  = in_queue;
     ctx->out_queue = out_queue;
     ctx->sw_pix_fmt = o->sw_pix_fmt;
     ctx->max_pixels = o->max_pixels;
     ctx->audio_texture = o->audio_texture;
+    ctx->export_mvs_grid = o->export_mvs_grid;
     ctx->st_timebase = stream->time_base;
     ctx->max_pts = o->end_time64 > 0 ? av_rescale_q(o->end_time64, AV_TIME_BASE_Q, ctx->st_timebase) : AV_NOPTS_VALUE;
 
@@ -399,16 +470,201 @@ int sxpi_filtering_init(void *log_ctx,
     return 0;
 }
 
+static void accumulate_mv(int32_t *acc_dx, int32_t *acc_dy, int32_t *acc_w,
+                          int grid_w, int grid_h, int pic_w, int pic_h,
+                          const AVMotionVector *mv)
+{
+    const int scale = mv->motion_scale ? mv->motion_scale : 1;
+    const int mv_dx = mv->motion_x * 4 / scale;
+    const int mv_dy = mv->motion_y * 4 / scale;
+
+    const int x0 = FFMAX(mv->dst_x - mv->w / 2, 0);
+    const int y0 = FFMAX(mv->dst_y - mv->h / 2, 0);
+    const int x1 = FFMIN(mv->dst_x - mv->w / 2 + mv->w, pic_w);
+    const int y1 = FFMIN(mv->dst_y - mv->h / 2 + mv->h, pic_h);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    const int bs = SXPI_MVS_GRID_BLOCK_SIZE;
+    for (int by = y0 / bs; by <= (y1 - 1) / bs && by < grid_h; by++) {
+        const int oh = FFMIN(y1, (by + 1) * bs) - FFMAX(y0, by * bs);
+        for (int bx = x0 / bs; bx <= (x1 - 1) / bs && bx < grid_w; bx++) {
+            const int ow = FFMIN(x1, (bx + 1) * bs) - FFMAX(x0, bx * bs);
+            const int area = ow * oh;
+            const int i = by * grid_w + bx;
+            acc_dx[i] += mv_dx * area;
+            acc_dy[i] += mv_dy * area;
+            acc_w[i]  += area;
+        }
+    }
+}
+
+/*
+ * Pack the motion vectors side data into a dense grid of int16 dx and dy
+ * planes (one entry per macroblock), attached to the frame opaque_ref.
+ */
+static int export_mvs_grid(struct filtering_ctx *ctx, AVFrame *frame)
+{
+    /* Whatever a decoder or a filter may have propagated there is not a grid */
+    av_buffer_unref(&frame->opaque_ref);
+
+    const AVFrameSideData *sd = av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
+    if (!sd)
+        return 0;
+
+    const int pic_w  = ctx->codecpar->width;
+    const int pic_h  = ctx->codecpar->height;
+    const int bs     = SXPI_MVS_GRID_BLOCK_SIZE;
+    const int grid_w = (pic_w + bs - 1) / bs;
+    const int grid_h = (pic_h + bs - 1) / bs;
+    const int nb_blocks = grid_w * grid_h;
+
+    /* Planes are aligned so they can be processed with SIMD directly */
+    const int hdr_size   = FFALIGN(sizeof(struct sxpi_mvs_grid), 64);
+    const int plane_size = FFALIGN(nb_blocks * sizeof(int16_t), 64);
+    const int size = hdr_size + 2 * plane_size;
+
+    if (!ctx->mvs_grid_pool || ctx->mvs_grid_size != size) {
+        TRACE(ctx, "allocate motion vectors grid pool for %dx%d blocks", grid_w, grid_h);
+        av_buffer_pool_uninit(&ctx->mvs_grid_pool);
+        av_freep(&ctx->mvs_acc);
+        ctx->mvs_grid_size = 0;
+        ctx->mvs_grid_pool = av_buffer_pool_init(size, NULL);
+        ctx->mvs_acc = av_malloc_array(3 * nb_blocks, sizeof(*ctx->mvs_acc));
+        if (!ctx->mvs_grid_pool || !ctx->mvs_acc)
+            return AVERROR(ENOMEM);
+        ctx->mvs_grid_size = size;
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(ctx->mvs_grid_pool);
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    int32_t *acc_dx = ctx->mvs_acc;
+    int32_t *acc_dy = acc_dx + nb_blocks;
+    int32_t *acc_w  = acc_dy + nb_blocks;
+    memset(ctx->mvs_acc, 0, 3 * nb_blocks * sizeof(*ctx->mvs_acc));
+
+    /* Only the vectors predicted from the past are considered so the grid
+     * describes the motion in display order */
+    const AVMotionVector *mvs = (const AVMotionVector *)sd->data;
+    const int nb_mvs = sd->size / sizeof(*mvs);
+    for (int i = 0; i < nb_mvs; i++)
+        if (mvs[i].source < 0)
+            accumulate_mv(acc_dx, acc_dy, acc_w, grid_w, grid_h, pic_w, pic_h, &mvs[i]);
+
+    struct sxpi_mvs_grid *grid = (struct sxpi_mvs_grid *)buf->data;
+    grid->width     = grid_w;
+    grid->height    = grid_h;
+    grid->dx_offset = hdr_size;
+    grid->dy_offset = hdr_size + plane_size;
+
+    int16_t *dx = (int16_t *)(buf->data + grid->dx_offset);
+    int16_t *dy = (int16_t *)(buf->data + grid->dy_offset);
+    for (int i = 0; i < nb_blocks; i++) {
+        const int w = acc_w[i];
+        dx[i] = w ? av_clip_int16(lrintf(acc_dx[i] / (float)w)) : 0;
+        dy[i] = w ? av_clip_int16(lrintf(acc_dy[i] / (float)w)) : 0;
+    }
+
+    TRACE(ctx, "packed %d motion vectors into a %dx%d grid", nb_mvs, grid_w, grid_h);
+
+    frame->opaque_ref = buf;
+    return 0;
+}
+
+/* Only the first message of the sink is notified: the consumer is expected
+ * to empty the queue once notified */
+static void notify_sink(struct filtering_ctx *ctx)
+{
+    if (ctx->sink_cb && sxpi_msgqueue_nb_elems(ctx->out_queue) == 1)
+        ctx->sink_cb(ctx->sink_arg);
+}
+
+/* The frames only, since the seek messages are expected back by the
+ * control thread whatever the depth is */
+static int sink_is_full(const struct filtering_ctx *ctx, const struct message *msg)
+{
+    return ctx->sink_depth && msg->type == MSG_FRAME &&
+           sxpi_msgqueue_nb_elems(ctx->out_queue) >= atomic_load_explicit(ctx->sink_depth, memory_order_relaxed);
+}
+
+/* Called when a frame is ready to be sent: the time spent since the previous
+ * one left is what it cost to produce it */
+static void update_frame_time(struct filtering_ctx *ctx)
+{
+    if (!ctx->frame_time || ctx->last_send_time == AV_NOPTS_VALUE)
+        return;
+    const int64_t elapsed = av_gettime_relative() - ctx->last_send_time;
+    const int64_t peak = atomic_load_explicit(ctx->frame_time, memory_order_relaxed);
+    atomic_store_explicit(ctx->frame_time, FFMAX(elapsed, peak - peak / 16), memory_order_relaxed);
+}
+
+static void notify_sent(struct filtering_ctx *ctx, const struct message *msg)
+{
+    if (msg->type == MSG_FRAME)
+        ctx->last_send_time = av_gettime_relative();
+    notify_sink(ctx);
+}
+
+/* Send a message to the sink, or keep it for the next step if the queue is
+ * full in non-blocking mode, or filled up to its depth */
+static int send_message(struct filtering_ctx *ctx, struct message *msg)
+{
+    int ret = sink_is_full(ctx, msg) ? AVERROR(EAGAIN)
+            : sxpi_msg_send(ctx->out_queue, ctx->budget, msg, ctx->send_flags);
+    if (ret == AVERROR(EAGAIN)) {
+        ctx->pending = *msg;
+        ctx->has_pending = 1;
+        ret = 0;
+    } else if (ret >= 0) {
+        notify_sent(ctx, msg);
+    }
+    return ret;
+}
+
+static void free_message(struct filtering_ctx *ctx, struct message *msg)
+{
+    if (msg->type == MSG_FRAME) {
+        AVFrame *frame = msg->data;
+        sxpi_framepool_release_frame(ctx->framepool, &frame);
+        msg->data = NULL;
+    } else {
+        sxpi_msg_free_data(msg);
+    }
+}
+
 static int send_frame(struct filtering_ctx *ctx, AVFrame *frame)
 {
     int ret;
     struct message msg = {
         .type = MSG_FRAME,
         .data = frame,
+        .pool = ctx->framepool,
     };
 
-    TRACE(ctx, "sending filtered frame to the sink");
-    ret = av_thread_message_queue_send(ctx->out_queue, &msg, 0);
+    if (ctx->export_mvs_grid && ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ret = export_mvs_grid(ctx, frame);
+        if (ret < 0) {
+            LOG(ctx, ERROR, "unable to export motion vectors grid: %s", av_err2str(ret));
+            return ret;
+        }
+    }
+
+    if (ctx->frame_cb) {
+        TRACE(ctx, "pushing filtered frame to the frame callback");
+        ret = ctx->frame_cb(ctx->frame_cb_arg, frame);
+        if (ret > 0) {
+            ctx->pending = msg;
+            ctx->has_pending = 1;
+            ctx->refused = 1;
+            ret = 0;
+        }
+    } else {
+        TRACE(ctx, "sending filtered frame to the sink");
+        update_frame_time(ctx);
+        ret = send_message(ctx, &msg);
+    }
     if (ret < 0) {
         if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
             LOG(ctx, ERROR, "unable to send frame: %s", av_err2str(ret));
@@ -441,7 +697,7 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
     TRACE(ctx, "pulling frame from filtergraph");
 
     if (do_audio_texture) {
-        filtered_frame = av_frame_alloc();
+        filtered_frame = sxpi_framepool_get_frame(ctx->framepool, &ctx->framepool_cache);
         if (!filtered_frame)
             return AVERROR(ENOMEM);
     }
@@ -449,7 +705,7 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
     ret = av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame);
     if (ret < 0) {
         if (do_audio_texture)
-            av_frame_free(&filtered_frame);
+            sxpi_framepool_release_frame(ctx->framepool, &filtered_frame);
         if (ret != AVERROR_EOF && ret != AVERROR(EAGAIN))
             LOG(ctx, ERROR, "unable to pull frame from filtergraph: %s", av_err2str(ret));
         return ret;
@@ -464,7 +720,7 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
     if (do_audio_texture) {
         AVFrame *audio_texture_frame = get_audio_frame();
         audio_frame_to_sound_texture(ctx, audio_texture_frame, filtered_frame);
-        av_frame_free(&filtered_frame);
+        sxpi_framepool_release_frame(ctx->framepool, &filtered_frame);
         av_frame_move_ref(outframe, audio_texture_frame);
         av_free(audio_texture_frame);
     }
@@ -476,145 +732,354 @@ static int pull_send_frame(struct filtering_ctx *ctx)
 {
     int ret;
 
-    AVFrame *filtered_frame = av_frame_alloc();
+    AVFrame *filtered_frame = sxpi_framepool_get_frame(ctx->framepool, &ctx->framepool_cache);
     if (!filtered_frame)
         return AVERROR(ENOMEM);
 
     ret = pull_frame(ctx, filtered_frame);
 
     if (ret < 0) {
-        av_frame_free(&filtered_frame);
+        sxpi_framepool_release_frame(ctx->framepool, &filtered_frame);
         return ret;
     }
 
     ret = send_frame(ctx, filtered_frame);
     if (ret < 0) {
-        av_frame_free(&filtered_frame);
+        sxpi_framepool_release_frame(ctx->framepool, &filtered_frame);
         return ret;
     }
 
     return 0;
 }
 
-static int flush_frames(struct filtering_ctx *ctx)
+static int finish_filtering(struct filtering_ctx *ctx, int ret)
 {
-    int ret;
-
-    if (!ctx->filter_graph)
-        return 0;
-
-    TRACE(ctx, "push null frame into %s filtergraph to trigger flushing",
-          av_get_media_type_string(ctx->codecpar->codec_type));
+    int in_err, out_err;
 
-    ret = push_frame(ctx, NULL);
-    if (ret < 0)
-        return ret;
+    if (ret < 0 && ret != AVERROR_EOF) {
+        in_err = out_err = ret;
+    } else {
+        in_err = AVERROR_EXIT;
+        out_err = AVERROR_EOF;
+    }
+    if (ctx->frame_cb && ret == AVERROR_EOF)
+        ctx->frame_cb(ctx->frame_cb_arg, NULL);
 
-    do {
-        ret = pull_send_frame(ctx);
-    } while (ret >= 0);
+    TRACE(ctx, "notify decoder with %s and sink with %s",
+          av_err2str(in_err), av_err2str(out_err));
+    sxpi_msg_set_err_send(ctx->in_queue, in_err);
+    sxpi_msgqueue_flush(ctx->in_queue);
+    sxpi_msgqueue_set_err_recv(ctx->out_queue, out_err);
+    if (ctx->sink_cb)
+        ctx->sink_cb(ctx->sink_arg);
+
+    ctx->running = 0;
+    ctx->flushing = 0;
+    return AVERROR_EOF;
+}
 
-    return ret;
+static int end_filtering(struct filtering_ctx *ctx, int ret)
+{
+    /* Fetch remaining frames */
+    if (ret == AVERROR_EOF && ctx->filter_graph) {
+        TRACE(ctx, "push null frame into %s filtergraph to trigger flushing",
+              av_get_media_type_string(ctx->codecpar->codec_type));
+        ret = push_frame(ctx, NULL);
+        if (ret >= 0) {
+            ctx->flushing = 1;
+            return 0;
+        }
+    }
+    return finish_filtering(ctx, ret);
 }
 
-void sxpi_filtering_run(struct filtering_ctx *ctx)
+/* A seek was requested after the latest one received: the frames to come
+ * until then are not worth filtering */
+static int is_stale(const struct filtering_ctx *ctx)
 {
-    int ret;
-    int in_err, out_err;
+    return ctx->seek_gen && atomic_load_explicit(ctx->seek_gen, memory_order_relaxed) != ctx->gen;
+}
 
+static void start_filtering(struct filtering_ctx *ctx, int flags)
+{
     TRACE(ctx, "filtering packets from %p into %p", ctx->in_queue, ctx->out_queue);
 
     // we want to force the reconstruction of the filtergraph
     ctx->last_frame_format = AV_PIX_FMT_NONE;
+    ctx->send_flags = flags;
+    ctx->running = 1;
+    ctx->gen = ctx->seek_gen ? atomic_load(ctx->seek_gen) : 0;
+    ctx->last_send_time = AV_NOPTS_VALUE;
+    ctx->refused = 0;
+    atomic_store(&ctx->aborted, 0);
+}
 
-    for (;;) {
-        AVFrame *frame;
-        struct message msg;
+/*
+ * Wait for a wake up (see sxpi_filtering_set_wakeup()). In non-blocking mode,
+ * AVERROR(EAGAIN) is returned instead of waiting, and the step is expected to
+ * be run again once woken up.
+ */
+static int park(struct filtering_ctx *ctx, int flags)
+{
+    if (sxpi_wakeup_check(ctx->wakeup))
+        return 0;
+    if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+        return AVERROR(EAGAIN);
+    TRACE(ctx, "parked until woken up");
+    sxpi_wakeup_wait(ctx->wakeup);
+    return 0;
+}
 
-        TRACE(ctx, "fetching a frame from the inqueue");
-        ret = av_thread_message_queue_recv(ctx->in_queue, &msg, 0);
+/* Deal with what must be done before filtering another message: deliver the
+ * frame the sink or the frame callback could not accept yet, and drain the
+ * filtergraph once the filtering ended. Returns 0 if there is nothing left to
+ * deal with, 1 if progress was made, or a negative value (see
+ * sxpi_filtering_step()) */
+static int step_pending(struct filtering_ctx *ctx, int flags)
+{
+    int ret;
+
+    if (ctx->has_pending && ctx->pending.type == MSG_FRAME && is_stale(ctx)) {
+        TRACE(ctx, "drop obsolete filtered frame");
+        free_message(ctx, &ctx->pending);
+        ctx->has_pending = 0;
+        ctx->refused = 0;
+    }
+
+    if (ctx->has_pending && ctx->frame_cb && ctx->pending.type == MSG_FRAME) {
+        if (atomic_load(&ctx->aborted)) {
+            free_message(ctx, &ctx->pending);
+            ctx->has_pending = 0;
+            return finish_filtering(ctx, AVERROR_EXIT);
+        }
+        /* The refused frame is only offered again once resumed, a seek may
+         * have made it obsolete in the meantime */
+        if (ctx->refused) {
+            ret = park(ctx, flags);
+            if (ret < 0)
+                return ret;
+            ctx->refused = 0;
+            return 1;
+        }
+        ret = ctx->frame_cb(ctx->frame_cb_arg, ctx->pending.data);
+        if (ret > 0) {
+            ctx->refused = 1;
+            return 1;
+        }
+        ctx->has_pending = 0;
         if (ret < 0) {
-            if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
-                LOG(ctx, ERROR, "unable to fetch a frame from the inqueue: %s", av_err2str(ret));
-            break;
+            LOG(ctx, ERROR, "frame callback failed: %s", av_err2str(ret));
+            free_message(ctx, &ctx->pending);
+            return finish_filtering(ctx, ret);
         }
+        return 1;
+    }
 
-        if (msg.type == MSG_SEEK) {
-            TRACE(ctx, "message is a seek, destroy filtergraph and forward message to out queue");
-            avfilter_graph_free(&ctx->filter_graph);
-            ctx->last_frame_format = AV_PIX_FMT_NONE;
-            av_thread_message_flush(ctx->out_queue);
-            ret = av_thread_message_queue_send(ctx->out_queue, &msg, 0);
-            if (ret < 0) {
-                sxpi_msg_free_data(&msg);
-                break;
-            }
-            continue;
+    if (ctx->has_pending && sink_is_full(ctx, &ctx->pending)) {
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+        if (atomic_load(&ctx->aborted)) {
+            free_message(ctx, &ctx->pending);
+            ctx->has_pending = 0;
+            return finish_filtering(ctx, AVERROR_EXIT);
         }
+        ret = park(ctx, flags);
+        return ret < 0 ? ret : 1;
+    }
 
-        frame = msg.data;
+    if (ctx->has_pending) {
+        ret = sxpi_msg_send(ctx->out_queue, ctx->budget, &ctx->pending, flags);
+        if (ret == AVERROR(EAGAIN))
+            return ret;
+        ctx->has_pending = 0;
+        if (ret < 0) {
+            if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+                LOG(ctx, ERROR, "unable to send frame: %s", av_err2str(ret));
+            free_message(ctx, &ctx->pending);
+            return finish_filtering(ctx, ret);
+        }
+        notify_sent(ctx, &ctx->pending);
+        return 1;
+    }
 
-        TRACE(ctx, "filtering %s %s frame @ ts=%s",
-              av_get_media_type_string(ctx->codecpar->codec_type),
-              ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? av_get_pix_fmt_name(frame->format)
-                                                              : av_get_sample_fmt_name(frame->format),
-              av_ts2timestr(frame->pts, &ctx->st_timebase));
+    if (ctx->flushing) {
+        ret = pull_send_frame(ctx);
+        if (ret < 0)
+            return finish_filtering(ctx, ret);
+        return 1;
+    }
 
-        /* lazy filtergraph configuration */
-        // XXX: check width/height/samplerate/etc changes?
-        if (ctx->last_frame_format != frame->format) {
-            ctx->last_frame_format = frame->format;
-            ret = setup_filtergraph(ctx);
-            if (ret < 0)
-                break;
-        }
+    return 0;
+}
 
-        // TODO: replace with a trim filter in libavfilter (check if hw accelerated
-        // filters work)
-        if (frame->pts < 0) {
-            av_frame_free(&frame);
-            TRACE(ctx, "frame ts is negative, skipping");
-            continue;
-        } else if (ctx->max_pts != AV_NOPTS_VALUE && frame->pts > ctx->max_pts) {
-            av_frame_free(&frame);
-            TRACE(ctx, "reached trim duration");
-            ret = AVERROR_EXIT; // not EOF because we do not want to flush the frames
-            break;
+/* Filter a frame or forward a seek, taking the ownership of the message */
+static int process_message(struct filtering_ctx *ctx, struct message *msg)
+{
+    int ret;
+
+    if (msg->type == MSG_SEEK) {
+        TRACE(ctx, "message is a seek, destroy filtergraph and forward message to out queue");
+        ctx->gen = ((const struct seek_request *)msg->data)->gen;
+        ctx->last_send_time = AV_NOPTS_VALUE;
+        avfilter_graph_free(&ctx->filter_graph);
+        ctx->last_frame_format = AV_PIX_FMT_NONE;
+        sxpi_msgqueue_flush(ctx->out_queue);
+        ret = send_message(ctx, msg);
+        if (ret < 0) {
+            sxpi_msg_free_data(msg);
+            return end_filtering(ctx, ret);
         }
+        return 0;
+    }
 
-        if (!ctx->filter_graph) {
-            ret = send_frame(ctx, frame);
-            if (ret < 0) {
-                av_frame_free(&frame);
-                break;
-            }
-        } else {
-            ret = push_frame(ctx, frame);
-            av_frame_free(&frame);
-            if (ret < 0)
-                break;
+    AVFrame *frame = msg->data;
+
+    if (is_stale(ctx)) {
+        TRACE(ctx, "drop obsolete frame @ ts=%s", av_ts2timestr(frame->pts, &ctx->st_timebase));
+        sxpi_framepool_release_frame(ctx->framepool, &frame);
+        return 0;
+    }
 
-            ret = pull_send_frame(ctx);
-            if (ret < 0 && ret != AVERROR(EAGAIN))
-                break;
+    TRACE(ctx, "filtering %s %s frame @ ts=%s",
+          av_get_media_type_string(ctx->codecpar->codec_type),
+          ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? av_get_pix_fmt_name(frame->format)
+                                                          : av_get_sample_fmt_name(frame->format),
+          av_ts2timestr(frame->pts, &ctx->st_timebase));
+
+    /* lazy filtergraph configuration */
+    // XXX: check width/height/samplerate/etc changes?
+    if (ctx->last_frame_format != frame->format) {
+        ctx->last_frame_format = frame->format;
+        ret = setup_filtergraph(ctx);
+        if (ret < 0) {
+            sxpi_framepool_release_frame(ctx->framepool, &frame);
+            return end_filtering(ctx, ret);
         }
     }
 
-    /* Fetch remaining frames */
-    if (ret == AVERROR_EOF)
-        ret = flush_frames(ctx);
+    // TODO: replace with a trim filter in libavfilter (check if hw accelerated
+    // filters work)
+    if (frame->pts < 0) {
+        sxpi_framepool_release_frame(ctx->framepool, &frame);
+        TRACE(ctx, "frame ts is negative, skipping");
+        return 0;
+    } else if (ctx->max_pts != AV_NOPTS_VALUE && frame->pts > ctx->max_pts) {
+        sxpi_framepool_release_frame(ctx->framepool, &frame);
+        TRACE(ctx, "reached trim duration");
+        if (ctx->frame_cb)
+            ctx->frame_cb(ctx->frame_cb_arg, NULL);
+        return end_filtering(ctx, AVERROR_EXIT); // not EOF because we do not want to flush the frames
+    }
 
-    if (ret < 0 && ret != AVERROR_EOF) {
-        in_err = out_err = ret;
+    if (!ctx->filter_graph) {
+        ret = send_frame(ctx, frame);
+        if (ret < 0) {
+            sxpi_framepool_release_frame(ctx->framepool, &frame);
+            return end_filtering(ctx, ret);
+        }
     } else {
-        in_err = AVERROR_EXIT;
-        out_err = AVERROR_EOF;
+        ret = push_frame(ctx, frame);
+        sxpi_framepool_release_frame(ctx->framepool, &frame);
+        if (ret < 0)
+            return end_filtering(ctx, ret);
+
+        ret = pull_send_frame(ctx);
+        if (ret < 0 && ret != AVERROR(EAGAIN))
+            return end_filtering(ctx, ret);
     }
-    TRACE(ctx, "notify decoder with %s and sink with %s",
-          av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->in_queue,  in_err);
-    av_thread_message_flush(ctx->in_queue);
-    av_thread_message_queue_set_err_recv(ctx->out_queue, out_err);
+
+    return 0;
+}
+
+int sxpi_filtering_step(struct filtering_ctx *ctx, int flags)
+{
+    int ret;
+    struct message msg;
+
+    if (!ctx->running)
+        start_filtering(ctx, flags);
+
+    ret = step_pending(ctx, flags);
+    if (ret)
+        return FFMIN(ret, 0);
+
+    TRACE(ctx, "fetching a frame from the inqueue");
+    ret = sxpi_msg_recv(ctx->in_queue, &msg, flags);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0) {
+        if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+            LOG(ctx, ERROR, "unable to fetch a frame from the inqueue: %s", av_err2str(ret));
+        return end_filtering(ctx, ret);
+    }
+
+    return process_message(ctx, &msg);
+}
+
+int sxpi_filtering_push_message(struct filtering_ctx *ctx, struct message *msg, int flags)
+{
+    if (!msg)
+        return sxpi_filtering_step(ctx, flags);
+
+    if (!ctx->running)
+        start_filtering(ctx, flags);
+
+    /* The message is only accepted once the previous one is out of the way,
+     * as it would be by a full in queue */
+    int ret;
+    while ((ret = step_pending(ctx, flags)) > 0);
+    if (ret < 0)
+        return ret;
+
+    /* Whatever happens next, the message is consumed: an end of the filtering
+     * is reported by the error to send of the in queue */
+    process_message(ctx, msg);
+    return 0;
+}
+
+void sxpi_filtering_run(struct filtering_ctx *ctx)
+{
+    while (sxpi_filtering_step(ctx, 0) >= 0);
+}
+
+void sxpi_filtering_set_frame_cb(struct filtering_ctx *ctx, filtering_frame_func cb, void *arg)
+{
+    ctx->frame_cb = cb;
+    ctx->frame_cb_arg = arg;
+}
+
+void sxpi_filtering_set_sink_cb(struct filtering_ctx *ctx, void (*sink_cb)(void *arg), void *arg)
+{
+    ctx->sink_cb  = sink_cb;
+    ctx->sink_arg = arg;
+}
+
+void sxpi_filtering_set_seek_gen(struct filtering_ctx *ctx, const atomic_int *seek_gen)
+{
+    ctx->seek_gen = seek_gen;
+}
+
+void sxpi_filtering_set_sink_depth(struct filtering_ctx *ctx, const atomic_int *depth, atomic_llong *frame_time)
+{
+    ctx->sink_depth = depth;
+    ctx->frame_time = frame_time;
+}
+
+void sxpi_filtering_set_budget(struct filtering_ctx *ctx, struct membudget *budget)
+{
+    ctx->budget = budget;
+}
+
+void sxpi_filtering_set_wakeup(struct filtering_ctx *ctx, struct wakeup *wakeup)
+{
+    ctx->wakeup = wakeup;
+}
+
+void sxpi_filtering_abort(struct filtering_ctx *ctx)
+{
+    atomic_store(&ctx->aborted, 1);
+    if (ctx->wakeup)
+        sxpi_wakeup_signal(ctx->wakeup);
 }
 
 void sxpi_filtering_free(struct filtering_ctx **fp)
@@ -633,7 +1098,14 @@ void sxpi_filtering_free(struct filtering_ctx **fp)
             ctx->rdft = NULL;
         }
     }
+    if (ctx->has_pending)
+        free_message(ctx, &ctx->pending);
     avfilter_graph_free(&ctx->filter_graph);
+    av_buffer_pool_uninit(&ctx->mvs_grid_pool);
+    av_freep(&ctx->mvs_acc);
+    if (ctx->framepool)
+        sxpi_framepool_flush_cache(ctx->framepool, &ctx->framepool_cache);
+    sxpi_framepool_unref(&ctx->framepool);
     avcodec_parameters_free(&ctx->codecpar);
     av_freep(&ctx->filters);
     av_freep(fp);
@@ -24,21 +24,96 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/threadmessage.h>
 
+#include "framepool.h"
+#include "membudget.h"
+#include "msgqueue.h"
 #include "opts.h"
+#include "wakeup.h"
+
+struct message;
+
+/*
+ * Frame delivery callback replacing the out queue for the frames. It takes
+ * the ownership of the frame and returns 0, or returns a positive value if it
+ * can not accept it yet, in which case the filtering is parked until woken up
+ * (see sxpi_filtering_set_wakeup()) and then calls it again with the same
+ * frame. A negative value ends the filtering. It is called with a NULL frame
+ * at the end of the stream.
+ */
+typedef int (*filtering_frame_func)(void *arg, AVFrame *frame);
 
 struct filtering_ctx *sxpi_filtering_alloc(void);
 
 int sxpi_filtering_init(void *log_ctx,
                         struct filtering_ctx *ctx,
-                        AVThreadMessageQueue *in_queue,
-                        AVThreadMessageQueue *out_queue,
+                        struct msgqueue *in_queue,
+                        struct msgqueue *out_queue,
                         const AVStream *stream,
                         const AVCodecContext *avctx,
                         double media_rotation,
+                        struct framepool *framepool,
                         const struct sxplayer_opts *o);
 
+/*
+ * Filter one frame (or forward one message). With AV_THREAD_MESSAGE_NONBLOCK,
+ * AVERROR(EAGAIN) is returned when no progress can be made until a frame is
+ * queued, the sink is consumed or the filtering is woken up. Any other negative value means the
+ * filtering ended, and the next call starts it over.
+ */
+int sxpi_filtering_step(struct filtering_ctx *ctx, int flags);
+
+/*
+ * Filter a message given by the caller instead of received from the in queue,
+ * so the filtering runs in the thread of the previous stage. It takes the
+ * ownership of the message and returns 0, or returns AVERROR(EAGAIN) (with
+ * AV_THREAD_MESSAGE_NONBLOCK) while the previous filtered frame waits for room
+ * in the sink. Any other negative value means the filtering ended, which is
+ * also reported by the error to send of the in queue. With a NULL message, a
+ * step is run on the in queue instead, which is how the end of the stream is
+ * received.
+ */
+int sxpi_filtering_push_message(struct filtering_ctx *ctx, struct message *msg, int flags);
+
 void sxpi_filtering_run(struct filtering_ctx *ctx);
 
+/* Deliver the frames to the callback instead of the out queue, which then
+ * only receives the seek messages. Must be called before the filtering runs. */
+void sxpi_filtering_set_frame_cb(struct filtering_ctx *ctx, filtering_frame_func cb, void *arg);
+
+/*
+ * Callback called when the out queue receives a message while empty, and when
+ * the filtering ends.
+ */
+void sxpi_filtering_set_sink_cb(struct filtering_ctx *ctx, void (*sink_cb)(void *arg), void *arg);
+
+/* See sxpi_demuxing_set_seek_gen() */
+void sxpi_filtering_set_seek_gen(struct filtering_ctx *ctx, const atomic_int *seek_gen);
+
+/*
+ * Do not fill the out queue beyond the number of frames in depth, which may be
+ * changed at any time below the capacity of the queue. The time spent
+ * producing the frames is reported into frame_time: it is the time between
+ * two frames ready to be sent (excluding the time waiting for the sink), as a
+ * peak decaying over the next frames. Must be called before the filtering
+ * runs.
+ */
+void sxpi_filtering_set_sink_depth(struct filtering_ctx *ctx, const atomic_int *depth, atomic_llong *frame_time);
+
+/* See sxpi_demuxing_set_budget() */
+void sxpi_filtering_set_budget(struct filtering_ctx *ctx, struct membudget *budget);
+
+/*
+ * Wake up of the filtering parked on a frame refused by the frame callback, or
+ * on a sink filled up to its depth (see sxpi_filtering_set_sink_depth()). It
+ * must be signaled when the callback is ready again, when a frame is taken
+ * from the sink, and after a seek is requested; in non-blocking mode, the step
+ * must also be run again. Must be called before the filtering runs.
+ */
+void sxpi_filtering_set_wakeup(struct filtering_ctx *ctx, struct wakeup *wakeup);
+
+/* Stop waiting for a busy frame callback, so the filtering can be joined */
+void sxpi_filtering_abort(struct filtering_ctx *ctx);
+
 void sxpi_filtering_free(struct filtering_ctx **ctxp);
 
 #endif
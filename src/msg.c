@@ -24,23 +24,33 @@
 
 #include "msg.h"
 
+static void uncharge(struct message *msg)
+{
+    if (msg->budget)
+        sxpi_membudget_release(msg->budget, msg->charge);
+    msg->budget = NULL;
+    msg->charge = 0;
+}
+
 void sxpi_msg_free_data(void *arg)
 {
     struct message *msg = arg;
 
+    uncharge(msg);
+
     switch (msg->type) {
     case MSG_FRAME: {
         AVFrame *frame = msg->data;
-        av_frame_free(&frame);
+        sxpi_framepool_release_frame(msg->pool, &frame);
         msg->data = NULL;
         break;
     }
     case MSG_PACKET:
-        av_packet_unref(msg->data);
-        av_freep(&msg->data);
+        av_packet_unref(&msg->pkt);
         break;
     case MSG_SEEK:
     case MSG_INFO:
+    case MSG_INFO_CB:
         av_freep(&msg->data);
         break;
     case MSG_START:
@@ -51,3 +61,70 @@ void sxpi_msg_free_data(void *arg)
         av_assert0(0);
     }
 }
+
+int64_t sxpi_msg_get_size(const struct message *msg)
+{
+    int64_t size = 0;
+
+    if (msg->type == MSG_PACKET) {
+        size = msg->pkt.size;
+    } else if (msg->type == MSG_FRAME) {
+        const AVFrame *frame = msg->data;
+        for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+            size += frame->buf[i]->size;
+        for (int i = 0; i < frame->nb_extended_buf; i++)
+            size += frame->extended_buf[i]->size;
+    }
+    return size;
+}
+
+static int get_err_send(void *arg)
+{
+    return sxpi_msgqueue_get_err_send(arg);
+}
+
+int sxpi_msg_send(struct msgqueue *q, struct membudget *budget, struct message *msg, int flags)
+{
+    msg->budget = NULL;
+    msg->charge = 0;
+
+    if (budget) {
+        const int64_t size = sxpi_msg_get_size(msg);
+        if (size) {
+            const int ret = (flags & AV_THREAD_MESSAGE_NONBLOCK)
+                          ? sxpi_membudget_charge(budget, size, !sxpi_membudget_get_used(budget))
+                          : sxpi_membudget_charge_wait(budget, size, get_err_send, q);
+            if (ret < 0)
+                return ret;
+            msg->budget = budget;
+            msg->charge = size;
+        }
+    }
+
+    int ret = sxpi_msgqueue_send(q, msg, flags);
+    if (ret < 0)
+        uncharge(msg);
+    return ret;
+}
+
+void sxpi_msg_set_err_send(struct msgqueue *q, int err)
+{
+    sxpi_msgqueue_set_err_send(q, err);
+    sxpi_membudget_wake();
+}
+
+int sxpi_msg_recv(struct msgqueue *q, struct message *msg, int flags)
+{
+    int ret = sxpi_msgqueue_recv(q, msg, flags);
+    if (ret >= 0)
+        uncharge(msg);
+    return ret;
+}
+
+int sxpi_msg_recv_deadline(struct msgqueue *q, struct message *msg, int64_t deadline)
+{
+    int ret = sxpi_msgqueue_recv_deadline(q, msg, deadline);
+    if (ret >= 0)
+        uncharge(msg);
+    return ret;
+}
@@ -21,6 +21,14 @@
 #ifndef MSG_H
 #define MSG_H
 
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/threadmessage.h>
+
+#include "framepool.h"
+#include "membudget.h"
+#include "msgqueue.h"
+
 enum msg_type {
     MSG_FRAME,
     MSG_PACKET,
@@ -29,14 +37,57 @@ enum msg_type {
     MSG_START,
     MSG_STOP,
     MSG_SYNC,
+    MSG_INFO_CB,
     NB_MSG
 };
 
+/*
+ * The packets are stored in the message itself (and thus in the queue slots)
+ * rather than behind data, so demuxing does not allocate anything per packet.
+ */
 struct message {
-    void *data;
+    void *data;                             // NULL for a MSG_PACKET
+    AVPacket pkt;                           // data of a MSG_PACKET
     enum msg_type type;
+    struct membudget *budget;               // budget of the queue holding the message, NULL if not charged
+    int64_t charge;                         // bytes charged to the budget
+    struct framepool *pool;                 // pool the frame container goes back to when freed, NULL if none
+};
+
+enum seek_mode {
+    SEEK_MODE_PRECISE,                      // drop the frames preceding the requested time
+    SEEK_MODE_KEYFRAME,                     // deliver every frame from the keyframe preceding the requested time
+    SEEK_MODE_PROGRESSIVE,                  // deliver the keyframe preceding the requested time, then proceed as precise
+};
+
+/* Data of a MSG_SEEK message */
+struct seek_request {
+    int64_t ts;                             // requested time in AV_TIME_BASE unit
+    enum seek_mode mode;
+    int gen;                                // seek generation the modules work for after this seek
 };
 
 void sxpi_msg_free_data(void *arg);
 
+/*
+ * Send a message to a queue bounded by the bytes of its packets and frames
+ * in budget (can be NULL). The budget is ignored while the queue holds no
+ * packet or frame, so it always accepts at least one. Without
+ * AV_THREAD_MESSAGE_NONBLOCK, this waits for the budget to be available.
+ */
+int sxpi_msg_send(struct msgqueue *q, struct membudget *budget, struct message *msg, int flags);
+
+/* Same as sxpi_msgqueue_set_err_send(), also aborting a sxpi_msg_send()
+ * waiting for the budget */
+void sxpi_msg_set_err_send(struct msgqueue *q, int err);
+
+/* Receive a message from a queue, releasing its charge */
+int sxpi_msg_recv(struct msgqueue *q, struct message *msg, int flags);
+
+/* Same as sxpi_msg_recv(), waiting at most until the deadline */
+int sxpi_msg_recv_deadline(struct msgqueue *q, struct message *msg, int64_t deadline);
+
+/* Bytes of the packet or frame buffers of the message */
+int64_t sxpi_msg_get_size(const struct message *msg);
+
 #endif
@@ -0,0 +1,293 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/threadmessage.h>
+#include <libavutil/time.h>
+
+#include "msgqueue.h"
+#include "pthread_compat.h"
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * The head and tail are message counters (not indexes), so the ring is empty
+ * when they are equal. Each of them lives on its own cache line since they
+ * are written from different cores.
+ *
+ * The flushed messages keep their slot until the consumer frees them, so the
+ * ring has twice the slots of the queue: after a flush, the producer can
+ * queue new messages right away, without waiting for the consumer.
+ */
+struct msgqueue {
+    uint8_t *elems;
+    unsigned nb_elems;                      // capacity of the queue
+    unsigned nb_slots;                      // capacity of the ring
+    unsigned elem_size;
+    void (*free_func)(void *msg);
+
+    atomic_int err_send;
+    atomic_int err_recv;
+    atomic_ullong flush_tail;               // the messages before are to be dropped by the consumer
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond_send;               // signaled when the ring stops being full, or on error
+    pthread_cond_t cond_recv;               // signaled when the ring stops being empty, or on error
+    atomic_int send_waiting;
+    atomic_int recv_waiting;
+
+    char pad0[CACHE_LINE_SIZE];
+    atomic_ullong head;                     // written by the consumer
+    char pad1[CACHE_LINE_SIZE - sizeof(atomic_ullong)];
+    atomic_ullong tail;                     // written by the producer
+    char pad2[CACHE_LINE_SIZE - sizeof(atomic_ullong)];
+};
+
+int sxpi_msgqueue_alloc(struct msgqueue **qp, unsigned nb_elems, unsigned elem_size)
+{
+    struct msgqueue *q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->elems = av_malloc_array(2 * nb_elems, elem_size);
+    if (!q->elems) {
+        av_freep(&q);
+        return AVERROR(ENOMEM);
+    }
+    q->nb_elems  = nb_elems;
+    q->nb_slots  = 2 * nb_elems;
+    q->elem_size = elem_size;
+    atomic_init(&q->err_send, 0);
+    atomic_init(&q->err_recv, 0);
+    atomic_init(&q->flush_tail, 0);
+    atomic_init(&q->send_waiting, 0);
+    atomic_init(&q->recv_waiting, 0);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond_send, NULL);
+    pthread_cond_init(&q->cond_recv, NULL);
+    *qp = q;
+    return 0;
+}
+
+void sxpi_msgqueue_set_free_func(struct msgqueue *q, void (*free_func)(void *msg))
+{
+    q->free_func = free_func;
+}
+
+static uint8_t *get_elem(const struct msgqueue *q, uint64_t pos)
+{
+    return q->elems + (pos % q->nb_slots) * q->elem_size;
+}
+
+/*
+ * The flag is set before checking the ring again, and the other side updates
+ * the ring before checking the flag (both sequentially consistent), so either
+ * the waiting side sees the update or the updating side sees the flag. The
+ * signal is sent under the lock so it can not be missed between the check
+ * and the wait.
+ */
+static void wake(struct msgqueue *q, atomic_int *waiting, pthread_cond_t *cond)
+{
+    if (!atomic_load(waiting))
+        return;
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void wake_all(struct msgqueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond_send);
+    pthread_cond_broadcast(&q->cond_recv);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static int can_send(struct msgqueue *q)
+{
+    const uint64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    const uint64_t head = atomic_load(&q->head);
+    const uint64_t flush_tail = atomic_load(&q->flush_tail);
+    return tail - FFMAX(head, flush_tail) < q->nb_elems && tail - head < q->nb_slots;
+}
+
+int sxpi_msgqueue_send(struct msgqueue *q, void *msg, unsigned flags)
+{
+    int err;
+
+    while (!(err = atomic_load(&q->err_send)) && !can_send(q)) {
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+        pthread_mutex_lock(&q->lock);
+        atomic_store(&q->send_waiting, 1);
+        if (!atomic_load(&q->err_send) && !can_send(q))
+            pthread_cond_wait(&q->cond_send, &q->lock);
+        atomic_store(&q->send_waiting, 0);
+        pthread_mutex_unlock(&q->lock);
+    }
+    if (err)
+        return err;
+
+    const uint64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    memcpy(get_elem(q, tail), msg, q->elem_size);
+    atomic_store(&q->tail, tail + 1);
+    wake(q, &q->recv_waiting, &q->cond_recv);
+    return 0;
+}
+
+/* Drop the messages flushed by another thread */
+static void skip_flushed(struct msgqueue *q)
+{
+    const uint64_t flush_tail = atomic_load(&q->flush_tail);
+    uint64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head >= flush_tail)
+        return;
+    for (; head < flush_tail; head++)
+        if (q->free_func)
+            q->free_func(get_elem(q, head));
+    atomic_store(&q->head, head);
+    wake(q, &q->send_waiting, &q->cond_send);
+}
+
+static int can_recv(struct msgqueue *q)
+{
+    return atomic_load(&q->tail) != atomic_load_explicit(&q->head, memory_order_relaxed);
+}
+
+/*
+ * The condition variables use the realtime clock, so the deadline is
+ * converted using the time remaining until it
+ */
+static void wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline)
+{
+    if (deadline == AV_NOPTS_VALUE) {
+        pthread_cond_wait(cond, lock);
+        return;
+    }
+
+    const int64_t remaining = deadline - av_gettime_relative();
+    if (remaining <= 0)
+        return;
+
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    const int64_t nsec = ts.tv_nsec + remaining % 1000000 * 1000;
+    ts.tv_sec += remaining / 1000000 + nsec / 1000000000;
+    ts.tv_nsec = nsec % 1000000000;
+    pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static int recv_until(struct msgqueue *q, void *msg, unsigned flags, int64_t deadline)
+{
+    skip_flushed(q);
+    while (!can_recv(q)) {
+        const int err = atomic_load(&q->err_recv);
+        if (err)
+            return err;
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+        if (deadline != AV_NOPTS_VALUE && av_gettime_relative() >= deadline)
+            return AVERROR(EAGAIN);
+        pthread_mutex_lock(&q->lock);
+        atomic_store(&q->recv_waiting, 1);
+        if (!atomic_load(&q->err_recv) && !can_recv(q))
+            wait_until(&q->cond_recv, &q->lock, deadline);
+        atomic_store(&q->recv_waiting, 0);
+        pthread_mutex_unlock(&q->lock);
+        skip_flushed(q);
+    }
+
+    const uint64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    memcpy(msg, get_elem(q, head), q->elem_size);
+    atomic_store(&q->head, head + 1);
+    wake(q, &q->send_waiting, &q->cond_send);
+    return 0;
+}
+
+int sxpi_msgqueue_recv(struct msgqueue *q, void *msg, unsigned flags)
+{
+    return recv_until(q, msg, flags, AV_NOPTS_VALUE);
+}
+
+int sxpi_msgqueue_recv_deadline(struct msgqueue *q, void *msg, int64_t deadline)
+{
+    return recv_until(q, msg, 0, deadline);
+}
+
+void sxpi_msgqueue_set_err_send(struct msgqueue *q, int err)
+{
+    atomic_store(&q->err_send, err);
+    wake_all(q);
+}
+
+void sxpi_msgqueue_set_err_recv(struct msgqueue *q, int err)
+{
+    atomic_store(&q->err_recv, err);
+    wake_all(q);
+}
+
+int sxpi_msgqueue_get_err_send(struct msgqueue *q)
+{
+    return atomic_load(&q->err_send);
+}
+
+int sxpi_msgqueue_nb_elems(struct msgqueue *q)
+{
+    const uint64_t tail = atomic_load(&q->tail);
+    const uint64_t head = FFMAX(atomic_load(&q->head), atomic_load(&q->flush_tail));
+    return tail > head ? tail - head : 0;
+}
+
+void sxpi_msgqueue_flush(struct msgqueue *q)
+{
+    /* Concurrent flushes must not move the mark backward */
+    const uint64_t tail = atomic_load(&q->tail);
+    uint64_t flush_tail = atomic_load(&q->flush_tail);
+    while (flush_tail < tail && !atomic_compare_exchange_weak(&q->flush_tail, &flush_tail, tail));
+    wake(q, &q->send_waiting, &q->cond_send);
+    wake(q, &q->recv_waiting, &q->cond_recv);
+}
+
+void sxpi_msgqueue_drain(struct msgqueue *q)
+{
+    sxpi_msgqueue_flush(q);
+    skip_flushed(q);
+}
+
+void sxpi_msgqueue_free(struct msgqueue **qp)
+{
+    struct msgqueue *q = *qp;
+    if (!q)
+        return;
+    sxpi_msgqueue_drain(q);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond_send);
+    pthread_cond_destroy(&q->cond_recv);
+    av_freep(&q->elems);
+    av_freep(qp);
+}
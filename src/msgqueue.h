@@ -0,0 +1,75 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef MSGQUEUE_H
+#define MSGQUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Bounded queue of fixed size messages between a single producer and a single
+ * consumer, with the same semantics as AVThreadMessageQueue (including
+ * AV_THREAD_MESSAGE_NONBLOCK and the send/recv errors).
+ *
+ * The messages are copied into a ring without taking any lock: the producer
+ * only writes the tail and the consumer only writes the head. A lock is only
+ * taken to sleep, when the ring is empty (or full) in blocking mode, and to
+ * wake the other side when it is known to be sleeping. A consumer woken up
+ * consequently receives all the messages queued since, without any further
+ * synchronization.
+ *
+ * Either side can be handed over to another thread, as long as the calls of
+ * that side are serialized. The other functions can be called from any
+ * thread. Flushing from any other thread than the consumer only marks the
+ * queued messages as dropped: the consumer frees them the next time it
+ * receives, and sxpi_msgqueue_drain() frees them once the consumer is known
+ * to be idle.
+ */
+
+struct msgqueue;
+
+int sxpi_msgqueue_alloc(struct msgqueue **qp, unsigned nb_elems, unsigned elem_size);
+void sxpi_msgqueue_set_free_func(struct msgqueue *q, void (*free_func)(void *msg));
+
+int sxpi_msgqueue_send(struct msgqueue *q, void *msg, unsigned flags);
+int sxpi_msgqueue_recv(struct msgqueue *q, void *msg, unsigned flags);
+
+/*
+ * Blocking receive giving up with AVERROR(EAGAIN) once the deadline (absolute
+ * time in the av_gettime_relative() reference) is reached
+ */
+int sxpi_msgqueue_recv_deadline(struct msgqueue *q, void *msg, int64_t deadline);
+
+void sxpi_msgqueue_set_err_send(struct msgqueue *q, int err);
+void sxpi_msgqueue_set_err_recv(struct msgqueue *q, int err);
+int sxpi_msgqueue_get_err_send(struct msgqueue *q);
+
+/* Number of messages queued, excluding the flushed ones */
+int sxpi_msgqueue_nb_elems(struct msgqueue *q);
+
+void sxpi_msgqueue_flush(struct msgqueue *q);
+
+/* Free the queued messages, while no thread is receiving */
+void sxpi_msgqueue_drain(struct msgqueue *q);
+
+void sxpi_msgqueue_free(struct msgqueue **qp);
+
+#endif
@@ -21,6 +21,7 @@
 #ifndef OPTS_H
 #define OPTS_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 struct sxplayer_opts {
@@ -38,6 +39,7 @@ struct sxplayer_opts {
     int autorotate;                         // switch for automatically rotate in software decoding
     int auto_hwaccel;                       // attempt to enable hardware acceleration
     int export_mvs;                         // export motion vectors into frame->mvs
+    int export_mvs_grid;                    // export a per-macroblock motion grid into frame->mvs_dx/mvs_dy
     int pkt_skip_mod;                       // skip packet if module pkt_skip_mod (and not a key pkt)
     int thread_stack_size;
     void *opaque;                           // pointer to an opaque pointer forwarded to the decoder
@@ -47,10 +49,36 @@ struct sxplayer_opts {
     char *vt_pix_fmt;                       // VideoToolbox pixel format in the CVPixelBufferRef
     int stream_idx;
     int use_pkt_duration;
+    int reverse;                            // serve the backward requests from a window of decoded frames
+    int max_nb_reverse_frames;              // maximum number of frames in the reverse playback window
+    int frame_cache_size;                   // maximum size of the frame cache in MB (0 to disable)
+    int index_scan;                         // scan the packets in the background when the demuxer has no index
+    char *index_cache_dir;                  // directory of the sidecar files (NULL to disable)
+    int keyframes_only;                     // demux and decode the keyframes only
+    void *pool;                             // pointer to a struct sxplayer_pool pointer (NULL for dedicated threads)
+    int pool_size;                          // pool pointer size
+    int probesize;                          // maximum number of bytes read to probe the media (0 for the FFmpeg default)
+    double analyzeduration;                 // maximum duration of the media analyzed when probing (0 for the FFmpeg default)
+    int fast_open;                          // trust the container headers when they describe the stream
+    int probe_cache;                        // share the probing results with the other contexts opening the same media
+    double playback_rate;                   // see public header
+    double display_rate;                    // frequency at which the frames are presented (0 for the media frame rate)
+    int seek_mode;                          // frames delivered after a seek (see SXPLAYER_SEEK_*)
+    int adaptive_prefetch;                  // adapt the number of frames in the filtered queue to the decoding time
+    double prefetch_duration;               // number of frames in the filtered queue expressed in seconds (0 to disable)
+    int max_nb_prefetch;                    // maximum number of frames in the filtered queue when prefetching
+    int max_packets_bytes;                  // maximum bytes of packets in the queue (0 for unlimited)
+    int max_frames_bytes;                   // maximum bytes of frames in the queue (0 for unlimited)
+    int max_sink_bytes;                     // maximum bytes of frames in the filtered queue (0 for unlimited)
+    int budget_policy;                      // behaviour of the decoder when the memory budget is exhausted (see SXPLAYER_BUDGET_*)
+    int pipeline_layout;                    // scheduling of the decoding and filtering (see SXPLAYER_PIPELINE_*)
 
     int64_t start_time64;
     int64_t end_time64;
     int64_t dist_time_seek_trigger64;
+
+    atomic_int drop_ref;                    // skip non reference frames while catching up (see sxplayer_set_drop_ref())
+    _Atomic(double) cur_playback_rate;      // playback rate in use (see sxplayer_set_playback_rate())
 };
 
 #endif
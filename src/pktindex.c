@@ -0,0 +1,467 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "pktindex.h"
+#include "pthread_compat.h"
+#include "sidecar.h"
+#include "workpool.h"
+
+/* Fixed cost of a seek (flushing the pipeline, seeking in the demuxer and
+ * restarting the decoder), expressed as a number of average packets */
+#define SEEK_COST_NB_PACKETS 8
+
+#define SCAN_TASK_NB_PACKETS 256            // number of packets a scan task reads before yielding
+
+struct pktindex {
+    void *log_ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                    // signaled when the index grows or the scan ends
+
+    struct pktindex_entry *entries;         // sorted by ascending ts
+    int nb_entries;
+    int nb_allocated;
+    int64_t nb_keyframes;
+    int64_t total_size;
+    int64_t covered_ts;                     // highest ts indexed so far
+    int complete;
+
+    char *filename;
+    int stream_idx;
+    struct sidecar *sidecar;
+    AVFormatContext *fmt_ctx;               // scanned file, NULL until opened
+    pthread_t scan_tid;
+    struct workpool_task *scan_task;        // scan running on a pool instead of a thread
+    int scan_started;
+    int scanning;                           // the scan may still extend the index (protected by the lock)
+    atomic_int abort_request;
+};
+
+struct pktindex *sxpi_pktindex_alloc(void *log_ctx)
+{
+    struct pktindex *idx = av_mallocz(sizeof(*idx));
+    if (!idx)
+        return NULL;
+    if (pthread_mutex_init(&idx->lock, NULL)) {
+        av_free(idx);
+        return NULL;
+    }
+    if (pthread_cond_init(&idx->cond, NULL)) {
+        pthread_mutex_destroy(&idx->lock);
+        av_free(idx);
+        return NULL;
+    }
+    idx->log_ctx = log_ctx;
+    idx->covered_ts = INT64_MIN;
+    atomic_init(&idx->abort_request, 0);
+    return idx;
+}
+
+void sxpi_pktindex_free(struct pktindex **idxp)
+{
+    struct pktindex *idx = *idxp;
+    if (!idx)
+        return;
+    if (idx->scan_started) {
+        atomic_store(&idx->abort_request, 1);
+        if (idx->scan_task) {
+            sxpi_workpool_task_wake(idx->scan_task);
+            sxpi_workpool_task_wait(idx->scan_task);
+        } else {
+            pthread_join(idx->scan_tid, NULL);
+        }
+    }
+    sxpi_workpool_task_free(&idx->scan_task);
+    pthread_cond_destroy(&idx->cond);
+    pthread_mutex_destroy(&idx->lock);
+    av_freep(&idx->entries);
+    av_freep(&idx->filename);
+    av_freep(idxp);
+}
+
+static int grow_entries(struct pktindex *idx, int nb_entries)
+{
+    if (nb_entries <= idx->nb_allocated)
+        return 0;
+    const int nb_allocated = FFMAX(nb_entries, idx->nb_allocated ? idx->nb_allocated * 2 : 256);
+    struct pktindex_entry *entries = av_realloc_array(idx->entries, nb_allocated, sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    idx->entries = entries;
+    idx->nb_allocated = nb_allocated;
+    return 0;
+}
+
+int sxpi_pktindex_add(struct pktindex *idx, int64_t ts, int size, int key)
+{
+    pthread_mutex_lock(&idx->lock);
+
+    int ret = grow_entries(idx, idx->nb_entries + 1);
+    if (ret < 0)
+        goto end;
+
+    /* The packets come in decoding order, so only the few ones reordered
+     * (B-frames) are not appended at the end */
+    int pos = idx->nb_entries;
+    while (pos > 0 && idx->entries[pos - 1].ts > ts)
+        pos--;
+    struct pktindex_entry *entry = &idx->entries[pos];
+    memmove(entry + 1, entry, (idx->nb_entries - pos) * sizeof(*entry));
+    entry->ts   = ts;
+    entry->size = size;
+    entry->key  = !!key;
+    idx->nb_entries++;
+    idx->nb_keyframes += entry->key;
+    idx->total_size += size;
+    idx->covered_ts = FFMAX(idx->covered_ts, ts);
+    pthread_cond_broadcast(&idx->cond);
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+/* The entries must be sorted and follow the existing ones */
+int sxpi_pktindex_add_entries(struct pktindex *idx, const struct pktindex_entry *entries, int nb_entries)
+{
+    pthread_mutex_lock(&idx->lock);
+
+    int ret = grow_entries(idx, idx->nb_entries + nb_entries);
+    if (ret < 0)
+        goto end;
+
+    memcpy(idx->entries + idx->nb_entries, entries, nb_entries * sizeof(*entries));
+    idx->nb_entries += nb_entries;
+    for (int i = 0; i < nb_entries; i++) {
+        idx->nb_keyframes += !!entries[i].key;
+        idx->total_size += entries[i].size;
+    }
+    if (nb_entries)
+        idx->covered_ts = FFMAX(idx->covered_ts, entries[nb_entries - 1].ts);
+    pthread_cond_broadcast(&idx->cond);
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+int sxpi_pktindex_get_entries(struct pktindex *idx, struct pktindex_entry **entriesp, int *nb_entriesp)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&idx->lock);
+    if (!idx->complete) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+    *entriesp = av_memdup(idx->entries, idx->nb_entries * sizeof(*idx->entries));
+    if (!*entriesp && idx->nb_entries) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    *nb_entriesp = idx->nb_entries;
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+void sxpi_pktindex_set_complete(struct pktindex *idx)
+{
+    pthread_mutex_lock(&idx->lock);
+    idx->complete = 1;
+    pthread_cond_broadcast(&idx->cond);
+    pthread_mutex_unlock(&idx->lock);
+}
+
+static int scan_interrupt_cb(void *arg)
+{
+    struct pktindex *idx = arg;
+    return atomic_load(&idx->abort_request);
+}
+
+static int open_scan(struct pktindex *idx)
+{
+    AVFormatContext *fmt_ctx = avformat_alloc_context();
+    if (!fmt_ctx)
+        return AVERROR(ENOMEM);
+    fmt_ctx->interrupt_callback.callback = scan_interrupt_cb;
+    fmt_ctx->interrupt_callback.opaque   = idx;
+
+    /* Only the packets layout is needed, so the streams are not probed */
+    int ret = avformat_open_input(&fmt_ctx, idx->filename, NULL, NULL);
+    if (ret < 0)
+        return ret;
+    idx->fmt_ctx = fmt_ctx;
+    if (idx->stream_idx >= fmt_ctx->nb_streams)
+        return AVERROR_STREAM_NOT_FOUND;
+    for (int i = 0; i < fmt_ctx->nb_streams; i++)
+        if (i != idx->stream_idx)
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    return 0;
+}
+
+/* Read up to nb_packets packets, opening the file first if needed. Return 0
+ * if the scan is to be continued, or the error ending it (AVERROR_EOF once
+ * complete). */
+static int scan_packets(struct pktindex *idx, int nb_packets)
+{
+    if (!idx->fmt_ctx) {
+        int ret = open_scan(idx);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (int i = 0; i < nb_packets; i++) {
+        AVPacket pkt;
+
+        int ret = av_read_frame(idx->fmt_ctx, &pkt);
+        if (ret < 0)
+            return ret;
+
+        const int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+        if (pkt.stream_index == idx->stream_idx && ts != AV_NOPTS_VALUE)
+            ret = sxpi_pktindex_add(idx, ts, pkt.size, pkt.flags & AV_PKT_FLAG_KEY);
+        av_packet_unref(&pkt);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static void end_scan(struct pktindex *idx, int ret)
+{
+    if (ret == AVERROR_EOF) {
+        sxpi_pktindex_set_complete(idx);
+        LOG(idx, INFO, "Packet scan complete: %d packets, %"PRId64" keyframes",
+            idx->nb_entries, idx->nb_keyframes);
+        if (idx->sidecar)
+            sxpi_sidecar_write(idx->sidecar, idx);
+    } else if (ret != AVERROR_EXIT) {
+        LOG(idx, WARNING, "Packet scan interrupted: %s", av_err2str(ret));
+    }
+    avformat_close_input(&idx->fmt_ctx);
+
+    pthread_mutex_lock(&idx->lock);
+    idx->scanning = 0;
+    pthread_cond_broadcast(&idx->cond);
+    pthread_mutex_unlock(&idx->lock);
+}
+
+static void *scan_thread(void *arg)
+{
+    struct pktindex *idx = arg;
+    int ret;
+
+    sxpi_set_thread_name("sxp/index");
+
+    while (!(ret = scan_packets(idx, INT_MAX)));
+    end_scan(idx, ret);
+    return NULL;
+}
+
+static enum workpool_status scan_task_func(void *arg)
+{
+    struct pktindex *idx = arg;
+    const int ret = atomic_load(&idx->abort_request) ? AVERROR_EXIT
+                  : scan_packets(idx, SCAN_TASK_NB_PACKETS);
+    if (!ret)
+        return WORKPOOL_TASK_AGAIN;
+    end_scan(idx, ret);
+    return WORKPOOL_TASK_DONE;
+}
+
+int sxpi_pktindex_start_scan(struct pktindex *idx, const char *filename, int stream_idx,
+                             struct sidecar *sidecar, struct workpool *workpool)
+{
+    if (idx->scan_started)
+        return 0;
+
+    idx->filename = av_strdup(filename);
+    if (!idx->filename)
+        return AVERROR(ENOMEM);
+    idx->stream_idx = stream_idx;
+    idx->sidecar = sidecar;
+
+    pthread_mutex_lock(&idx->lock);
+    idx->scanning = 1;
+    pthread_mutex_unlock(&idx->lock);
+
+    if (workpool) {
+        idx->scan_task = sxpi_workpool_task_alloc_blocking(workpool, scan_task_func, idx);
+        if (!idx->scan_task) {
+            end_scan(idx, AVERROR(ENOMEM));
+            return AVERROR(ENOMEM);
+        }
+        sxpi_workpool_task_start(idx->scan_task);
+        idx->scan_started = 1;
+        return 0;
+    }
+
+    int ret = pthread_create(&idx->scan_tid, NULL, scan_thread, idx);
+    if (ret) {
+        ret = AVERROR(ret);
+        LOG(idx, ERROR, "Unable to start packet scan thread: %s", av_err2str(ret));
+        end_scan(idx, ret);
+        return ret;
+    }
+    idx->scan_started = 1;
+    return 0;
+}
+
+/* Index of the first entry with a timestamp strictly greater than ts */
+static int upper_bound(const struct pktindex *idx, int64_t ts)
+{
+    int lo = 0, hi = idx->nb_entries;
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (idx->entries[mid].ts <= ts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int sxpi_pktindex_should_seek(struct pktindex *idx, int64_t cur, int64_t target, int keyframes_only)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&idx->lock);
+
+    if (!idx->nb_entries || (!idx->complete && target >= idx->covered_ts)) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+
+    /* Find the keyframe a seek to target would land on */
+    const int start = upper_bound(idx, cur);
+    int key_pos = upper_bound(idx, target) - 1;
+    while (key_pos >= start && !idx->entries[key_pos].key)
+        key_pos--;
+    if (key_pos < start)
+        goto end;
+
+    /* Decoding up to the keyframe is what the seek saves */
+    const int64_t seek_cost = SEEK_COST_NB_PACKETS * idx->total_size / idx->nb_entries;
+    int64_t decode_cost = 0;
+    for (int i = start; i < key_pos && decode_cost <= seek_cost; i++)
+        if (!keyframes_only || idx->entries[i].key)
+            decode_cost += idx->entries[i].size;
+    ret = decode_cost > seek_cost;
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+int64_t sxpi_pktindex_get_prev_keyframe(struct pktindex *idx, int64_t ts)
+{
+    int64_t ret = AV_NOPTS_VALUE;
+
+    pthread_mutex_lock(&idx->lock);
+
+    while (!idx->complete && (ts == AV_NOPTS_VALUE || ts > idx->covered_ts)) {
+        if (!idx->scanning)
+            goto end;
+        pthread_cond_wait(&idx->cond, &idx->lock);
+    }
+
+    int pos = ts == AV_NOPTS_VALUE ? idx->nb_entries : upper_bound(idx, ts - 1);
+    while (--pos >= 0) {
+        if (idx->entries[pos].key) {
+            ret = idx->entries[pos].ts;
+            break;
+        }
+    }
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+int64_t sxpi_pktindex_snap_to_keyframe(struct pktindex *idx, int64_t ts)
+{
+    int64_t ret = AV_NOPTS_VALUE;
+
+    pthread_mutex_lock(&idx->lock);
+
+    if (!idx->nb_entries || (!idx->complete && ts >= idx->covered_ts))
+        goto end;
+
+    const int pos = upper_bound(idx, ts);
+    int prev = pos - 1;
+    while (prev >= 0 && !idx->entries[prev].key)
+        prev--;
+    int next = pos;
+    while (next < idx->nb_entries && !idx->entries[next].key)
+        next++;
+
+    if (next == idx->nb_entries) {
+        /* The next keyframe may not be scanned yet */
+        if (idx->complete)
+            ret = ts;
+        goto end;
+    }
+
+    const int64_t next_ts = idx->entries[next].ts;
+    if (prev >= 0 && ts - idx->entries[prev].ts <= next_ts - ts) {
+        ret = ts;
+        goto end;
+    }
+
+    /* Aim at the middle of the GOP starting with the next keyframe */
+    int after = next + 1;
+    while (after < idx->nb_entries && !idx->entries[after].key)
+        after++;
+    const int64_t gop_duration = after < idx->nb_entries ? idx->entries[after].ts - next_ts
+                               : prev >= 0             ? next_ts - idx->entries[prev].ts
+                               : 0;
+    ret = next_ts + gop_duration / 2;
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+int sxpi_pktindex_get_stats(struct pktindex *idx, int64_t *nb_frames,
+                            int64_t *nb_keyframes, double *avg_gop_length)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&idx->lock);
+    if (!idx->complete) {
+        ret = AVERROR(EAGAIN);
+    } else {
+        *nb_frames      = idx->nb_entries;
+        *nb_keyframes   = idx->nb_keyframes;
+        *avg_gop_length = idx->nb_keyframes ? idx->nb_entries / (double)idx->nb_keyframes : 0;
+    }
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef PKTINDEX_H
+#define PKTINDEX_H
+
+#include <stdint.h>
+
+/*
+ * Index of the packets of the selected stream: presentation timestamp (stream
+ * time base unit), size and key flag of each of them.
+ *
+ * The index is either filled at once from the demuxer index, or
+ * progressively by a scan running in the background, in which case the
+ * queries only succeed for the part of the stream covered so far. All the
+ * functions are thread safe.
+ */
+
+struct pktindex;
+struct sidecar;
+struct workpool;
+
+/* Also the on-disk layout of the sidecar index entries */
+struct pktindex_entry {
+    int64_t ts;
+    int32_t size;
+    int32_t key;
+};
+
+struct pktindex *sxpi_pktindex_alloc(void *log_ctx);
+void sxpi_pktindex_free(struct pktindex **idxp);
+
+int sxpi_pktindex_add(struct pktindex *idx, int64_t ts, int size, int key);
+int sxpi_pktindex_add_entries(struct pktindex *idx, const struct pktindex_entry *entries, int nb_entries);
+void sxpi_pktindex_set_complete(struct pktindex *idx);
+
+/*
+ * Get a copy of the entries of a complete index (to be freed with
+ * av_free()). Return AVERROR(EAGAIN) if the index is not complete.
+ */
+int sxpi_pktindex_get_entries(struct pktindex *idx, struct pktindex_entry **entriesp, int *nb_entriesp);
+
+/*
+ * Start scanning the packets of the stream stream_idx of the specified file
+ * in the background, as a task of workpool or in a dedicated thread if it is
+ * NULL. The scan is aborted when the index is freed. If sidecar is not NULL,
+ * the index is saved into it once the scan is complete.
+ */
+int sxpi_pktindex_start_scan(struct pktindex *idx, const char *filename, int stream_idx,
+                             struct sidecar *sidecar, struct workpool *workpool);
+
+/*
+ * Tell if reaching the frame at target from the frame at cur is cheaper with
+ * a seek than by decoding all the packets in between: that is the case when
+ * a keyframe lies in (cur, target] and the packets before it represent more
+ * than the seek cost. In keyframes only mode, only the key packets count.
+ * Return AVERROR(EAGAIN) if the index does not cover target yet.
+ */
+int sxpi_pktindex_should_seek(struct pktindex *idx, int64_t cur, int64_t target, int keyframes_only);
+
+/*
+ * Get a timestamp at which the keyframe the closest to ts is displayed, when
+ * only the keyframes are decoded: the middle of its GOP, so that the
+ * keyframe is selected even if its timestamp is slightly off. Return
+ * AV_NOPTS_VALUE if the index does not cover ts yet.
+ */
+int64_t sxpi_pktindex_snap_to_keyframe(struct pktindex *idx, int64_t ts);
+
+/*
+ * Get the timestamp of the last keyframe displayed strictly before ts, or of
+ * the last keyframe of the stream if ts is AV_NOPTS_VALUE. While a scan is
+ * running, this waits for it to index that part of the stream. Return
+ * AV_NOPTS_VALUE if the index can not tell.
+ */
+int64_t sxpi_pktindex_get_prev_keyframe(struct pktindex *idx, int64_t ts);
+
+/*
+ * Get the number of frames, number of keyframes and average GOP length (in
+ * frames) of the stream. Return AVERROR(EAGAIN) until the index is complete.
+ */
+int sxpi_pktindex_get_stats(struct pktindex *idx, int64_t *nb_frames,
+                            int64_t *nb_keyframes, double *avg_gop_length);
+
+#endif
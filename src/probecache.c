@@ -0,0 +1,206 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "pthread_compat.h"
+#include "probecache.h"
+
+#define PROBECACHE_MAX_ENTRIES 32
+
+struct probecache_entry {
+    struct probecache_entry *next;
+    char *filename;
+    int64_t media_size;
+    int64_t media_mtime;
+    enum AVMediaType media_type;
+    int requested_idx;                      // stream index requested by the user (-1 for the best one)
+    int nb_streams;
+    AVCodecParameters *par;
+    AVRational time_base;
+    AVRational avg_frame_rate;
+    AVRational r_frame_rate;
+    int64_t start_time;                     // stream start time, in stream time base
+    int64_t st_duration;                    // stream duration, in stream time base
+    int64_t fmt_start_time;                 // format start time, in AV_TIME_BASE
+    int64_t fmt_duration;                   // format duration, in AV_TIME_BASE
+    struct probe_result res;
+};
+
+/* Most recently used entry first */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct probecache_entry *cache_entries;
+
+static int get_media_stat(const char *filename, int64_t *size, int64_t *mtime)
+{
+    struct stat st;
+
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+        return 0;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
+
+static void free_entry(struct probecache_entry *entry)
+{
+    av_freep(&entry->filename);
+    avcodec_parameters_free(&entry->par);
+    av_free(entry);
+}
+
+/* Detach the entry matching the media and the stream selection, along with
+ * the outdated entries of the same media. Must be called with the lock held. */
+static struct probecache_entry *detach_entry(const char *filename, int64_t size, int64_t mtime,
+                                             enum AVMediaType media_type, int requested_idx)
+{
+    struct probecache_entry *found = NULL;
+    struct probecache_entry **entryp = &cache_entries;
+
+    while (*entryp) {
+        struct probecache_entry *entry = *entryp;
+        if (strcmp(entry->filename, filename)) {
+            entryp = &entry->next;
+            continue;
+        }
+        if (entry->media_size != size || entry->media_mtime != mtime) {
+            *entryp = entry->next;
+            free_entry(entry);
+            continue;
+        }
+        if (!found && entry->media_type == media_type && entry->requested_idx == requested_idx) {
+            *entryp = entry->next;
+            found = entry;
+            continue;
+        }
+        entryp = &entry->next;
+    }
+    return found;
+}
+
+/* Insert the entry in front and evict the least recently used ones beyond the
+ * cache capacity. Must be called with the lock held. */
+static void insert_entry(struct probecache_entry *entry)
+{
+    entry->next = cache_entries;
+    cache_entries = entry;
+
+    struct probecache_entry **entryp = &cache_entries;
+    for (int i = 0; *entryp && i < PROBECACHE_MAX_ENTRIES; i++)
+        entryp = &(*entryp)->next;
+    while (*entryp) {
+        struct probecache_entry *evicted = *entryp;
+        *entryp = evicted->next;
+        free_entry(evicted);
+    }
+}
+
+int sxpi_probecache_get(const char *filename, AVFormatContext *fmt_ctx,
+                        enum AVMediaType media_type, int stream_idx,
+                        struct probe_result *res)
+{
+    int64_t size, mtime;
+
+    if (!get_media_stat(filename, &size, &mtime))
+        return 0;
+
+    pthread_mutex_lock(&cache_lock);
+    struct probecache_entry *entry = detach_entry(filename, size, mtime, media_type, stream_idx);
+    if (!entry) {
+        pthread_mutex_unlock(&cache_lock);
+        return 0;
+    }
+
+    /* The headers read by avformat_open_input() must describe the same
+     * streams as when the media was probed */
+    AVStream *st = entry->res.stream_idx < fmt_ctx->nb_streams ? fmt_ctx->streams[entry->res.stream_idx] : NULL;
+    if (fmt_ctx->nb_streams != entry->nb_streams || !st ||
+        st->time_base.num != entry->time_base.num || st->time_base.den != entry->time_base.den) {
+        pthread_mutex_unlock(&cache_lock);
+        free_entry(entry);
+        return 0;
+    }
+
+    int ret = avcodec_parameters_copy(st->codecpar, entry->par);
+    if (ret >= 0) {
+        st->avg_frame_rate  = entry->avg_frame_rate;
+        st->r_frame_rate    = entry->r_frame_rate;
+        st->start_time      = entry->start_time;
+        st->duration        = entry->st_duration;
+        fmt_ctx->start_time = entry->fmt_start_time;
+        fmt_ctx->duration   = entry->fmt_duration;
+        *res = entry->res;
+        ret = 1;
+    }
+    insert_entry(entry);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+int sxpi_probecache_set(const char *filename, const AVFormatContext *fmt_ctx,
+                        enum AVMediaType media_type, int stream_idx,
+                        const struct probe_result *res)
+{
+    int64_t size, mtime;
+
+    if (!get_media_stat(filename, &size, &mtime))
+        return 0;
+
+    struct probecache_entry *entry = av_mallocz(sizeof(*entry));
+    if (!entry)
+        return AVERROR(ENOMEM);
+
+    const AVStream *st = fmt_ctx->streams[res->stream_idx];
+    entry->filename = av_strdup(filename);
+    entry->par = avcodec_parameters_alloc();
+    if (!entry->filename || !entry->par || avcodec_parameters_copy(entry->par, st->codecpar) < 0) {
+        free_entry(entry);
+        return AVERROR(ENOMEM);
+    }
+    entry->media_size     = size;
+    entry->media_mtime    = mtime;
+    entry->media_type     = media_type;
+    entry->requested_idx  = stream_idx;
+    entry->nb_streams     = fmt_ctx->nb_streams;
+    entry->time_base      = st->time_base;
+    entry->avg_frame_rate = st->avg_frame_rate;
+    entry->r_frame_rate   = st->r_frame_rate;
+    entry->start_time     = st->start_time;
+    entry->st_duration    = st->duration;
+    entry->fmt_start_time = fmt_ctx->start_time;
+    entry->fmt_duration   = fmt_ctx->duration;
+    entry->res            = *res;
+
+    /* Another context may have probed the same media concurrently, in which
+     * case its entry is replaced */
+    pthread_mutex_lock(&cache_lock);
+    struct probecache_entry *old = detach_entry(filename, size, mtime, media_type, stream_idx);
+    insert_entry(entry);
+    pthread_mutex_unlock(&cache_lock);
+
+    if (old)
+        free_entry(old);
+    return 0;
+}
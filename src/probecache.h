@@ -0,0 +1,57 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+#include <libavformat/avformat.h>
+
+/*
+ * Process-wide cache of the probing results of the local media, shared by all
+ * the contexts: when several contexts open the same file (typically its audio
+ * and video streams, or the same clip several times), only the first one
+ * probes it.
+ *
+ * Entries are keyed by the media path, size and modification time, and by
+ * the stream selection. The cache is bounded, the least recently used entries
+ * are evicted first.
+ */
+
+struct probe_result {
+    int stream_idx;                         // selected stream
+    double rotation;                        // rotation of the selected stream in degrees
+    int64_t duration;                       // probed duration in AV_TIME_BASE, or AV_NOPTS_VALUE
+};
+
+/*
+ * Set the cached parameters of the selected stream on the freshly opened
+ * fmt_ctx, instead of probing them, and fill the result. Return 1 on success,
+ * 0 if the media is not cached (or does not match the cached entry anymore).
+ */
+int sxpi_probecache_get(const char *filename, AVFormatContext *fmt_ctx,
+                        enum AVMediaType media_type, int stream_idx,
+                        struct probe_result *res);
+
+/* Save the parameters of the stream selected in the probed fmt_ctx */
+int sxpi_probecache_set(const char *filename, const AVFormatContext *fmt_ctx,
+                        enum AVMediaType media_type, int stream_idx,
+                        const struct probe_result *res);
+
+#endif
@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 typedef struct pthread_t {
     void *(*func)(void *arg);
@@ -159,6 +160,20 @@ static inline int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex
     return 0;
 }
 
+static inline int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    int64_t ms = (abstime->tv_sec - now.tv_sec) * 1000 + (abstime->tv_nsec - now.tv_nsec) / 1000000;
+    if (ms < 0)
+        ms = 0;
+    else if (ms >= INFINITE)
+        ms = INFINITE - 1;
+    if (!SleepConditionVariableSRW(cond, mutex, (DWORD)ms, 0))
+        return GetLastError() == ERROR_TIMEOUT ? ETIMEDOUT : EINVAL;
+    return 0;
+}
+
 static inline int pthread_cond_signal(pthread_cond_t *cond)
 {
     WakeConditionVariable(cond);
@@ -0,0 +1,126 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+
+#include "readyfd.h"
+
+struct readyfd {
+    int read_fd;
+    int write_fd;                           // same as read_fd with an eventfd
+};
+
+#if !HAVE_EVENTFD && !defined(_WIN32)
+static int set_fd_flags(int fd)
+{
+    const int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0 ||
+        fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+        return AVERROR(errno);
+    return 0;
+}
+#endif
+
+int sxpi_readyfd_alloc(struct readyfd **rfdp)
+{
+    *rfdp = NULL;
+
+#ifdef _WIN32
+    return AVERROR(ENOSYS);
+#else
+    struct readyfd *rfd = av_mallocz(sizeof(*rfd));
+    if (!rfd)
+        return AVERROR(ENOMEM);
+
+#if HAVE_EVENTFD
+    rfd->read_fd = rfd->write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rfd->read_fd < 0) {
+        const int ret = AVERROR(errno);
+        av_free(rfd);
+        return ret;
+    }
+#else
+    int fds[2];
+    if (pipe(fds) < 0) {
+        const int ret = AVERROR(errno);
+        av_free(rfd);
+        return ret;
+    }
+    rfd->read_fd  = fds[0];
+    rfd->write_fd = fds[1];
+    int ret = set_fd_flags(fds[0]);
+    if (ret >= 0)
+        ret = set_fd_flags(fds[1]);
+    if (ret < 0) {
+        sxpi_readyfd_free(&rfd);
+        return ret;
+    }
+#endif
+
+    *rfdp = rfd;
+    return 0;
+#endif
+}
+
+int sxpi_readyfd_get_fd(const struct readyfd *rfd)
+{
+    return rfd->read_fd;
+}
+
+void sxpi_readyfd_signal(struct readyfd *rfd)
+{
+#ifndef _WIN32
+    /* A full pipe or a saturated eventfd is readable anyway */
+#if HAVE_EVENTFD
+    const uint64_t one = 1;
+    ssize_t ret = write(rfd->write_fd, &one, sizeof(one));
+#else
+    const uint8_t one = 1;
+    ssize_t ret = write(rfd->write_fd, &one, sizeof(one));
+#endif
+    (void)ret;
+#endif
+}
+
+void sxpi_readyfd_free(struct readyfd **rfdp)
+{
+    struct readyfd *rfd = *rfdp;
+    if (!rfd)
+        return;
+#ifndef _WIN32
+    if (rfd->write_fd != rfd->read_fd)
+        close(rfd->write_fd);
+    close(rfd->read_fd);
+#endif
+    av_freep(rfdp);
+}
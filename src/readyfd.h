@@ -0,0 +1,45 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef READYFD_H
+#define READYFD_H
+
+/*
+ * Non-blocking file descriptor becoming readable when signaled, for the
+ * integration in the poll(), epoll or kqueue based event loops. It is backed
+ * by an eventfd when available, and by a pipe otherwise. Signaling it again
+ * while it is readable has no additional effect, and the reader resets it by
+ * reading it until it would block.
+ *
+ * Not available on Windows.
+ */
+
+struct readyfd;
+
+int sxpi_readyfd_alloc(struct readyfd **rfdp);
+int sxpi_readyfd_get_fd(const struct readyfd *rfd);
+
+/* Make the file descriptor readable, can be called from any thread */
+void sxpi_readyfd_signal(struct readyfd *rfd);
+
+void sxpi_readyfd_free(struct readyfd **rfdp);
+
+#endif
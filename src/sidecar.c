@@ -0,0 +1,421 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/file.h>
+#include <libavutil/mem.h>
+#include <libavutil/random_seed.h>
+#include <libavutil/sha.h>
+
+#include "internal.h"
+#include "log.h"
+#include "sidecar.h"
+
+#define SIDECAR_MAGIC   MKTAG('S','X','I','X')
+#define SIDECAR_VERSION 1
+
+/*
+ * File layout: header, index entries, media path, extradata. The sidecar is
+ * only meant to be read back on the same machine, so everything is stored
+ * in native endianness and layout.
+ */
+
+struct sidecar_params {
+    int64_t bit_rate;
+    uint64_t channel_layout;
+    int64_t start_time;                     // stream start time, in stream time base
+    int64_t duration;                       // stream duration, in stream time base
+    int64_t fmt_start_time;                 // format start time, in AV_TIME_BASE
+    int64_t fmt_duration;                   // format duration, in AV_TIME_BASE
+    int32_t stream_idx;
+    int32_t media_type;
+    int32_t codec_id;
+    uint32_t codec_tag;
+    int32_t format;
+    int32_t width, height;
+    int32_t sar_num, sar_den;
+    int32_t profile, level;
+    int32_t field_order;
+    int32_t color_range, color_primaries, color_trc, color_space;
+    int32_t chroma_location;
+    int32_t video_delay;
+    int32_t channels, sample_rate, frame_size;
+    int32_t tb_num, tb_den;
+    int32_t avg_fr_num, avg_fr_den;
+    int32_t r_fr_num, r_fr_den;
+    int32_t extradata_size;
+};
+
+struct sidecar_header {
+    uint32_t magic;
+    uint32_t version;
+    int64_t media_size;
+    int64_t media_mtime;
+    int64_t nb_entries;
+    int32_t index_complete;
+    int32_t path_size;
+    int32_t params_size;
+    int32_t entry_size;
+    struct sidecar_params params;
+};
+
+SXPI_STATIC_ASSERT(sidecar_entry_size, sizeof(struct pktindex_entry) == 16);
+SXPI_STATIC_ASSERT(sidecar_header_align, sizeof(struct sidecar_header) % 8 == 0);
+
+struct sidecar {
+    void *log_ctx;
+    char *path;                             // sidecar path
+    char *filename;                         // media path
+    int64_t media_size;
+    int64_t media_mtime;
+
+    uint8_t *map;                           // mapped sidecar, NULL if none was loaded
+    size_t map_size;
+    const struct sidecar_header *hdr;       // header in the mapped sidecar
+
+    struct sidecar_params params;           // parameters of the stream to write
+    uint8_t *extradata;
+    int has_params;
+};
+
+int sxpi_sidecar_alloc(struct sidecar **scp, void *log_ctx, const char *dir, const char *filename)
+{
+    struct stat st;
+
+    *scp = NULL;
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+        return 0;
+
+    struct sidecar *sc = av_mallocz(sizeof(*sc));
+    if (!sc)
+        return AVERROR(ENOMEM);
+    sc->log_ctx = log_ctx;
+    sc->media_size = st.st_size;
+    sc->media_mtime = st.st_mtime;
+
+    uint8_t digest[20];
+    char hash[2 * sizeof(digest) + 1];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha) {
+        av_free(sc);
+        return AVERROR(ENOMEM);
+    }
+    av_sha_init(sha, 160);
+    av_sha_update(sha, (const uint8_t *)filename, strlen(filename));
+    av_sha_final(sha, digest);
+    av_free(sha);
+    for (int i = 0; i < (int)sizeof(digest); i++)
+        snprintf(hash + 2 * i, 3, "%02x", digest[i]);
+
+    sc->path = av_asprintf("%s/%s.sxidx", dir, hash);
+    sc->filename = av_strdup(filename);
+    if (!sc->path || !sc->filename) {
+        sxpi_sidecar_free(&sc);
+        return AVERROR(ENOMEM);
+    }
+
+    *scp = sc;
+    return 0;
+}
+
+static void unload(struct sidecar *sc)
+{
+    if (sc->map)
+        av_file_unmap(sc->map, sc->map_size);
+    sc->map = NULL;
+    sc->map_size = 0;
+    sc->hdr = NULL;
+}
+
+void sxpi_sidecar_free(struct sidecar **scp)
+{
+    struct sidecar *sc = *scp;
+    if (!sc)
+        return;
+    unload(sc);
+    av_freep(&sc->extradata);
+    av_freep(&sc->path);
+    av_freep(&sc->filename);
+    av_freep(scp);
+}
+
+static const struct pktindex_entry *get_entries(const struct sidecar *sc)
+{
+    return (const struct pktindex_entry *)(sc->map + sizeof(*sc->hdr));
+}
+
+static const char *get_media_path(const struct sidecar *sc)
+{
+    return (const char *)(get_entries(sc) + sc->hdr->nb_entries);
+}
+
+static const uint8_t *get_extradata(const struct sidecar *sc)
+{
+    return (const uint8_t *)get_media_path(sc) + sc->hdr->path_size;
+}
+
+int sxpi_sidecar_load(struct sidecar *sc)
+{
+    if (sc->map)
+        return 1;
+
+    int ret = av_file_map(sc->path, &sc->map, &sc->map_size, 0, NULL);
+    if (ret < 0) {
+        TRACE(sc, "no sidecar loaded from %s: %s", sc->path, av_err2str(ret));
+        sc->map = NULL;
+        return 0;
+    }
+
+    const struct sidecar_header *hdr = (const struct sidecar_header *)sc->map;
+    if (sc->map_size < sizeof(*hdr) ||
+        hdr->magic != SIDECAR_MAGIC || hdr->version != SIDECAR_VERSION ||
+        hdr->params_size != sizeof(hdr->params) ||
+        hdr->entry_size != sizeof(struct pktindex_entry) ||
+        hdr->nb_entries < 0 || hdr->nb_entries > INT_MAX ||
+        hdr->path_size < 0 || hdr->params.extradata_size < 0 ||
+        sc->map_size != sizeof(*hdr) + hdr->nb_entries * sizeof(struct pktindex_entry)
+                        + hdr->path_size + hdr->params.extradata_size) {
+        LOG(sc, WARNING, "Ignoring invalid sidecar %s", sc->path);
+        unload(sc);
+        return 0;
+    }
+    sc->hdr = hdr;
+
+    if (hdr->media_size != sc->media_size || hdr->media_mtime != sc->media_mtime ||
+        (size_t)hdr->path_size != strlen(sc->filename) ||
+        memcmp(get_media_path(sc), sc->filename, hdr->path_size)) {
+        TRACE(sc, "sidecar %s is outdated", sc->path);
+        unload(sc);
+        return 0;
+    }
+
+    av_freep(&sc->extradata);
+    if (hdr->params.extradata_size) {
+        sc->extradata = av_memdup(get_extradata(sc), hdr->params.extradata_size);
+        if (!sc->extradata) {
+            unload(sc);
+            return AVERROR(ENOMEM);
+        }
+    }
+    sc->params = hdr->params;
+    sc->has_params = 1;
+
+    TRACE(sc, "loaded sidecar %s with %"PRId64" index entries", sc->path, hdr->nb_entries);
+    return 1;
+}
+
+static void drop(struct sidecar *sc)
+{
+    unload(sc);
+    av_freep(&sc->extradata);
+    sc->has_params = 0;
+}
+
+int sxpi_sidecar_apply(struct sidecar *sc, AVFormatContext *fmt_ctx,
+                       enum AVMediaType media_type, int stream_idx)
+{
+    const struct sidecar_params *p = &sc->params;
+
+    if (!sc->map)
+        return AVERROR_INVALIDDATA;
+
+    if (p->media_type != media_type || (stream_idx >= 0 && p->stream_idx != stream_idx) ||
+        p->stream_idx >= fmt_ctx->nb_streams) {
+        TRACE(sc, "sidecar stream selection does not match");
+        drop(sc);
+        return AVERROR_INVALIDDATA;
+    }
+
+    AVStream *st = fmt_ctx->streams[p->stream_idx];
+    AVCodecParameters *par = st->codecpar;
+    if ((par->codec_id != AV_CODEC_ID_NONE && par->codec_id != p->codec_id) ||
+        st->time_base.num != p->tb_num || st->time_base.den != p->tb_den) {
+        LOG(sc, WARNING, "Sidecar %s does not match the media stream", sc->path);
+        drop(sc);
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (p->extradata_size != par->extradata_size ||
+        (p->extradata_size && memcmp(par->extradata, sc->extradata, p->extradata_size))) {
+        uint8_t *extradata = av_mallocz(p->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!extradata)
+            return AVERROR(ENOMEM);
+        memcpy(extradata, sc->extradata, p->extradata_size);
+        av_freep(&par->extradata);
+        par->extradata = extradata;
+        par->extradata_size = p->extradata_size;
+    }
+
+    par->codec_type          = p->media_type;
+    par->codec_id            = p->codec_id;
+    par->codec_tag           = p->codec_tag;
+    par->format              = p->format;
+    par->bit_rate            = p->bit_rate;
+    par->profile             = p->profile;
+    par->level               = p->level;
+    par->width               = p->width;
+    par->height              = p->height;
+    par->sample_aspect_ratio = av_make_q(p->sar_num, p->sar_den);
+    par->field_order         = p->field_order;
+    par->color_range         = p->color_range;
+    par->color_primaries     = p->color_primaries;
+    par->color_trc           = p->color_trc;
+    par->color_space         = p->color_space;
+    par->chroma_location     = p->chroma_location;
+    par->video_delay         = p->video_delay;
+    par->channel_layout      = p->channel_layout;
+    par->channels            = p->channels;
+    par->sample_rate         = p->sample_rate;
+    par->frame_size          = p->frame_size;
+
+    st->avg_frame_rate = av_make_q(p->avg_fr_num, p->avg_fr_den);
+    st->r_frame_rate   = av_make_q(p->r_fr_num, p->r_fr_den);
+    st->start_time     = p->start_time;
+    st->duration       = p->duration;
+    fmt_ctx->start_time = p->fmt_start_time;
+    fmt_ctx->duration   = p->fmt_duration;
+
+    return p->stream_idx;
+}
+
+int sxpi_sidecar_fill_index(struct sidecar *sc, struct pktindex *idx)
+{
+    if (!sc->map || !sc->hdr->index_complete)
+        return 0;
+    int ret = sxpi_pktindex_add_entries(idx, get_entries(sc), sc->hdr->nb_entries);
+    if (ret < 0)
+        return ret;
+    sxpi_pktindex_set_complete(idx);
+    return 1;
+}
+
+int sxpi_sidecar_set_stream(struct sidecar *sc, const AVFormatContext *fmt_ctx, int stream_idx)
+{
+    /* The parameters are read by the index scan thread when it completes, so
+     * they must not change once set */
+    if (sc->has_params)
+        return 0;
+
+    const AVStream *st = fmt_ctx->streams[stream_idx];
+    const AVCodecParameters *par = st->codecpar;
+
+    if (par->extradata_size) {
+        sc->extradata = av_memdup(par->extradata, par->extradata_size);
+        if (!sc->extradata)
+            return AVERROR(ENOMEM);
+    }
+
+    sc->params = (struct sidecar_params){
+        .bit_rate        = par->bit_rate,
+        .channel_layout  = par->channel_layout,
+        .start_time      = st->start_time,
+        .duration        = st->duration,
+        .fmt_start_time  = fmt_ctx->start_time,
+        .fmt_duration    = fmt_ctx->duration,
+        .stream_idx      = stream_idx,
+        .media_type      = par->codec_type,
+        .codec_id        = par->codec_id,
+        .codec_tag       = par->codec_tag,
+        .format          = par->format,
+        .width           = par->width,
+        .height          = par->height,
+        .sar_num         = par->sample_aspect_ratio.num,
+        .sar_den         = par->sample_aspect_ratio.den,
+        .profile         = par->profile,
+        .level           = par->level,
+        .field_order     = par->field_order,
+        .color_range     = par->color_range,
+        .color_primaries = par->color_primaries,
+        .color_trc       = par->color_trc,
+        .color_space     = par->color_space,
+        .chroma_location = par->chroma_location,
+        .video_delay     = par->video_delay,
+        .channels        = par->channels,
+        .sample_rate     = par->sample_rate,
+        .frame_size      = par->frame_size,
+        .tb_num          = st->time_base.num,
+        .tb_den          = st->time_base.den,
+        .avg_fr_num      = st->avg_frame_rate.num,
+        .avg_fr_den      = st->avg_frame_rate.den,
+        .r_fr_num        = st->r_frame_rate.num,
+        .r_fr_den        = st->r_frame_rate.den,
+        .extradata_size  = par->extradata_size,
+    };
+    sc->has_params = 1;
+    return 0;
+}
+
+void sxpi_sidecar_write(struct sidecar *sc, struct pktindex *idx)
+{
+    struct pktindex_entry *entries = NULL;
+    int nb_entries = 0;
+    char *tmp_path = NULL;
+    FILE *f = NULL;
+
+    if (!sc->has_params)
+        return;
+
+    const int index_complete = sxpi_pktindex_get_entries(idx, &entries, &nb_entries) >= 0;
+    if (sc->hdr && sc->hdr->index_complete >= index_complete)
+        goto end;
+
+    struct sidecar_header hdr = {
+        .magic          = SIDECAR_MAGIC,
+        .version        = SIDECAR_VERSION,
+        .media_size     = sc->media_size,
+        .media_mtime    = sc->media_mtime,
+        .nb_entries     = nb_entries,
+        .index_complete = index_complete,
+        .path_size      = strlen(sc->filename),
+        .params_size    = sizeof(hdr.params),
+        .entry_size     = sizeof(*entries),
+        .params         = sc->params,
+    };
+
+    tmp_path = av_asprintf("%s.%08"PRIx32".tmp", sc->path, av_get_random_seed());
+    if (!tmp_path)
+        goto end;
+
+    f = fopen(tmp_path, "wb");
+    if (!f) {
+        LOG(sc, WARNING, "Unable to create sidecar %s", tmp_path);
+        goto end;
+    }
+
+    const int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                   fwrite(entries, sizeof(*entries), nb_entries, f) == (size_t)nb_entries &&
+                   fwrite(sc->filename, 1, hdr.path_size, f) == (size_t)hdr.path_size &&
+                   fwrite(sc->extradata, 1, sc->params.extradata_size, f) == (size_t)sc->params.extradata_size;
+    if (fclose(f) || !ok || rename(tmp_path, sc->path)) {
+        LOG(sc, WARNING, "Unable to write sidecar %s", sc->path);
+        remove(tmp_path);
+        goto end;
+    }
+    TRACE(sc, "wrote sidecar %s with %d index entries", sc->path, nb_entries);
+
+end:
+    av_free(tmp_path);
+    av_free(entries);
+}
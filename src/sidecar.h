@@ -0,0 +1,75 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <libavformat/avformat.h>
+
+#include "pktindex.h"
+
+/*
+ * Sidecar file saving what is costly to figure out when opening a media: the
+ * parameters of the selected stream (normally probed by
+ * avformat_find_stream_info()), the durations and the packet index.
+ *
+ * Sidecars live in a user provided cache directory, named after a hash of
+ * the media path. The media size and modification time are stored inside so
+ * an outdated sidecar is ignored, then replaced. A sidecar is written to a
+ * temporary file and renamed, so concurrent processes never see a partial
+ * one.
+ */
+
+struct sidecar;
+
+/*
+ * Set *scp to NULL (without error) if the media is not a local file, in which
+ * case no sidecar is used.
+ */
+int sxpi_sidecar_alloc(struct sidecar **scp, void *log_ctx, const char *dir, const char *filename);
+void sxpi_sidecar_free(struct sidecar **scp);
+
+/* Map the existing sidecar if it matches the media, return 1 if so */
+int sxpi_sidecar_load(struct sidecar *sc);
+
+/*
+ * Set the parameters of the stream saved in the loaded sidecar on the freshly
+ * opened fmt_ctx, instead of probing them. Return the stream index, or
+ * AVERROR_INVALIDDATA if the sidecar does not match the media or the stream
+ * selection (in which case it is dropped).
+ */
+int sxpi_sidecar_apply(struct sidecar *sc, AVFormatContext *fmt_ctx,
+                       enum AVMediaType media_type, int stream_idx);
+
+/* Fill the index with the one of the loaded sidecar, return 1 if it had one */
+int sxpi_sidecar_fill_index(struct sidecar *sc, struct pktindex *idx);
+
+/* Save the parameters of the selected stream for the next write */
+int sxpi_sidecar_set_stream(struct sidecar *sc, const AVFormatContext *fmt_ctx, int stream_idx);
+
+/*
+ * Write the sidecar with the stream parameters, and the index if it is
+ * complete. Failing to write is not an error for the player, so it is only
+ * logged.
+ */
+void sxpi_sidecar_write(struct sidecar *sc, struct pktindex *idx);
+
+#endif
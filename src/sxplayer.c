@@ -32,6 +32,7 @@ struct player {
     int paused;
     int seeking;
     int next_frame_requested;
+    int prev_frame_requested;
     int mouse_down;
     int fullscreen;
 };
@@ -150,8 +151,9 @@ static void render(struct player *p)
     };
 
     struct sxplayer_frame *frame;
-    if (p->next_frame_requested) {
-        frame = sxplayer_get_next_frame(p->sxplayer_ctx);
+    if (p->next_frame_requested || p->prev_frame_requested) {
+        frame = p->next_frame_requested ? sxplayer_get_next_frame(p->sxplayer_ctx)
+                                        : sxplayer_get_prev_frame(p->sxplayer_ctx);
         if (frame) {
             printf("Stepped to frame t=%f\n", frame->ts);
             p->frame_ts = frame->ts * 1000000;
@@ -159,6 +161,7 @@ static void render(struct player *p)
             p->frame_time = frame->ts;
         }
         p->next_frame_requested = 0;
+        p->prev_frame_requested = 0;
     } else {
         update_time(p, -1);
         frame = sxplayer_get_frame(p->sxplayer_ctx, p->frame_time);
@@ -225,7 +228,7 @@ static int key_callback(struct player *p, SDL_KeyboardEvent *event)
         break;
     case SDLK_o:
         p->paused = 1;
-        set_frame_index(p, clipi64(p->frame_index - 1, 0, p->duration_i));
+        p->prev_frame_requested = 1;
         break;
     case SDLK_p:
         p->paused = 1;
@@ -275,6 +278,7 @@ int main(int ac, char **av)
 
     sxplayer_set_option(p.sxplayer_ctx, "sw_pix_fmt", SXPLAYER_PIXFMT_RGBA);
     sxplayer_set_option(p.sxplayer_ctx, "auto_hwaccel", 0);
+    sxplayer_set_option(p.sxplayer_ctx, "reverse", 1);
 
     struct sxplayer_info info = {0};
     ret = sxplayer_get_info(p.sxplayer_ctx, &info);
@@ -0,0 +1,67 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "wakeup.h"
+
+void sxpi_wakeup_init(struct wakeup *w)
+{
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    atomic_init(&w->pending, 0);
+    atomic_init(&w->waiting, 0);
+}
+
+/*
+ * The waiter sets its flag before checking the pending wake up, and the
+ * signaling side sets the pending wake up before checking the flag (both
+ * sequentially consistent), so either the waiter sees the wake up or the
+ * signaling side sees the waiter, and signals it under the lock.
+ */
+void sxpi_wakeup_signal(struct wakeup *w)
+{
+    atomic_store(&w->pending, 1);
+    if (!atomic_load(&w->waiting))
+        return;
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+int sxpi_wakeup_check(struct wakeup *w)
+{
+    return atomic_exchange(&w->pending, 0);
+}
+
+void sxpi_wakeup_wait(struct wakeup *w)
+{
+    pthread_mutex_lock(&w->lock);
+    atomic_store(&w->waiting, 1);
+    while (!atomic_exchange(&w->pending, 0))
+        pthread_cond_wait(&w->cond, &w->lock);
+    atomic_store(&w->waiting, 0);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void sxpi_wakeup_destroy(struct wakeup *w)
+{
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+}
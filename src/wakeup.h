@@ -0,0 +1,52 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <stdatomic.h>
+
+#include "pthread_compat.h"
+
+/*
+ * Wake up signal for a single waiter. A wake up sent while nobody waits is
+ * kept for the next wait (or check), so none is ever lost. The lock is only
+ * taken when the waiter is known to be sleeping.
+ */
+struct wakeup {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int pending;
+    atomic_int waiting;
+};
+
+void sxpi_wakeup_init(struct wakeup *w);
+void sxpi_wakeup_signal(struct wakeup *w);
+
+/* Consume the pending wake up without waiting, return 1 if there was one */
+int sxpi_wakeup_check(struct wakeup *w);
+
+/* Wait for a wake up and consume it */
+void sxpi_wakeup_wait(struct wakeup *w);
+
+void sxpi_wakeup_destroy(struct wakeup *w);
+
+#endif
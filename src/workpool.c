@@ -0,0 +1,406 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <stdatomic.h>
+
+#include <libavutil/avassert.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "pthread_compat.h"
+#include "workpool.h"
+
+enum task_state {
+    TASK_STOPPED,
+    TASK_IDLE,
+    TASK_QUEUED,
+    TASK_RUNNING,
+    TASK_RERUN,                             // woken up while running
+};
+
+struct workpool_task {
+    struct workpool *wp;
+    workpool_func func;
+    void *arg;
+    atomic_int state;
+    int blocking;                           // run by the blocking threads
+    struct workpool_task *next;             // next task in the worker queue
+};
+
+struct worker {
+    struct workpool *wp;
+    int id;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    struct workpool_task *first;            // queue of runnable tasks
+    struct workpool_task *last;
+};
+
+struct workpool {
+    atomic_int refcount;
+    struct worker *workers;
+    int nb_workers;
+    int nb_started;
+    atomic_uint next_worker;                // target of the wake ups from outside the pool
+    struct worker blocking;                 // queue of the runnable blocking tasks
+    pthread_cond_t blocking_cond;           // signaled when a blocking task is queued or on quit
+    pthread_t *blocking_tids;
+    int nb_blocking;                        // number of blocking threads started
+    int nb_blocking_idle;                   // blocking threads waiting for a task
+    int nb_blocking_queued;                 // blocking tasks waiting for a thread
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;               // signaled when a task is queued or on quit
+    pthread_cond_t done_cond;               // signaled when a task is done
+    int nb_queued;
+    int quit;
+};
+
+static void append_task(struct worker *w, struct workpool_task *task)
+{
+    task->next = NULL;
+    if (w->last)
+        w->last->next = task;
+    else
+        w->first = task;
+    w->last = task;
+}
+
+static void *blocking_thread(void *arg);
+
+/* Must be called with the blocking queue locked */
+static int start_blocking_thread(struct workpool *wp)
+{
+    pthread_t *tids = av_realloc_array(wp->blocking_tids, wp->nb_blocking + 1, sizeof(*tids));
+    if (!tids)
+        return AVERROR(ENOMEM);
+    wp->blocking_tids = tids;
+    const int ret = pthread_create(&tids[wp->nb_blocking], NULL, blocking_thread, wp);
+    if (ret)
+        return AVERROR(ret);
+    wp->nb_blocking++;
+    return 0;
+}
+
+static void push_task(struct workpool *wp, int worker_id, struct workpool_task *task)
+{
+    if (task->blocking) {
+        struct worker *w = &wp->blocking;
+        pthread_mutex_lock(&w->lock);
+        append_task(w, task);
+        wp->nb_blocking_queued++;
+        /* If the thread can not be started, the task waits for one of the
+         * others (there is always at least one) to be done */
+        if (wp->nb_blocking_queued <= wp->nb_blocking_idle || start_blocking_thread(wp) < 0)
+            pthread_cond_signal(&wp->blocking_cond);
+        pthread_mutex_unlock(&w->lock);
+        return;
+    }
+
+    struct worker *w = &wp->workers[worker_id];
+
+    pthread_mutex_lock(&w->lock);
+    append_task(w, task);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_lock(&wp->lock);
+    wp->nb_queued++;
+    pthread_cond_signal(&wp->work_cond);
+    pthread_mutex_unlock(&wp->lock);
+}
+
+static struct workpool_task *dequeue_task(struct worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    struct workpool_task *task = w->first;
+    if (task) {
+        w->first = task->next;
+        if (!w->first)
+            w->last = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+/* Take a task from the worker own queue, or steal one from the others */
+static struct workpool_task *pop_task(struct workpool *wp, int worker_id)
+{
+    for (int i = 0; i < wp->nb_workers; i++) {
+        struct workpool_task *task = dequeue_task(&wp->workers[(worker_id + i) % wp->nb_workers]);
+        if (task) {
+            pthread_mutex_lock(&wp->lock);
+            wp->nb_queued--;
+            pthread_mutex_unlock(&wp->lock);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void run_task(struct worker *w, struct workpool_task *task)
+{
+    struct workpool *wp = w->wp;
+
+    atomic_store(&task->state, TASK_RUNNING);
+    const enum workpool_status status = task->func(task->arg);
+
+    if (status == WORKPOOL_TASK_DONE) {
+        pthread_mutex_lock(&wp->lock);
+        atomic_store(&task->state, TASK_STOPPED);
+        pthread_cond_broadcast(&wp->done_cond);
+        pthread_mutex_unlock(&wp->lock);
+        return;
+    }
+
+    if (status == WORKPOOL_TASK_IDLE) {
+        int state = TASK_RUNNING;
+        if (atomic_compare_exchange_strong(&task->state, &state, TASK_IDLE))
+            return;
+    }
+
+    /* Runnable again, or woken up while running: the task goes at the end of
+     * the queue to give the other ones a chance to run */
+    atomic_store(&task->state, TASK_QUEUED);
+    push_task(wp, w->id, task);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct workpool *wp = w->wp;
+
+    sxpi_set_thread_name("sxp/pool");
+
+    for (;;) {
+        struct workpool_task *task = pop_task(wp, w->id);
+        if (task) {
+            run_task(w, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&wp->lock);
+        while (wp->nb_queued <= 0 && !wp->quit)
+            pthread_cond_wait(&wp->work_cond, &wp->lock);
+        const int quit = wp->quit;
+        pthread_mutex_unlock(&wp->lock);
+        if (quit)
+            break;
+    }
+    return NULL;
+}
+
+static void *blocking_thread(void *arg)
+{
+    struct workpool *wp = arg;
+    struct worker *w = &wp->blocking;
+
+    sxpi_set_thread_name("sxp/blocking");
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        struct workpool_task *task = w->first;
+        if (task) {
+            w->first = task->next;
+            if (!w->first)
+                w->last = NULL;
+            wp->nb_blocking_queued--;
+            pthread_mutex_unlock(&w->lock);
+            run_task(w, task);
+            pthread_mutex_lock(&w->lock);
+            continue;
+        }
+        if (wp->quit)
+            break;
+        wp->nb_blocking_idle++;
+        pthread_cond_wait(&wp->blocking_cond, &w->lock);
+        wp->nb_blocking_idle--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void free_pool(struct workpool *wp)
+{
+    pthread_mutex_lock(&wp->lock);
+    wp->quit = 1;
+    pthread_cond_broadcast(&wp->work_cond);
+    pthread_mutex_unlock(&wp->lock);
+
+    pthread_mutex_lock(&wp->blocking.lock);
+    pthread_cond_broadcast(&wp->blocking_cond);
+    pthread_mutex_unlock(&wp->blocking.lock);
+
+    for (int i = 0; i < wp->nb_started; i++)
+        pthread_join(wp->workers[i].tid, NULL);
+    for (int i = 0; i < wp->nb_workers; i++)
+        pthread_mutex_destroy(&wp->workers[i].lock);
+    for (int i = 0; i < wp->nb_blocking; i++)
+        pthread_join(wp->blocking_tids[i], NULL);
+
+    pthread_cond_destroy(&wp->blocking_cond);
+    pthread_mutex_destroy(&wp->blocking.lock);
+    pthread_cond_destroy(&wp->done_cond);
+    pthread_cond_destroy(&wp->work_cond);
+    pthread_mutex_destroy(&wp->lock);
+    av_freep(&wp->workers);
+    av_freep(&wp->blocking_tids);
+    av_free(wp);
+}
+
+struct workpool *sxpi_workpool_create(int nb_threads)
+{
+    struct workpool *wp = av_mallocz(sizeof(*wp));
+    if (!wp)
+        return NULL;
+
+    if (nb_threads <= 0)
+        nb_threads = av_cpu_count();
+
+    atomic_init(&wp->refcount, 1);
+    atomic_init(&wp->next_worker, 0);
+    pthread_mutex_init(&wp->lock, NULL);
+    pthread_cond_init(&wp->work_cond, NULL);
+    pthread_cond_init(&wp->done_cond, NULL);
+    pthread_cond_init(&wp->blocking_cond, NULL);
+    pthread_mutex_init(&wp->blocking.lock, NULL);
+    wp->blocking.wp = wp;
+    wp->blocking.id = -1;
+
+    wp->workers = av_calloc(nb_threads, sizeof(*wp->workers));
+    if (!wp->workers) {
+        free_pool(wp);
+        return NULL;
+    }
+    wp->nb_workers = nb_threads;
+    for (int i = 0; i < nb_threads; i++) {
+        struct worker *w = &wp->workers[i];
+        w->wp = wp;
+        w->id = i;
+        pthread_mutex_init(&w->lock, NULL);
+    }
+
+    for (int i = 0; i < nb_threads; i++) {
+        if (pthread_create(&wp->workers[i].tid, NULL, worker_thread, &wp->workers[i])) {
+            free_pool(wp);
+            return NULL;
+        }
+        wp->nb_started++;
+    }
+
+    /* The other blocking threads are started on demand */
+    pthread_mutex_lock(&wp->blocking.lock);
+    const int ret = start_blocking_thread(wp);
+    pthread_mutex_unlock(&wp->blocking.lock);
+    if (ret < 0) {
+        free_pool(wp);
+        return NULL;
+    }
+
+    return wp;
+}
+
+struct workpool *sxpi_workpool_ref(struct workpool *wp)
+{
+    if (wp)
+        atomic_fetch_add_explicit(&wp->refcount, 1, memory_order_relaxed);
+    return wp;
+}
+
+void sxpi_workpool_unref(struct workpool **wpp)
+{
+    struct workpool *wp = *wpp;
+    if (!wp)
+        return;
+    *wpp = NULL;
+    if (atomic_fetch_sub_explicit(&wp->refcount, 1, memory_order_acq_rel) == 1)
+        free_pool(wp);
+}
+
+struct workpool_task *sxpi_workpool_task_alloc(struct workpool *wp, workpool_func func, void *arg)
+{
+    struct workpool_task *task = av_mallocz(sizeof(*task));
+    if (!task)
+        return NULL;
+    task->wp = sxpi_workpool_ref(wp);
+    task->func = func;
+    task->arg = arg;
+    atomic_init(&task->state, TASK_STOPPED);
+    return task;
+}
+
+struct workpool_task *sxpi_workpool_task_alloc_blocking(struct workpool *wp, workpool_func func, void *arg)
+{
+    struct workpool_task *task = sxpi_workpool_task_alloc(wp, func, arg);
+    if (task)
+        task->blocking = 1;
+    return task;
+}
+
+static int get_wake_worker(struct workpool *wp)
+{
+    return atomic_fetch_add_explicit(&wp->next_worker, 1, memory_order_relaxed) % wp->nb_workers;
+}
+
+void sxpi_workpool_task_start(struct workpool_task *task)
+{
+    av_assert0(atomic_load(&task->state) == TASK_STOPPED);
+    atomic_store(&task->state, TASK_QUEUED);
+    push_task(task->wp, get_wake_worker(task->wp), task);
+}
+
+void sxpi_workpool_task_wake(struct workpool_task *task)
+{
+    int state = atomic_load(&task->state);
+    for (;;) {
+        if (state == TASK_IDLE) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_QUEUED)) {
+                push_task(task->wp, get_wake_worker(task->wp), task);
+                return;
+            }
+        } else if (state == TASK_RUNNING) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_RERUN))
+                return;
+        } else {
+            return;
+        }
+    }
+}
+
+void sxpi_workpool_task_wait(struct workpool_task *task)
+{
+    struct workpool *wp = task->wp;
+
+    pthread_mutex_lock(&wp->lock);
+    while (atomic_load(&task->state) != TASK_STOPPED)
+        pthread_cond_wait(&wp->done_cond, &wp->lock);
+    pthread_mutex_unlock(&wp->lock);
+}
+
+void sxpi_workpool_task_free(struct workpool_task **taskp)
+{
+    struct workpool_task *task = *taskp;
+    if (!task)
+        return;
+    av_assert0(atomic_load(&task->state) == TASK_STOPPED);
+    sxpi_workpool_unref(&task->wp);
+    av_freep(taskp);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of sxplayer.
+ *
+ * Copyright (c) 2026 GoPro
+ *
+ * sxplayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * sxplayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with sxplayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/*
+ * Pool of worker threads running cooperative tasks.
+ *
+ * A task function is called repeatedly by the workers as long as it returns
+ * WORKPOOL_TASK_AGAIN. When it returns WORKPOOL_TASK_IDLE, it is not called
+ * anymore until the task is woken up. A task is never run by 2 workers at
+ * the same time, and a wake up happening while it runs makes it run again
+ * afterwards, so no wake up is ever lost.
+ *
+ * Every worker has its own queue of runnable tasks, and steals from the
+ * others when it is empty.
+ *
+ * The blocking tasks may block (on I/O, or waiting for the other tasks), so
+ * they are run by a separate set of threads instead of the workers. A thread
+ * is added to that set whenever a blocking task is queued while all of them
+ * are busy, so a blocking task never holds back another one.
+ */
+
+enum workpool_status {
+    WORKPOOL_TASK_AGAIN,                    // made progress, run again
+    WORKPOOL_TASK_IDLE,                     // can not progress until woken up
+    WORKPOOL_TASK_DONE,                     // ended, until started again
+};
+
+typedef enum workpool_status (*workpool_func)(void *arg);
+
+struct workpool;
+struct workpool_task;
+
+struct workpool *sxpi_workpool_create(int nb_threads);
+struct workpool *sxpi_workpool_ref(struct workpool *wp);
+void sxpi_workpool_unref(struct workpool **wpp);
+
+struct workpool_task *sxpi_workpool_task_alloc(struct workpool *wp, workpool_func func, void *arg);
+struct workpool_task *sxpi_workpool_task_alloc_blocking(struct workpool *wp, workpool_func func, void *arg);
+
+/* The task must be done (or never started) when started or freed */
+void sxpi_workpool_task_start(struct workpool_task *task);
+void sxpi_workpool_task_wake(struct workpool_task *task);
+void sxpi_workpool_task_wait(struct workpool_task *task);
+void sxpi_workpool_task_free(struct workpool_task **taskp);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/threadmessage.h>
+#include <libavutil/time.h>
+
+#include "msgqueue.h"
+#include "pthread_compat.h"
+
+/*
+ * Throughput of the queues between the pipeline modules: a producer thread
+ * sends messages (of the size of the pipeline ones) through a queue to a
+ * consumer thread, with AVThreadMessageQueue and with the SPSC ring.
+ */
+
+#define NB_MESSAGES 1000000
+
+struct bench_msg {
+    void *data;
+    AVPacket pkt;
+    int type;
+    void *budget;
+    int64_t charge;
+    void *pool;
+};
+
+struct queue_ops {
+    const char *name;
+    int (*alloc)(void **q, unsigned nb_elems, unsigned elem_size);
+    int (*send)(void *q, void *msg, unsigned flags);
+    int (*recv)(void *q, void *msg, unsigned flags);
+    void (*free)(void **q);
+};
+
+static int avq_alloc(void **q, unsigned nb_elems, unsigned elem_size)
+{
+    return av_thread_message_queue_alloc((AVThreadMessageQueue **)q, nb_elems, elem_size);
+}
+
+static int avq_send(void *q, void *msg, unsigned flags) { return av_thread_message_queue_send(q, msg, flags); }
+static int avq_recv(void *q, void *msg, unsigned flags) { return av_thread_message_queue_recv(q, msg, flags); }
+static void avq_free(void **q) { av_thread_message_queue_free((AVThreadMessageQueue **)q); }
+
+static int ring_alloc(void **q, unsigned nb_elems, unsigned elem_size)
+{
+    return sxpi_msgqueue_alloc((struct msgqueue **)q, nb_elems, elem_size);
+}
+
+static int ring_send(void *q, void *msg, unsigned flags) { return sxpi_msgqueue_send(q, msg, flags); }
+static int ring_recv(void *q, void *msg, unsigned flags) { return sxpi_msgqueue_recv(q, msg, flags); }
+static void ring_free(void **q) { sxpi_msgqueue_free((struct msgqueue **)q); }
+
+static const struct queue_ops queues[] = {
+    {"AVThreadMessageQueue", avq_alloc,  avq_send,  avq_recv,  avq_free},
+    {"msgqueue",             ring_alloc, ring_send, ring_recv, ring_free},
+};
+
+struct producer {
+    const struct queue_ops *ops;
+    void *q;
+    int ret;
+};
+
+static void *producer_thread(void *arg)
+{
+    struct producer *p = arg;
+    for (intptr_t i = 0; i < NB_MESSAGES; i++) {
+        struct bench_msg msg = {.data = (void *)i};
+        p->ret = p->ops->send(p->q, &msg, 0);
+        if (p->ret < 0)
+            break;
+    }
+    return NULL;
+}
+
+static int run(const struct queue_ops *ops, unsigned nb_elems)
+{
+    struct producer p = {.ops = ops};
+    int ret = ops->alloc(&p.q, nb_elems, sizeof(struct bench_msg));
+    if (ret < 0)
+        return ret;
+
+    const int64_t t0 = av_gettime_relative();
+
+    pthread_t tid;
+    ret = pthread_create(&tid, NULL, producer_thread, &p);
+    if (ret) {
+        ops->free(&p.q);
+        return -1;
+    }
+
+    for (intptr_t i = 0; i < NB_MESSAGES; i++) {
+        struct bench_msg msg;
+        ret = ops->recv(p.q, &msg, 0);
+        if (ret < 0 || msg.data != (void *)i) {
+            fprintf(stderr, "%s: message %d out of order\n", ops->name, (int)i);
+            ret = -1;
+            break;
+        }
+    }
+
+    pthread_join(tid, NULL);
+    const int64_t elapsed = av_gettime_relative() - t0;
+    ops->free(&p.q);
+    if (ret < 0 || p.ret < 0)
+        return -1;
+
+    printf("%-20s queue of %2u: %6.1f ns/message\n",
+           ops->name, nb_elems, elapsed * 1000. / NB_MESSAGES);
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    static const unsigned sizes[] = {1, 2, 5, 16};
+
+    for (int i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+        for (int j = 0; j < sizeof(queues) / sizeof(*queues); j++)
+            if (run(&queues[j], sizes[i]) < 0)
+                return -1;
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define TARGET_TS (3*1000000)
+#define BUDGET_US 10000
+#define MAX_TRIES 1000
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_ctx *s1 = sxplayer_create(filename);
+    struct sxplayer_ctx *s2 = sxplayer_create(filename);
+    struct sxplayer_frame *ref = NULL;
+
+    if (!s1 || !s2)
+        goto end;
+
+    sxplayer_set_option(s1, "auto_hwaccel", 0);
+    sxplayer_set_option(s1, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s2, "auto_hwaccel", 0);
+    sxplayer_set_option(s2, "use_pkt_duration", use_pkt_duration);
+
+    ref = sxplayer_get_frame_ms(s1, TARGET_TS);
+    if (!ref) {
+        fprintf(stderr, "unable to get reference frame\n");
+        goto end;
+    }
+
+    /* Nothing is decoded yet, so this is not supposed to block */
+    struct sxplayer_frame *frame = sxplayer_try_get_frame_ms(s2, TARGET_TS);
+    sxplayer_release_frame(frame);
+
+    /* Keep polling with a short budget: the decoding progresses in the
+     * background until the exact frame is reached */
+    int64_t last_ms = -1;
+    for (int i = 0; i < MAX_TRIES && last_ms != ref->ms; i++) {
+        frame = sxplayer_get_frame_deadline_ms(s2, TARGET_TS, BUDGET_US);
+        if (frame) {
+            if (frame->ms > TARGET_TS) {
+                fprintf(stderr, "frame at %"PRId64" returned for %d\n", frame->ms, TARGET_TS);
+                sxplayer_release_frame(frame);
+                goto end;
+            }
+            last_ms = frame->ms;
+            sxplayer_release_frame(frame);
+        }
+    }
+
+    if (last_ms != ref->ms) {
+        fprintf(stderr, "last frame obtained at %"PRId64", expected %"PRId64"\n", last_ms, ref->ms);
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_release_frame(ref);
+    sxplayer_free(&s1);
+    sxplayer_free(&s2);
+    return ret;
+}
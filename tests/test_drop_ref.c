@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+static const int64_t targets[] = {3000000, 1500000, 7200000, 4040000, 500000};
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_ctx *s1 = sxplayer_create(filename);
+    struct sxplayer_ctx *s2 = sxplayer_create(filename);
+
+    if (!s1 || !s2)
+        goto end;
+
+    sxplayer_set_option(s1, "auto_hwaccel", 0);
+    sxplayer_set_option(s1, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s2, "auto_hwaccel", 0);
+    sxplayer_set_option(s2, "use_pkt_duration", use_pkt_duration);
+
+    if (sxplayer_set_drop_ref(s2, 1) < 0)
+        goto end;
+
+    /* Dropping the non reference frames must not change the frames returned
+     * after a seek */
+    for (int i = 0; i < sizeof(targets) / sizeof(*targets); i++) {
+        struct sxplayer_frame *f1 = sxplayer_get_frame_ms(s1, targets[i]);
+        struct sxplayer_frame *f2 = sxplayer_get_frame_ms(s2, targets[i]);
+        const int match = f1 && f2 && f1->ms == f2->ms;
+
+        if (!match)
+            fprintf(stderr, "frame mismatch at %"PRId64": %"PRId64" != %"PRId64"\n", targets[i],
+                    f1 ? f1->ms : -1, f2 ? f2->ms : -1);
+        sxplayer_release_frame(f1);
+        sxplayer_release_frame(f2);
+        if (!match)
+            goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_free(&s1);
+    sxplayer_free(&s2);
+    return ret;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+int main(void)
+{
+    return 77; // not supported, skipped
+}
+#else
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <sxplayer.h>
+
+#define END_TIME        2.0
+#define POLL_TIMEOUT_MS 5000
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "end_time", END_TIME);
+    return s;
+}
+
+static void drain_fd(int fd)
+{
+    uint64_t buf;
+    while (read(fd, &buf, sizeof(buf)) > 0 || errno == EINTR);
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    int nb_ref_frames = 0, nb_frames = 0, nb_wakeups = 0;
+    double last_ts = -1.0;
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration);
+    struct sxplayer_ctx *s   = create_context(filename, use_pkt_duration);
+
+    if (!ref || !s) {
+        ret = -1;
+        goto end;
+    }
+
+    for (;;) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(ref);
+        if (!frame)
+            break;
+        nb_ref_frames++;
+        sxplayer_release_frame(frame);
+    }
+
+    const int fd = sxplayer_get_event_fd(s);
+    if (fd < 0) {
+        ret = fd;
+        goto end;
+    }
+
+    for (;;) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
+        if (ret <= 0) {
+            fprintf(stderr, "no event after %d frames\n", nb_frames);
+            ret = -1;
+            goto end;
+        }
+        nb_wakeups++;
+        drain_fd(fd);
+
+        struct sxplayer_frame *frame;
+        while ((ret = sxplayer_try_get_next_frame(s, &frame)) > 0) {
+            if (frame->ts <= last_ts) {
+                fprintf(stderr, "frame %f returned after frame %f\n", frame->ts, last_ts);
+                ret = -1;
+            }
+            last_ts = frame->ts;
+            nb_frames++;
+            sxplayer_release_frame(frame);
+            if (ret < 0)
+                goto end;
+        }
+        if (ret < 0)
+            break;
+    }
+
+    printf("frames:%d wakeups:%d reference:%d\n", nb_frames, nb_wakeups, nb_ref_frames);
+
+    ret = 0;
+    if (!nb_frames || nb_frames != nb_ref_frames) {
+        fprintf(stderr, "%d frames returned, expected %d\n", nb_frames, nb_ref_frames);
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s);
+    sxplayer_free(&ref);
+    return ret;
+}
+#endif
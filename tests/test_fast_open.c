@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 20
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration, int fast_open)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "fast_open", fast_open);
+    if (fast_open) {
+        sxplayer_set_option(s, "probesize", 32 << 10);
+        sxplayer_set_option(s, "analyzeduration", 0.1);
+    }
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct sxplayer_info ref_info, info;
+    struct sxplayer_stats stats;
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration, 0);
+    struct sxplayer_ctx *s   = create_context(filename, use_pkt_duration, 1);
+
+    if (!ref || !s) {
+        ret = -1;
+        goto end;
+    }
+
+    if ((ret = sxplayer_get_info(ref, &ref_info)) < 0 ||
+        (ret = sxplayer_get_info(s, &info)) < 0)
+        goto end;
+
+    if (info.width != ref_info.width || info.height != ref_info.height ||
+        info.timebase[0] != ref_info.timebase[0] || info.timebase[1] != ref_info.timebase[1]) {
+        fprintf(stderr, "fast open info %dx%d tb:%d/%d mismatches %dx%d tb:%d/%d\n",
+                info.width, info.height, info.timebase[0], info.timebase[1],
+                ref_info.width, ref_info.height, ref_info.timebase[0], ref_info.timebase[1]);
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *ref_frame = sxplayer_get_next_frame(ref);
+        struct sxplayer_frame *frame     = sxplayer_get_next_frame(s);
+        if (!ref_frame || !frame) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            ret = -1;
+        } else if (frame->ts != ref_frame->ts) {
+            fprintf(stderr, "frame #%d: ts %f mismatches %f\n", i, frame->ts, ref_frame->ts);
+            ret = -1;
+        }
+        sxplayer_release_frame(ref_frame);
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = sxplayer_get_stats(s, &stats);
+    if (ret < 0)
+        goto end;
+
+    printf("open:%"PRId64"us first frame:%"PRId64"us fast opened:%d\n",
+           stats.open_duration, stats.time_to_first_frame, stats.fast_opened);
+
+    if (stats.open_duration <= 0 || stats.time_to_first_frame < stats.open_duration) {
+        fprintf(stderr, "invalid open (%"PRId64") or first frame (%"PRId64") time\n",
+                stats.open_duration, stats.time_to_first_frame);
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s);
+    sxplayer_free(&ref);
+    return ret;
+}
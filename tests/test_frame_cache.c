@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define START_TS (2*1000000)
+#define NB_STEPS 25
+#define STEP_TS  40000
+#define NB_PASSES 3
+
+static int64_t get_frame_ts(struct sxplayer_ctx *s, int64_t ts, int64_t prev_ts)
+{
+    struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, ts);
+    if (!frame)
+        return prev_ts;
+    const int64_t frame_ts = frame->ms;
+    sxplayer_release_frame(frame);
+    return frame_ts;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_stats stats;
+    struct sxplayer_ctx *s1 = sxplayer_create(filename);
+    struct sxplayer_ctx *s2 = sxplayer_create(filename);
+
+    if (!s1 || !s2)
+        goto end;
+
+    sxplayer_set_option(s1, "auto_hwaccel", 0);
+    sxplayer_set_option(s1, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s2, "auto_hwaccel", 0);
+    sxplayer_set_option(s2, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s2, "frame_cache_size", 256);
+
+    /* Scrub back and forth over the same section: the cached frames must be
+     * identical to the decoded ones */
+    int64_t ts1 = -1, ts2 = -1;
+    for (int pass = 0; pass < NB_PASSES; pass++) {
+        for (int i = 0; i < NB_STEPS; i++) {
+            const int step = pass & 1 ? NB_STEPS - 1 - i : i;
+            const int64_t ts = START_TS + step * STEP_TS;
+            ts1 = get_frame_ts(s1, ts, ts1);
+            ts2 = get_frame_ts(s2, ts, ts2);
+            if (ts1 != ts2) {
+                fprintf(stderr, "pass %d: frame mismatch at %"PRId64": %"PRId64" != %"PRId64"\n",
+                        pass, ts, ts1, ts2);
+                goto end;
+            }
+        }
+    }
+
+    ret = sxplayer_get_stats(s2, &stats);
+    if (ret < 0)
+        goto end;
+
+    printf("cache hits:%"PRId64" misses:%"PRId64"\n", stats.nb_cache_hits, stats.nb_cache_misses);
+    if (!stats.nb_cache_hits) {
+        fprintf(stderr, "no request served from the cache\n");
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s1);
+    sxplayer_free(&s2);
+    return ret;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <sxplayer.h>
+
+#define END_TIME     2.0
+#define BUSY_PERIOD  5
+
+struct push_state {
+    atomic_int ended;
+    atomic_int stalled;         // a frame was refused and the delivery is not resumed yet
+    int nb_frames;
+    int nb_refused;
+    int refused;                // the previous frame offered was refused
+    double refused_ts;
+    double last_ts;
+    int ret;
+};
+
+static int frame_callback(void *arg, struct sxplayer_frame *frame)
+{
+    struct push_state *st = arg;
+
+    if (!frame) {
+        atomic_store(&st->ended, 1);
+        return 0;
+    }
+
+    if (st->refused) {
+        if (atomic_load(&st->stalled)) {
+            fprintf(stderr, "frame %f offered again before the delivery is resumed\n", frame->ts);
+            st->ret = -1;
+        }
+        if (frame->ts != st->refused_ts) {
+            fprintf(stderr, "frame %f offered instead of the refused frame %f\n", frame->ts, st->refused_ts);
+            st->ret = -1;
+        }
+        st->refused = 0;
+    } else if (st->nb_frames % BUSY_PERIOD == BUSY_PERIOD - 1) {
+        /* Refuse the frame once to exercise the backpressure */
+        st->refused = 1;
+        st->refused_ts = frame->ts;
+        st->nb_refused++;
+        atomic_store(&st->stalled, 1);
+        return 1;
+    }
+
+    if (st->nb_frames && frame->ts <= st->last_ts) {
+        fprintf(stderr, "frame %f pushed after frame %f\n", frame->ts, st->last_ts);
+        st->ret = -1;
+    }
+    st->last_ts = frame->ts;
+    st->nb_frames++;
+    sxplayer_release_frame(frame);
+    return 0;
+}
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "end_time", END_TIME);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    int nb_ref_frames = 0;
+    struct push_state st = {0};
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration);
+    struct sxplayer_ctx *s   = create_context(filename, use_pkt_duration);
+
+    if (!ref || !s) {
+        ret = -1;
+        goto end;
+    }
+
+    for (;;) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(ref);
+        if (!frame)
+            break;
+        nb_ref_frames++;
+        sxplayer_release_frame(frame);
+    }
+
+    ret = sxplayer_set_frame_callback(s, frame_callback, &st);
+    if (ret < 0)
+        goto end;
+
+    struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+    if (frame) {
+        fprintf(stderr, "frame requested in push mode\n");
+        sxplayer_release_frame(frame);
+        ret = -1;
+        goto end;
+    }
+
+    ret = sxplayer_start(s);
+    if (ret < 0)
+        goto end;
+
+    while (!atomic_load(&st.ended)) {
+        if (atomic_load(&st.stalled)) {
+            atomic_store(&st.stalled, 0);
+            sxplayer_resume_frame_callback(s);
+        }
+    }
+
+    printf("pushed:%d refused:%d reference:%d\n", st.nb_frames, st.nb_refused, nb_ref_frames);
+
+    ret = st.ret;
+    if (!st.nb_frames || st.nb_frames != nb_ref_frames || !st.nb_refused) {
+        fprintf(stderr, "%d frames pushed (%d refused once), expected %d\n",
+                st.nb_frames, st.nb_refused, nb_ref_frames);
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s);
+    sxplayer_free(&ref);
+    return ret;
+}
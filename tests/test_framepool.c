@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_WARMUP_FRAMES 100
+#define NB_FRAMES 200
+
+static int get_frames(struct sxplayer_ctx *s, int n)
+{
+    for (int i = 0; i < n; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            return -1;
+        }
+        sxplayer_release_frame(frame);
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct sxplayer_stats warm, stats;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    /* The frame containers alive at the same time are bounded by the queues
+     * sizes: once they have all been allocated, they are only recycled, even
+     * when a seek flushes the queues */
+    ret = get_frames(s, NB_WARMUP_FRAMES);
+    if (ret < 0)
+        goto end;
+    ret = sxplayer_get_stats(s, &warm);
+    if (ret < 0)
+        goto end;
+
+    ret = get_frames(s, NB_FRAMES / 2);
+    if (ret < 0)
+        goto end;
+    ret = sxplayer_seek(s, 0);
+    if (ret < 0)
+        goto end;
+    ret = get_frames(s, NB_FRAMES / 2);
+    if (ret < 0)
+        goto end;
+    ret = sxplayer_get_stats(s, &stats);
+    if (ret < 0)
+        goto end;
+
+    printf("frame allocs:%"PRId64" wrapper allocs:%"PRId64" reuses:%"PRId64"\n",
+           stats.nb_frame_allocs, stats.nb_wrapper_allocs, stats.nb_pool_reuses);
+
+    /* Every frame is released before the next one is requested, so a single
+     * wrapper is expected to be recycled all along */
+    if (stats.nb_wrapper_allocs != 1) {
+        fprintf(stderr, "%"PRId64" frame wrappers allocated, expected 1\n", stats.nb_wrapper_allocs);
+        ret = -1;
+    }
+
+    if (stats.nb_frame_allocs != warm.nb_frame_allocs) {
+        fprintf(stderr, "%"PRId64" frames allocated for %d frames decoded after the warm-up\n",
+                stats.nb_frame_allocs - warm.nb_frame_allocs, NB_FRAMES);
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
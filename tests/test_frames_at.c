@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define SOURCE_FPS 25
+
+static const int64_t targets[] = {
+    12000000,
+     3000000,
+     3010000,
+    45500000,
+           0,
+     3000000,
+    44000000,
+    12080000,
+      -10000,
+     7400000,
+};
+
+#define NB_TARGETS (sizeof(targets) / sizeof(*targets))
+
+static int check_frame(const struct sxplayer_frame *f, int64_t t64)
+{
+    if (t64 < 0) {
+        if (f) {
+            fprintf(stderr, "got a frame for negative t=%"PRId64"\n", t64);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%"PRId64"\n", t64);
+        return -1;
+    }
+
+    const double t = t64 / 1000000.;
+    if (f->ts > t || t - f->ts >= 1. / SOURCE_FPS) {
+        fprintf(stderr, "requested t=%f, got frame_ts=%f\n", t, f->ts);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct sxplayer_frame *frames[NB_TARGETS];
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    /* Return a frame with the single frame API first: the batch must still
+     * honor a target matching this frame */
+    struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, 7400000);
+    if (!frame)
+        return -1;
+    sxplayer_release_frame(frame);
+
+    for (int r = 0; r < 2; r++) {
+        printf("run #%d\n", r+1);
+
+        if (sxplayer_get_frames_at(s, targets, NB_TARGETS, frames) < 0) {
+            fprintf(stderr, "unable to get the frames\n");
+            ret = -1;
+            break;
+        }
+
+        for (int i = 0; i < NB_TARGETS; i++) {
+            if (check_frame(frames[i], targets[i]) < 0)
+                ret = -1;
+            sxplayer_release_frame(frames[i]);
+        }
+    }
+
+    sxplayer_free(&s);
+    return ret;
+}
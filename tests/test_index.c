@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <sxplayer.h>
+
+#define NB_JUMPS 20
+#define JUMP_STEP 0.7
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv>\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+
+    int ret = 0;
+    int64_t nb_frames = 0;
+    struct sxplayer_info info;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "index_scan", 1);
+
+    /* The packet scan only reads the file, so it is expected to be done long
+     * before all the frames are decoded */
+    for (;;) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame)
+            break;
+        nb_frames++;
+        sxplayer_release_frame(frame);
+    }
+
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+
+    printf("frames:%"PRId64" keyframes:%"PRId64" avg gop:%f (decoded %"PRId64" frames)\n",
+           info.nb_frames, info.nb_keyframes, info.avg_gop_length, nb_frames);
+
+    if (info.nb_frames != nb_frames || info.nb_keyframes <= 0 || info.nb_keyframes > info.nb_frames ||
+        fabs(info.avg_gop_length - info.nb_frames / (double)info.nb_keyframes) > 1e-6) {
+        fprintf(stderr, "inconsistent index information\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* Jump forward by less than a GOP length or more, whether the player
+     * seeks or decodes, the frame must be the one displayed at that time */
+    const double frame_duration = info.duration / info.nb_frames;
+    double prev_ts = -1;
+    for (int i = 0; i < NB_JUMPS; i++) {
+        const double t = i * JUMP_STEP;
+        if (t >= info.duration)
+            break;
+        struct sxplayer_frame *frame = sxplayer_get_frame(s, t);
+        if (!frame) {
+            if (!i || prev_ts < 0) {
+                fprintf(stderr, "unable to get a frame at %f\n", t);
+                ret = -1;
+            }
+            continue;
+        }
+        if (frame->ts > t || t - frame->ts > 2 * frame_duration) {
+            fprintf(stderr, "got frame %f for t=%f\n", frame->ts, t);
+            ret = -1;
+        }
+        prev_ts = frame->ts;
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            break;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
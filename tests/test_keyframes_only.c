@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <sxplayer.h>
+
+#define MAX_KEYFRAMES 1024
+#define NB_CHECKS 50
+
+static struct sxplayer_ctx *open_media(const char *filename, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "index_scan", 1);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "keyframes_only", 1);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    int nb_keyframes = 0;
+    double keyframes[MAX_KEYFRAMES];
+    struct sxplayer_info info;
+    struct sxplayer_ctx *s = open_media(filename, use_pkt_duration);
+
+    if (!s)
+        return -1;
+
+    for (;;) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame)
+            break;
+        if (nb_keyframes == MAX_KEYFRAMES) {
+            fprintf(stderr, "too many keyframes\n");
+            ret = -1;
+        } else {
+            keyframes[nb_keyframes++] = frame->ts;
+        }
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+
+    printf("decoded %d keyframes, %"PRId64" in the index over %"PRId64" frames\n",
+           nb_keyframes, info.nb_keyframes, info.nb_frames);
+
+    if (!nb_keyframes || nb_keyframes != info.nb_keyframes) {
+        fprintf(stderr, "unexpected number of keyframes decoded\n");
+        ret = -1;
+        goto end;
+    }
+    sxplayer_free(&s);
+
+    /* The packet index is not guaranteed to be ready when the first requests
+     * are made, so a new player is only checked against the keyframes */
+    s = open_media(filename, use_pkt_duration);
+    if (!s)
+        return -1;
+    for (int i = 0; i < NB_CHECKS; i++) {
+        const double t = i * info.duration / NB_CHECKS;
+        struct sxplayer_frame *frame = sxplayer_get_frame(s, t);
+        if (!frame)
+            continue;
+
+        int found = 0;
+        for (int k = 0; k < nb_keyframes && !found; k++)
+            found = keyframes[k] == frame->ts;
+        if (!found) {
+            fprintf(stderr, "frame %f returned at t=%f is not a keyframe\n", frame->ts, t);
+            ret = -1;
+        }
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+    /* Once the index is complete, the closest keyframe is expected */
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+    if (info.nb_keyframes) {
+        for (int i = NB_CHECKS - 1; i >= 0; i--) {
+            const double t = i * info.duration / NB_CHECKS;
+            struct sxplayer_frame *frame = sxplayer_get_frame(s, t);
+            if (!frame)
+                continue;
+
+            double closest = keyframes[0];
+            for (int k = 1; k < nb_keyframes; k++)
+                if (fabs(keyframes[k] - t) < fabs(closest - t))
+                    closest = keyframes[k];
+            if (fabs(frame->ts - t) > fabs(closest - t)) {
+                fprintf(stderr, "frame %f returned at t=%f while keyframe %f is closer\n",
+                        frame->ts, t, closest);
+                ret = -1;
+            }
+            sxplayer_release_frame(frame);
+            if (ret < 0)
+                goto end;
+        }
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 50
+
+static struct sxplayer_ctx *create_ctx(const char *filename, int max_bytes, int policy)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "max_packets_bytes", max_bytes);
+    sxplayer_set_option(s, "max_frames_bytes", max_bytes);
+    sxplayer_set_option(s, "max_sink_bytes", max_bytes);
+    sxplayer_set_option(s, "budget_policy", policy);
+    return s;
+}
+
+/* Every queue holds a single packet or frame at most, whatever its size */
+static int check_next_frame(struct sxplayer_ctx *s, int i, double *last_ts)
+{
+    int ret = 0;
+    struct sxplayer_stats stats;
+    struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+    if (!frame) {
+        fprintf(stderr, "unable to get frame #%d\n", i);
+        return -1;
+    }
+
+    if (frame->ts <= *last_ts) {
+        fprintf(stderr, "frame #%d @ %f not after %f\n", i, frame->ts, *last_ts);
+        ret = -1;
+    }
+    *last_ts = frame->ts;
+
+    const int64_t frame_size = (int64_t)frame->linesize * frame->height;
+    sxplayer_get_stats(s, &stats);
+    if (stats.queued_bytes > 2 * frame_size + (1 << 20)) {
+        fprintf(stderr, "frame #%d: %"PRId64" bytes queued for frames of %"PRId64" bytes\n",
+                i, stats.queued_bytes, frame_size);
+        ret = -1;
+    }
+
+    sxplayer_release_frame(frame);
+    return ret;
+}
+
+static int test_budget(const char *filename, int max_bytes, int policy)
+{
+    int ret = 0;
+    double last_ts = -1;
+    struct sxplayer_ctx *s = create_ctx(filename, max_bytes, policy);
+    if (!s)
+        return -1;
+    for (int i = 0; i < NB_FRAMES && ret >= 0; i++)
+        ret = check_next_frame(s, i, &last_ts);
+    sxplayer_free(&s);
+    return ret;
+}
+
+/* The contexts keep making progress while the process-wide budget is
+ * exhausted by the others */
+static int test_global_budget(const char *filename)
+{
+    int ret = 0;
+    double last_ts[2] = {-1, -1};
+    struct sxplayer_ctx *s[2] = {
+        create_ctx(filename, 0, SXPLAYER_BUDGET_BLOCK),
+        create_ctx(filename, 0, SXPLAYER_BUDGET_BLOCK),
+    };
+
+    sxplayer_set_memory_budget(1);
+    if (!s[0] || !s[1])
+        ret = -1;
+    for (int i = 0; i < NB_FRAMES && ret >= 0; i++)
+        for (int j = 0; j < 2 && ret >= 0; j++)
+            ret = check_next_frame(s[j], i, &last_ts[j]);
+    sxplayer_free(&s[0]);
+    sxplayer_free(&s[1]);
+    sxplayer_set_memory_budget(0);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac != 2) {
+        fprintf(stderr, "Usage: %s <media>\n", av[0]);
+        return -1;
+    }
+
+    if (test_budget(av[1], 1, SXPLAYER_BUDGET_BLOCK) < 0 ||
+        test_budget(av[1], 1, SXPLAYER_BUDGET_DROP) < 0 ||
+        test_global_budget(av[1]) < 0)
+        return -1;
+
+    return 0;
+}
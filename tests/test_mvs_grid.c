@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 50
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct sxplayer_info info;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "export_mvs_grid", 1);
+
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+
+    const int grid_w = (info.width  + 15) / 16;
+    const int grid_h = (info.height + 15) / 16;
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            ret = -1;
+            goto end;
+        }
+
+        if (frame->mvs) {
+            if (!frame->mvs_dx || !frame->mvs_dy ||
+                frame->mvs_grid_w != grid_w || frame->mvs_grid_h != grid_h) {
+                fprintf(stderr, "frame #%d: invalid %dx%d grid for %d motion vectors (expected %dx%d)\n",
+                        i, frame->mvs_grid_w, frame->mvs_grid_h, frame->nb_mvs, grid_w, grid_h);
+                ret = -1;
+            }
+        } else if (frame->mvs_dx || frame->mvs_dy) {
+            fprintf(stderr, "frame #%d: grid exported without motion vectors\n", i);
+            ret = -1;
+        }
+
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            break;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 30
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration, const char *filters)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "sw_pix_fmt", SXPLAYER_PIXFMT_AUTO);
+    if (filters)
+        sxplayer_set_option(s, "filters", filters);
+    return s;
+}
+
+static int get_bytes_per_sample(int pix_fmt)
+{
+    switch (pix_fmt) {
+    case SXPLAYER_PIXFMT_P010LE:
+    case SXPLAYER_PIXFMT_YUV420P10LE:
+    case SXPLAYER_PIXFMT_YUV422P10LE:
+    case SXPLAYER_PIXFMT_YUV444P10LE:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+/* The frames delivered without filtergraph must be the same as the ones going
+ * through a graph doing nothing */
+static int compare_frames(const struct sxplayer_frame *f1, const struct sxplayer_frame *f2, int i)
+{
+    if (f1->ms != f2->ms || f1->pix_fmt != f2->pix_fmt ||
+        f1->width != f2->width || f1->height != f2->height) {
+        fprintf(stderr, "frame #%d mismatch: %dx%d fmt:%d @ %"PRId64" != %dx%d fmt:%d @ %"PRId64"\n", i,
+                f1->width, f1->height, f1->pix_fmt, f1->ms,
+                f2->width, f2->height, f2->pix_fmt, f2->ms);
+        return -1;
+    }
+
+    if (f1->pix_fmt == SXPLAYER_PIXFMT_RGBA || f1->pix_fmt == SXPLAYER_PIXFMT_BGRA) {
+        fprintf(stderr, "frame #%d: converted to rgba/bgra instead of kept in the decoder format\n", i);
+        return -1;
+    }
+
+    const int row_size = f1->width * get_bytes_per_sample(f1->pix_fmt);
+    for (int y = 0; y < f1->height; y++) {
+        if (memcmp(f1->datap[0] + y * f1->linesizep[0],
+                   f2->datap[0] + y * f2->linesizep[0], row_size)) {
+            fprintf(stderr, "frame #%d: luma plane differs at line %d\n", i, y);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_ctx *s   = create_context(filename, use_pkt_duration, NULL);
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration, "null");
+
+    if (!s || !ref)
+        goto end;
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *f1 = sxplayer_get_next_frame(s);
+        struct sxplayer_frame *f2 = sxplayer_get_next_frame(ref);
+        if (!f1 || !f2) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            sxplayer_release_frame(f1);
+            sxplayer_release_frame(f2);
+            goto end;
+        }
+        ret = compare_frames(f1, f2, i);
+        sxplayer_release_frame(f1);
+        sxplayer_release_frame(f2);
+        if (ret < 0)
+            goto end;
+    }
+
+end:
+    sxplayer_free(&s);
+    sxplayer_free(&ref);
+    return ret;
+}
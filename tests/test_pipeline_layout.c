@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_THREADS 2
+
+static const int64_t targets[] = {3000000, 500000, 6100000, 2040000};
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration,
+                                           int layout, struct sxplayer_pool **poolp, double end_time)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "pipeline_layout", layout);
+    if (poolp)
+        sxplayer_set_option(s, "pool", poolp);
+    if (end_time > 0)
+        sxplayer_set_option(s, "end_time", end_time);
+    return s;
+}
+
+/* Both contexts must deliver the same frames, up to the end of the stream */
+static int compare_next_frames(struct sxplayer_ctx *ref, struct sxplayer_ctx *s, const char *name)
+{
+    for (int i = 0;; i++) {
+        struct sxplayer_frame *f1 = sxplayer_get_next_frame(ref);
+        struct sxplayer_frame *f2 = sxplayer_get_next_frame(s);
+        const int match = (!f1 && !f2) || (f1 && f2 && f1->ms == f2->ms);
+
+        if (!match)
+            fprintf(stderr, "%s: frame #%d mismatch: %"PRId64" != %"PRId64"\n",
+                    name, i, f1 ? f1->ms : -1, f2 ? f2->ms : -1);
+        const int end = !f1 || !f2;
+        sxplayer_release_frame(f1);
+        sxplayer_release_frame(f2);
+        if (!match)
+            return -1;
+        if (end)
+            return 0;
+    }
+}
+
+static int compare_seeks(struct sxplayer_ctx *ref, struct sxplayer_ctx *s, const char *name)
+{
+    for (int i = 0; i < sizeof(targets) / sizeof(*targets); i++) {
+        struct sxplayer_frame *f1 = sxplayer_get_frame_ms(ref, targets[i]);
+        struct sxplayer_frame *f2 = sxplayer_get_frame_ms(s,   targets[i]);
+        const int match = f1 && f2 && f1->ms == f2->ms;
+
+        if (!match)
+            fprintf(stderr, "%s: frame mismatch at %"PRId64": %"PRId64" != %"PRId64"\n",
+                    name, targets[i], f1 ? f1->ms : -1, f2 ? f2->ms : -1);
+        sxplayer_release_frame(f1);
+        sxplayer_release_frame(f2);
+        if (!match)
+            return -1;
+    }
+    return 0;
+}
+
+static int run_test(const char *filename, int use_pkt_duration, struct sxplayer_pool **poolp,
+                    double end_time, const char *name)
+{
+    int ret = -1;
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration, SXPLAYER_PIPELINE_SPLIT, NULL, end_time);
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration, SXPLAYER_PIPELINE_FUSED, poolp, end_time);
+
+    if (!ref || !s)
+        goto end;
+
+    if ((ret = compare_next_frames(ref, s, name)) < 0 ||
+        (ret = compare_seeks(ref, s, name)) < 0 ||
+        (ret = compare_next_frames(ref, s, name)) < 0)
+        goto end;
+
+end:
+    sxplayer_free(&ref);
+    sxplayer_free(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct sxplayer_pool *pool = sxplayer_pool_create(NB_THREADS);
+    if (!pool)
+        return -1;
+
+    int ret;
+    if ((ret = run_test(filename, use_pkt_duration, NULL,  -1,  "fused"))               < 0 ||
+        (ret = run_test(filename, use_pkt_duration, NULL,  2.0, "fused with end time")) < 0 ||
+        (ret = run_test(filename, use_pkt_duration, &pool, -1,  "fused on a pool"))     < 0)
+        goto end;
+
+end:
+    sxplayer_pool_free(&pool);
+    return ret;
+}
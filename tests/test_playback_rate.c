@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 10
+
+static int check_rate(const char *filename, int use_pkt_duration, const int64_t *ref,
+                      int rate, int use_setter)
+{
+    int ret = 0;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    if (use_setter)
+        ret = sxplayer_set_playback_rate(s, rate);
+    else
+        ret = sxplayer_set_option(s, "playback_rate", (double)rate);
+    if (ret < 0)
+        goto end;
+
+    /* Only one frame out of rate is meant to be presented, the others must
+     * not come out of the pipeline */
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame) {
+            fprintf(stderr, "rate %d: unable to get frame #%d\n", rate, i);
+            ret = -1;
+            goto end;
+        }
+        if (frame->ms != ref[i * rate]) {
+            fprintf(stderr, "rate %d: frame #%d has ts %"PRId64", expected %"PRId64"\n",
+                    rate, i, frame->ms, ref[i * rate]);
+            ret = -1;
+        }
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
+
+/* Requests twice per frame at the playback rate, as a display faster than the
+ * media would: every frame is meant to be presented, none must be dropped */
+static int check_display_rate(const char *filename, int use_pkt_duration, const int64_t *ref, int rate)
+{
+    int ret = 0;
+    const int64_t frame_duration = ref[1] - ref[0];
+    const double display_rate = 2. * rate * 1000000. / frame_duration;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "playback_rate", (double)rate);
+    sxplayer_set_option(s, "display_rate", display_rate);
+
+    int n = 0;
+    for (int i = 0; n < NB_FRAMES; i++) {
+        const int64_t t = ref[0] + i * rate * 1000000. / display_rate;
+        struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, t);
+        if (!frame) {
+            if (i > 4 * NB_FRAMES) {
+                fprintf(stderr, "display rate %f: no frame after #%d\n", display_rate, n);
+                ret = -1;
+                goto end;
+            }
+            continue;
+        }
+        if (frame->ms != ref[n]) {
+            fprintf(stderr, "display rate %f: frame #%d requested at %"PRId64" has ts %"PRId64", expected %"PRId64"\n",
+                    display_rate, n, t, frame->ms, ref[n]);
+            ret = -1;
+        }
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+        n++;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    int64_t ref[NB_FRAMES * 4];
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    for (int i = 0; i < NB_FRAMES * 4; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame) {
+            fprintf(stderr, "unable to get reference frame #%d\n", i);
+            ret = -1;
+            goto end;
+        }
+        ref[i] = frame->ms;
+        sxplayer_release_frame(frame);
+    }
+
+    ret = check_rate(filename, use_pkt_duration, ref, 4, 0);
+    if (ret < 0)
+        goto end;
+
+    ret = check_rate(filename, use_pkt_duration, ref, 2, 1);
+    if (ret < 0)
+        goto end;
+
+    ret = check_display_rate(filename, use_pkt_duration, ref, 2);
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sxplayer.h>
+
+#define NB_CONTEXTS 4
+#define NB_THREADS  2
+#define NB_FRAMES   50
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    double last_ts[NB_CONTEXTS];
+    struct sxplayer_ctx *ctxs[NB_CONTEXTS] = {0};
+
+    /* More contexts than workers: the workers must be shared for the contexts
+     * to make progress */
+    struct sxplayer_pool *pool = sxplayer_pool_create(NB_THREADS);
+    if (!pool)
+        return -1;
+
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        ctxs[i] = sxplayer_create(filename);
+        if (!ctxs[i]) {
+            ret = -1;
+            goto end;
+        }
+        sxplayer_set_option(ctxs[i], "auto_hwaccel", 0);
+        sxplayer_set_option(ctxs[i], "use_pkt_duration", use_pkt_duration);
+        sxplayer_set_option(ctxs[i], "pool", &pool);
+        last_ts[i] = -1;
+    }
+
+    /* Consume the contexts in an interleaved way */
+    for (int n = 0; n < NB_FRAMES; n++) {
+        for (int i = 0; i < NB_CONTEXTS; i++) {
+            struct sxplayer_frame *frame = sxplayer_get_next_frame(ctxs[i]);
+            if (!frame) {
+                fprintf(stderr, "context #%d: unable to get frame #%d\n", i, n);
+                ret = -1;
+                goto end;
+            }
+            if (frame->ts <= last_ts[i]) {
+                fprintf(stderr, "context #%d: frame #%d ts %f is not after %f\n",
+                        i, n, frame->ts, last_ts[i]);
+                ret = -1;
+            }
+            last_ts[i] = frame->ts;
+            sxplayer_release_frame(frame);
+            if (ret < 0)
+                goto end;
+        }
+    }
+
+    /* Seeking in one context must not disturb the others */
+    struct sxplayer_frame *frame = sxplayer_get_frame(ctxs[0], 0.0);
+    if (!frame || frame->ts >= last_ts[0]) {
+        fprintf(stderr, "context #0: unable to get back to the first frame\n");
+        ret = -1;
+    }
+    sxplayer_release_frame(frame);
+
+    for (int i = 1; i < NB_CONTEXTS; i++) {
+        frame = sxplayer_get_next_frame(ctxs[i]);
+        if (!frame || frame->ts <= last_ts[i]) {
+            fprintf(stderr, "context #%d: unable to get the frame following %f\n", i, last_ts[i]);
+            ret = -1;
+        }
+        sxplayer_release_frame(frame);
+    }
+
+end:
+    for (int i = 0; i < NB_CONTEXTS; i++)
+        sxplayer_free(&ctxs[i]);
+    sxplayer_pool_free(&pool);
+    return ret;
+}
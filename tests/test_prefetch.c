@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 60
+#define MAX_NB_PREFETCH 4
+
+static int check_prefetch(const char *filename, int adaptive, double duration)
+{
+    int ret = 0;
+    double last_ts = -1;
+    struct sxplayer_stats stats;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "max_nb_sink", 1);
+    sxplayer_set_option(s, "max_nb_prefetch", MAX_NB_PREFETCH);
+    sxplayer_set_option(s, "adaptive_prefetch", adaptive);
+    sxplayer_set_option(s, "prefetch_duration", duration);
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            ret = -1;
+            goto end;
+        }
+        if (frame->ts <= last_ts) {
+            fprintf(stderr, "frame #%d @ %f not after %f\n", i, frame->ts, last_ts);
+            ret = -1;
+        }
+        last_ts = frame->ts;
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+
+        ret = sxplayer_get_stats(s, &stats);
+        if (ret < 0)
+            goto end;
+        if (stats.sink_depth < 1 || stats.sink_depth > MAX_NB_PREFETCH) {
+            fprintf(stderr, "sink depth %d out of [1,%d]\n", stats.sink_depth, MAX_NB_PREFETCH);
+            ret = -1;
+            goto end;
+        }
+    }
+
+    printf("adaptive:%d duration:%g sink depth:%d\n", adaptive, duration, stats.sink_depth);
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac != 2) {
+        fprintf(stderr, "Usage: %s <media>\n", av[0]);
+        return -1;
+    }
+
+    /* Ten seconds of media always exceed the budget */
+    struct sxplayer_stats stats;
+    struct sxplayer_ctx *s = sxplayer_create(av[1]);
+    if (!s)
+        return -1;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "prefetch_duration", 10.0);
+    sxplayer_set_option(s, "max_nb_prefetch", MAX_NB_PREFETCH);
+    struct sxplayer_frame *frame = sxplayer_get_frame(s, 0.0);
+    sxplayer_release_frame(frame);
+    int ret = frame ? sxplayer_get_stats(s, &stats) : -1;
+    sxplayer_free(&s);
+    if (ret < 0)
+        return -1;
+    if (stats.sink_depth != MAX_NB_PREFETCH) {
+        fprintf(stderr, "prefetch_duration: sink depth is %d, expected %d\n",
+                stats.sink_depth, MAX_NB_PREFETCH);
+        return -1;
+    }
+
+    if (check_prefetch(av[1], 1, 0.0) < 0 ||
+        check_prefetch(av[1], 1, 0.1) < 0)
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sxplayer.h>
+
+struct info_result {
+    int nb_calls;
+    int ret;
+    struct sxplayer_info info;
+};
+
+static void info_callback(void *arg, int ret, const struct sxplayer_info *info)
+{
+    struct info_result *res = arg;
+    res->nb_calls++;
+    res->ret = ret;
+    if (info)
+        res->info = *info;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct info_result res = {0};
+    struct sxplayer_info info;
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+
+    if (!s)
+        return -1;
+
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "start_time", 1.0);
+
+    ret = sxplayer_prepare(s);
+    if (ret < 0)
+        goto end;
+
+    ret = sxplayer_get_info_async(s, &res, info_callback);
+    if (ret < 0)
+        goto end;
+
+    /* Fetching a frame processes every pending request first, so the callback
+     * has been called once it returns */
+    struct sxplayer_frame *frame = sxplayer_get_frame(s, 0.0);
+    if (!frame) {
+        fprintf(stderr, "unable to get the first frame\n");
+        ret = -1;
+        goto end;
+    }
+    sxplayer_release_frame(frame);
+
+    if (res.nb_calls != 1 || res.ret < 0) {
+        fprintf(stderr, "info callback called %d times, ret=%d\n", res.nb_calls, res.ret);
+        ret = -1;
+        goto end;
+    }
+
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+
+    if (info.width != res.info.width || info.height != res.info.height ||
+        info.duration != res.info.duration ||
+        info.timebase[0] != res.info.timebase[0] || info.timebase[1] != res.info.timebase[1]) {
+        fprintf(stderr, "async info %dx%d %f mismatches %dx%d %f\n",
+                res.info.width, res.info.height, res.info.duration,
+                info.width, info.height, info.duration);
+        ret = -1;
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define TARGET_TS (3*1000000)
+#define MAX_FRAMES 1024
+#define NB_STEPS 60
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    int nb_frames = 0;
+    int64_t frames_ts[MAX_FRAMES];
+    struct sxplayer_ctx *s1 = sxplayer_create(filename);
+    struct sxplayer_ctx *s2 = sxplayer_create(filename);
+    struct sxplayer_frame *frame;
+
+    if (!s1 || !s2)
+        goto end;
+
+    sxplayer_set_option(s1, "auto_hwaccel", 0);
+    sxplayer_set_option(s1, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s2, "auto_hwaccel", 0);
+    sxplayer_set_option(s2, "use_pkt_duration", use_pkt_duration);
+
+    /* Reference: every frame up to the target, in forward order */
+    while (nb_frames < MAX_FRAMES) {
+        frame = sxplayer_get_next_frame(s2);
+        if (!frame)
+            break;
+        const int64_t ts = frame->ms;
+        sxplayer_release_frame(frame);
+        if (ts > TARGET_TS)
+            break;
+        frames_ts[nb_frames++] = ts;
+    }
+
+    frame = sxplayer_get_frame_ms(s1, TARGET_TS);
+    if (!frame) {
+        fprintf(stderr, "unable to get frame at %d\n", TARGET_TS);
+        goto end;
+    }
+    int idx = nb_frames - 1;
+    while (idx >= 0 && frames_ts[idx] != frame->ms)
+        idx--;
+    sxplayer_release_frame(frame);
+    if (idx < 0) {
+        fprintf(stderr, "frame at %d not found in the reference\n", TARGET_TS);
+        goto end;
+    }
+
+    for (int i = 0; i < NB_STEPS && idx > 0; i++) {
+        frame = sxplayer_get_prev_frame(s1);
+        idx--;
+        if (!frame) {
+            fprintf(stderr, "unable to get previous frame (step %d)\n", i);
+            goto end;
+        }
+        const int64_t ts = frame->ms;
+        sxplayer_release_frame(frame);
+        if (ts != frames_ts[idx]) {
+            fprintf(stderr, "step %d: got frame %"PRId64", expected %"PRId64"\n", i, ts, frames_ts[idx]);
+            goto end;
+        }
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_free(&s1);
+    sxplayer_free(&s2);
+    return ret;
+}
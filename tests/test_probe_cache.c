@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sxplayer.h>
+
+#define NB_FRAMES 20
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration, int probe_cache)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "probe_cache", probe_cache);
+    return s;
+}
+
+static int check_fast_opened(struct sxplayer_ctx *s, const char *name, int expected)
+{
+    struct sxplayer_stats stats;
+    int ret = sxplayer_get_stats(s, &stats);
+    if (ret < 0)
+        return ret;
+    if (stats.fast_opened != expected) {
+        fprintf(stderr, "%s context %s probed\n", name, expected ? "was" : "was not");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    double ref_duration, duration;
+    struct sxplayer_info ref_info, info, uncached_info;
+    struct sxplayer_ctx *ref      = create_context(filename, use_pkt_duration, 1);
+    struct sxplayer_ctx *s        = create_context(filename, use_pkt_duration, 1);
+    struct sxplayer_ctx *uncached = create_context(filename, use_pkt_duration, 0);
+
+    if (!ref || !s || !uncached) {
+        ret = -1;
+        goto end;
+    }
+
+    /* The first context probes the media and fills the cache */
+    if ((ret = sxplayer_get_info(ref, &ref_info)) < 0 ||
+        (ret = sxplayer_get_duration(ref, &ref_duration)) < 0 ||
+        (ret = sxplayer_get_info(s, &info)) < 0 ||
+        (ret = sxplayer_get_duration(s, &duration)) < 0 ||
+        (ret = sxplayer_get_info(uncached, &uncached_info)) < 0)
+        goto end;
+
+    if ((ret = check_fast_opened(ref, "first", 0)) < 0 ||
+        (ret = check_fast_opened(s, "second", 1)) < 0 ||
+        (ret = check_fast_opened(uncached, "uncached", 0)) < 0)
+        goto end;
+
+    if (info.width != ref_info.width || info.height != ref_info.height ||
+        info.timebase[0] != ref_info.timebase[0] || info.timebase[1] != ref_info.timebase[1] ||
+        info.duration != ref_info.duration || duration != ref_duration) {
+        fprintf(stderr, "cached info %dx%d tb:%d/%d duration:%f mismatches %dx%d tb:%d/%d duration:%f\n",
+                info.width, info.height, info.timebase[0], info.timebase[1], duration,
+                ref_info.width, ref_info.height, ref_info.timebase[0], ref_info.timebase[1], ref_duration);
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct sxplayer_frame *ref_frame = sxplayer_get_next_frame(ref);
+        struct sxplayer_frame *frame     = sxplayer_get_next_frame(s);
+        if (!ref_frame || !frame) {
+            fprintf(stderr, "unable to get frame #%d\n", i);
+            ret = -1;
+        } else if (frame->ts != ref_frame->ts || frame->width != ref_frame->width ||
+                   frame->height != ref_frame->height) {
+            fprintf(stderr, "frame #%d: %dx%d ts %f mismatches %dx%d ts %f\n", i,
+                    frame->width, frame->height, frame->ts,
+                    ref_frame->width, ref_frame->height, ref_frame->ts);
+            ret = -1;
+        }
+        sxplayer_release_frame(ref_frame);
+        sxplayer_release_frame(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+end:
+    sxplayer_free(&uncached);
+    sxplayer_free(&s);
+    sxplayer_free(&ref);
+    return ret;
+}
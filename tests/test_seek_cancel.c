@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+/* Pairs of targets: the first seek is abandoned while the pipeline catches
+ * up with it, and the second one must be honored exactly */
+static const int64_t targets[][2] = {
+    {7200000, 2500000},
+    {1500000, 6100000},
+    {4040000, 3900000},
+    {6800000,  500000},
+};
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration);
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration);
+
+    if (!ref || !s)
+        goto end;
+
+    for (int i = 0; i < sizeof(targets) / sizeof(*targets); i++) {
+        /* Start the seek without waiting for its frame */
+        struct sxplayer_frame *frame = sxplayer_get_frame_deadline_ms(s, targets[i][0], 0);
+        sxplayer_release_frame(frame);
+
+        struct sxplayer_frame *f1 = sxplayer_get_frame_ms(ref, targets[i][1]);
+        struct sxplayer_frame *f2 = sxplayer_get_frame_ms(s,   targets[i][1]);
+        const int match = f1 && f2 && f1->ms == f2->ms;
+
+        if (!match)
+            fprintf(stderr, "frame mismatch at %"PRId64" after abandoning %"PRId64": %"PRId64" != %"PRId64"\n",
+                    targets[i][1], targets[i][0], f1 ? f1->ms : -1, f2 ? f2->ms : -1);
+        sxplayer_release_frame(f1);
+        sxplayer_release_frame(f2);
+        if (!match)
+            goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_free(&ref);
+    sxplayer_free(&s);
+    return ret;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_SEEKS 30
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    return s;
+}
+
+static int64_t get_frame_after_seek(struct sxplayer_ctx *s, double t)
+{
+    sxplayer_seek(s, t);
+    struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+    if (!frame)
+        return -1;
+    const int64_t ts = frame->ms;
+    sxplayer_release_frame(frame);
+    return ts;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = -1;
+    struct sxplayer_stats stats;
+    struct sxplayer_ctx *ref = create_context(filename, use_pkt_duration);
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration);
+
+    if (!ref || !s)
+        goto end;
+
+    const double last_target = 1.0 + (NB_SEEKS - 1) * 0.1;
+    const int64_t ref_ts = get_frame_after_seek(ref, last_target);
+    if (ref_ts < 0) {
+        fprintf(stderr, "unable to get the reference frame\n");
+        goto end;
+    }
+
+    /* Get the pipeline running so every seek goes through it */
+    struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+    if (!frame) {
+        fprintf(stderr, "unable to get the first frame\n");
+        goto end;
+    }
+    sxplayer_release_frame(frame);
+
+    /* Scrubbing burst: the control thread is still executing the first seeks
+     * when the next ones are queued */
+    for (int i = 0; i < NB_SEEKS - 1; i++)
+        sxplayer_seek(s, 1.0 + i * 0.1);
+    const int64_t ts = get_frame_after_seek(s, last_target);
+    if (ts != ref_ts) {
+        fprintf(stderr, "got frame %"PRId64" after the burst, expected %"PRId64"\n", ts, ref_ts);
+        goto end;
+    }
+
+    sxplayer_get_stats(s, &stats);
+    printf("superseded seeks: %"PRId64"/%d\n", stats.nb_superseded_seeks, NB_SEEKS);
+    if (stats.nb_superseded_seeks <= 0 || stats.nb_superseded_seeks >= NB_SEEKS) {
+        fprintf(stderr, "unexpected number of superseded seeks\n");
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_free(&ref);
+    sxplayer_free(&s);
+    return ret;
+}
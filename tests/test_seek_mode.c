@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define TARGET 4500000
+
+static struct sxplayer_ctx *create_context(const char *filename, int use_pkt_duration, int seek_mode)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "seek_mode", seek_mode);
+    return s;
+}
+
+static int check_keyframe(const char *filename, int use_pkt_duration, int64_t ref_ts)
+{
+    int ret = -1;
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration, SXPLAYER_SEEK_KEYFRAME);
+    if (!s)
+        return -1;
+
+    struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, TARGET);
+    if (!frame || frame->ms > ref_ts) {
+        fprintf(stderr, "keyframe: got %"PRId64", expected a frame up to %"PRId64"\n",
+                frame ? frame->ms : -1, ref_ts);
+        goto end;
+    }
+    sxplayer_release_frame(frame);
+
+    /* The keyframe stands for the requested time */
+    frame = sxplayer_get_frame_ms(s, TARGET);
+    if (frame) {
+        fprintf(stderr, "keyframe: got a new frame (%"PRId64") for the same time\n", frame->ms);
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_release_frame(frame);
+    sxplayer_free(&s);
+    return ret;
+}
+
+static int check_progressive(const char *filename, int use_pkt_duration, int64_t ref_ts)
+{
+    int ret = -1;
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration, SXPLAYER_SEEK_PROGRESSIVE);
+    if (!s)
+        return -1;
+
+    struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, TARGET);
+    if (!frame || frame->ms > ref_ts) {
+        fprintf(stderr, "progressive: got %"PRId64", expected a placeholder up to %"PRId64"\n",
+                frame ? frame->ms : -1, ref_ts);
+        goto end;
+    }
+
+    /* The placeholder is followed by the exact frame */
+    if (frame->ms != ref_ts) {
+        sxplayer_release_frame(frame);
+        frame = sxplayer_get_frame_ms(s, TARGET);
+        if (!frame || frame->ms != ref_ts) {
+            fprintf(stderr, "progressive: got %"PRId64" after the placeholder, expected %"PRId64"\n",
+                    frame ? frame->ms : -1, ref_ts);
+            goto end;
+        }
+    }
+    sxplayer_release_frame(frame);
+
+    /* Same with the frames delivered in sequence after an explicit seek */
+    sxplayer_seek(s, TARGET / 1000000.);
+    frame = sxplayer_get_next_frame(s);
+    if (frame && frame->ms != ref_ts) {
+        sxplayer_release_frame(frame);
+        frame = sxplayer_get_next_frame(s);
+    }
+    if (!frame || frame->ms != ref_ts) {
+        fprintf(stderr, "progressive: got %"PRId64" after seeking, expected %"PRId64"\n",
+                frame ? frame->ms : -1, ref_ts);
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    sxplayer_release_frame(frame);
+    sxplayer_free(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct sxplayer_ctx *s = create_context(filename, use_pkt_duration, SXPLAYER_SEEK_PRECISE);
+    if (!s)
+        return -1;
+
+    int ret = -1;
+    struct sxplayer_frame *frame = sxplayer_get_frame_ms(s, TARGET);
+    if (!frame) {
+        fprintf(stderr, "unable to get the reference frame\n");
+        goto end;
+    }
+    const int64_t ref_ts = frame->ms;
+    sxplayer_release_frame(frame);
+
+    ret = check_keyframe(filename, use_pkt_duration, ref_ts);
+    if (ret < 0)
+        goto end;
+
+    ret = check_progressive(filename, use_pkt_duration, ref_ts);
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}
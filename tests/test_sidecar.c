@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <sxplayer.h>
+
+#define NB_CHECKS 10
+
+static struct sxplayer_ctx *open_media(const char *filename, const char *cache_dir, int use_pkt_duration)
+{
+    struct sxplayer_ctx *s = sxplayer_create(filename);
+    if (!s)
+        return NULL;
+    sxplayer_set_option(s, "auto_hwaccel", 0);
+    sxplayer_set_option(s, "index_scan", 1);
+    sxplayer_set_option(s, "use_pkt_duration", use_pkt_duration);
+    sxplayer_set_option(s, "index_cache_dir", cache_dir);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 3) {
+        fprintf(stderr, "Usage: %s <media.mkv> <cache_dir> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const char *cache_dir = av[2];
+    const int use_pkt_duration = ac > 3 ? atoi(av[3]) : 0;
+
+    int ret = 0;
+    double ts[NB_CHECKS];
+    struct sxplayer_info info, cached_info;
+
+    /* First opening: the sidecar is written once the packet scan is done,
+     * which is expected to happen long before all the frames are decoded */
+    struct sxplayer_ctx *s = open_media(filename, cache_dir, use_pkt_duration);
+    if (!s)
+        return -1;
+    while (!ret) {
+        struct sxplayer_frame *frame = sxplayer_get_next_frame(s);
+        if (!frame)
+            break;
+        sxplayer_release_frame(frame);
+    }
+    ret = sxplayer_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+    for (int i = 0; i < NB_CHECKS; i++) {
+        struct sxplayer_frame *frame = sxplayer_get_frame(s, i * info.duration / NB_CHECKS);
+        ts[i] = frame ? frame->ts : -1;
+        sxplayer_release_frame(frame);
+    }
+    sxplayer_free(&s);
+
+    if (!info.nb_frames) {
+        fprintf(stderr, "packet index not complete\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* Second opening: everything must be available from the sidecar */
+    s = open_media(filename, cache_dir, use_pkt_duration);
+    if (!s)
+        return -1;
+    ret = sxplayer_get_info(s, &cached_info);
+    if (ret < 0)
+        goto end;
+
+    if (cached_info.width != info.width || cached_info.height != info.height ||
+        cached_info.duration != info.duration ||
+        cached_info.timebase[0] != info.timebase[0] || cached_info.timebase[1] != info.timebase[1] ||
+        cached_info.nb_frames != info.nb_frames || cached_info.nb_keyframes != info.nb_keyframes) {
+        fprintf(stderr, "info mismatch: %dx%d %f %"PRId64"/%"PRId64" frames vs "
+                "%dx%d %f %"PRId64"/%"PRId64" frames\n",
+                cached_info.width, cached_info.height, cached_info.duration,
+                cached_info.nb_keyframes, cached_info.nb_frames,
+                info.width, info.height, info.duration,
+                info.nb_keyframes, info.nb_frames);
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < NB_CHECKS; i++) {
+        const double t = i * info.duration / NB_CHECKS;
+        struct sxplayer_frame *frame = sxplayer_get_frame(s, t);
+        const double frame_ts = frame ? frame->ts : -1;
+        sxplayer_release_frame(frame);
+        if (frame_ts != ts[i]) {
+            fprintf(stderr, "got frame %f at t=%f instead of %f\n", frame_ts, t, ts[i]);
+            ret = -1;
+            break;
+        }
+    }
+
+end:
+    sxplayer_free(&s);
+    return ret;
+}